@@ -371,6 +371,11 @@ void Model_NextDownload (void)
 			return;		// started a download
 	}
 
+	// let the filesystem expand compressed models while the map loads
+	for (i=1 ; i<MAX_MODELS && cl.model_name[i][0] ; i++)
+		if (cl.model_name[i][0] != '*')
+			FS_PrefetchFile (cl.model_name[i]);
+
 	cl.clipmodels[1] = CM_LoadMap (cl.model_name[1], true, NULL, &cl.map_checksum2);
 
 	for (i=1 ; i<MAX_MODELS ; i++)
@@ -393,6 +398,7 @@ void Model_NextDownload (void)
 		if (cl.model_name[i][0] == '*')
 			cl.clipmodels[i] = CM_InlineModel(cl.model_name[i]);
 	}
+	FS_FlushPrefetch ();
 
 #ifdef VWEP_TEST
 	// done with normal models, request vwep models if necessary
@@ -431,12 +437,16 @@ void Sound_NextDownload (void)
 			return;		// started a download
 	}
 
+	for (i=1 ; i<MAX_SOUNDS && cl.sound_name[i][0] ; i++)
+		FS_PrefetchFile (va("sound/%s", cl.sound_name[i]));
+
 	for (i=1 ; i<MAX_SOUNDS ; i++)
 	{
 		if (!cl.sound_name[i][0])
 			break;
 		cl.sound_precache[i] = S_PrecacheSound (cl.sound_name[i]);
 	}
+	FS_FlushPrefetch ();
 
 	// done with sounds, request models now
 	memset (cl.model_precache, 0, sizeof(cl.model_precache));
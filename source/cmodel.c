@@ -20,6 +20,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // cmodel.c
 
 #include "common.h"
+#include "sys.h"
 
 #ifdef hpux
 	// HP-UX already has a typedef cnode_t
@@ -91,6 +92,315 @@ static byte			*cmod_base;					// for CM_Load* functions
 
 
 
+/*
+===============================================================================
+
+TRACE NODES
+
+A copy of each clipnode with its plane folded in, so the trace kernel reads
+one small record per level instead of chasing a clipnode and then a plane.
+There is one array parallel to map_clipnodes (hulls 1 and 2 of every model),
+one for hull 0, and one for the box hull that CM_HullForBox keeps current.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	float	normal[3];
+	float	dist;
+	short	type;			// plane type, < 3 is axial
+	short	children[2];	// same as the clipnode's
+} tracenode_t;
+
+static tracenode_t	*map_tracenodes;		// parallel to map_clipnodes
+static dclipnode_t	*map_hull0clipnodes;
+static tracenode_t	*map_hull0tracenodes;	// parallel to map_hull0clipnodes
+static tracenode_t	box_tracenodes[6];
+
+static void CM_FillTraceNodes (tracenode_t *out, dclipnode_t *in, mplane_t *planes, int count)
+{
+	mplane_t	*plane;
+	int			i;
+
+	for (i = 0; i < count; i++, in++, out++)
+	{
+		plane = planes + in->planenum;
+		VectorCopy (plane->normal, out->normal);
+		out->dist = plane->dist;
+		out->type = plane->type;
+		out->children[0] = in->children[0];
+		out->children[1] = in->children[1];
+	}
+}
+
+static tracenode_t *CM_MakeTraceNodes (dclipnode_t *in, int count)
+{
+	tracenode_t	*out;
+
+	out = Hunk_AllocName (count * sizeof(*out), loadname);
+	CM_FillTraceNodes (out, in, map_planes, count);
+	return out;
+}
+
+
+/*
+===============================================================================
+
+CONTENTS GRID
+
+With cm_contentsgrid 1 (checked at map load), the world's bounds are cut
+into cells and every cell that has the same hull 0 contents all over gets
+them stored, so CM_HullPointContents on the world can skip the walk from
+the root.  Cells are grouped into blocks of CG_BLOCK^3; a block that is
+uniform as a whole stores just its contents, the rest get one byte per
+cell.  Cells crossing a contents boundary still walk the tree.
+
+===============================================================================
+*/
+
+cvar_t	cm_contentsgrid = {"cm_contentsgrid", "0"};
+
+#define	CG_BLOCK		8			// cells per block side
+#define	CG_BLOCKCELLS	(CG_BLOCK*CG_BLOCK*CG_BLOCK)
+#define	CG_MAXBLOCKS	(64*64*64)
+#define	CG_MARGIN		1			// cells are tested this much larger
+#define	CG_BUDGET		256			// node visits allowed to prove a box uniform
+
+static int			*cg_blocks;		// < 0 is uniform contents, else index into cg_cells
+static signed char	*cg_cells;		// contents, 0 if the cell isn't uniform
+static int			cg_numcells;	// blocks that have cells
+static int			cg_dims[3];		// in blocks
+static vec3_t		cg_mins, cg_maxs;
+static float		cg_cellsize, cg_invcellsize;
+static int			cg_headnode;	// world hull 0
+
+static struct {
+	int		hits;
+	int		boundary;
+	int		outside;
+} cg_stats;
+
+// 1 if the box is entirely in front of the node, 2 if entirely behind, 3 if both
+static int CM_BoxSide (const tracenode_t *node, vec3_t mins, vec3_t maxs)
+{
+	float	dmin, dmax;
+	int		i;
+
+	if (node->type < 3)
+	{
+		if (mins[node->type] - node->dist >= 0)
+			return 1;
+		if (maxs[node->type] - node->dist < 0)
+			return 2;
+		return 3;
+	}
+
+	dmin = dmax = -node->dist;
+	for (i = 0; i < 3; i++)
+	{
+		if (node->normal[i] < 0) {
+			dmin += node->normal[i] * maxs[i];
+			dmax += node->normal[i] * mins[i];
+		} else {
+			dmin += node->normal[i] * mins[i];
+			dmax += node->normal[i] * maxs[i];
+		}
+	}
+
+	if (dmin >= 0)
+		return 1;
+	if (dmax < 0)
+		return 2;
+	return 3;
+}
+
+// returns the contents if the whole box has the same, else 0
+static int CM_BoxContents_r (int num, vec3_t mins, vec3_t maxs, int *budget)
+{
+	const tracenode_t	*node;
+	int		side, front, back;
+
+	while (num >= 0)
+	{
+		if (--*budget < 0)
+			return 0;
+
+		node = map_hull0tracenodes + num;
+		side = CM_BoxSide (node, mins, maxs);
+		if (side != 3) {
+			num = node->children[side - 1];
+			continue;
+		}
+
+		front = CM_BoxContents_r (node->children[0], mins, maxs, budget);
+		if (!front)
+			return 0;
+		back = CM_BoxContents_r (node->children[1], mins, maxs, budget);
+		return front == back ? front : 0;
+	}
+
+	return num;
+}
+
+// the first node whose plane the box crosses
+static int CM_BoxHeadnode (int num, vec3_t mins, vec3_t maxs)
+{
+	const tracenode_t	*node;
+	int		side;
+
+	while (num >= 0)
+	{
+		node = map_hull0tracenodes + num;
+		side = CM_BoxSide (node, mins, maxs);
+		if (side == 3)
+			break;
+		num = node->children[side - 1];
+	}
+
+	return num;
+}
+
+// the box of size^3 cells starting at cell x, y, z
+static void CM_CellBounds (int x, int y, int z, int size, vec3_t mins, vec3_t maxs)
+{
+	mins[0] = cg_mins[0] + x * cg_cellsize - CG_MARGIN;
+	mins[1] = cg_mins[1] + y * cg_cellsize - CG_MARGIN;
+	mins[2] = cg_mins[2] + z * cg_cellsize - CG_MARGIN;
+	maxs[0] = cg_mins[0] + (x + size) * cg_cellsize + CG_MARGIN;
+	maxs[1] = cg_mins[1] + (y + size) * cg_cellsize + CG_MARGIN;
+	maxs[2] = cg_mins[2] + (z + size) * cg_cellsize + CG_MARGIN;
+}
+
+static void CM_BuildContentsGrid (void)
+{
+	int		*headnodes;
+	int		i, x, y, z, cx, cy, cz, b, contents, budget;
+	vec3_t	mins, maxs;
+	signed char	*cell;
+
+	cg_blocks = NULL;
+	cg_cells = NULL;
+	cg_numcells = 0;
+
+	if (!cm_contentsgrid.value)
+		return;
+
+	cg_headnode = map_cmodels[0].hulls[0].firstclipnode;
+	VectorCopy (map_cmodels[0].mins, cg_mins);
+
+	// cells are a power of two so that finding one is exact enough,
+	// big enough to keep the block table in bounds
+	for (cg_cellsize = 16; ; cg_cellsize *= 2)
+	{
+		for (i = 0; i < 3; i++)
+			cg_dims[i] = (int)ceil((map_cmodels[0].maxs[i] - cg_mins[i]) / (cg_cellsize * CG_BLOCK)) + 1;
+		if (cg_dims[0] * cg_dims[1] * cg_dims[2] <= CG_MAXBLOCKS)
+			break;
+	}
+	cg_invcellsize = 1.0 / cg_cellsize;
+	for (i = 0; i < 3; i++)
+		cg_maxs[i] = cg_mins[i] + cg_dims[i] * CG_BLOCK * cg_cellsize;
+
+	cg_blocks = Hunk_AllocName (cg_dims[0] * cg_dims[1] * cg_dims[2] * sizeof(*cg_blocks), loadname);
+	headnodes = Q_malloc (cg_dims[0] * cg_dims[1] * cg_dims[2] * sizeof(*headnodes));
+
+	// find the blocks that are uniform as a whole
+	for (z = 0, b = 0; z < cg_dims[2]; z++)
+		for (y = 0; y < cg_dims[1]; y++)
+			for (x = 0; x < cg_dims[0]; x++, b++)
+			{
+				CM_CellBounds (x*CG_BLOCK, y*CG_BLOCK, z*CG_BLOCK, CG_BLOCK, mins, maxs);
+				budget = CG_BUDGET;
+				contents = CM_BoxContents_r (cg_headnode, mins, maxs, &budget);
+				if (contents) {
+					cg_blocks[b] = contents;
+					continue;
+				}
+				headnodes[b] = CM_BoxHeadnode (cg_headnode, mins, maxs);
+				cg_blocks[b] = cg_numcells++;
+			}
+
+	// and fill in the cells of the others
+	cg_cells = Hunk_AllocName (cg_numcells * CG_BLOCKCELLS, loadname);
+	for (z = 0, b = 0; z < cg_dims[2]; z++)
+		for (y = 0; y < cg_dims[1]; y++)
+			for (x = 0; x < cg_dims[0]; x++, b++)
+			{
+				if (cg_blocks[b] < 0)
+					continue;
+				cell = cg_cells + cg_blocks[b] * CG_BLOCKCELLS;
+				for (cz = 0; cz < CG_BLOCK; cz++)
+					for (cy = 0; cy < CG_BLOCK; cy++)
+						for (cx = 0; cx < CG_BLOCK; cx++, cell++)
+						{
+							CM_CellBounds (x*CG_BLOCK + cx, y*CG_BLOCK + cy, z*CG_BLOCK + cz, 1, mins, maxs);
+							budget = CG_BUDGET;
+							*cell = CM_BoxContents_r (headnodes[b], mins, maxs, &budget);
+						}
+			}
+
+	Q_free (headnodes);
+}
+
+// returns 0 if p isn't in a uniform cell
+static int CM_GridContents (vec3_t p)
+{
+	int		x, y, z, b, contents;
+
+	if (p[0] < cg_mins[0] || p[1] < cg_mins[1] || p[2] < cg_mins[2]
+		|| p[0] >= cg_maxs[0] || p[1] >= cg_maxs[1] || p[2] >= cg_maxs[2]) {
+		cg_stats.outside++;
+		return 0;
+	}
+
+	x = (int)((p[0] - cg_mins[0]) * cg_invcellsize);
+	y = (int)((p[1] - cg_mins[1]) * cg_invcellsize);
+	z = (int)((p[2] - cg_mins[2]) * cg_invcellsize);
+
+	b = ((z / CG_BLOCK) * cg_dims[1] + y / CG_BLOCK) * cg_dims[0] + x / CG_BLOCK;
+	contents = cg_blocks[b];
+	if (contents >= 0)
+		contents = cg_cells[contents * CG_BLOCKCELLS + (((z % CG_BLOCK) * CG_BLOCK
+			+ y % CG_BLOCK) * CG_BLOCK + x % CG_BLOCK)];
+
+	if (contents)
+		cg_stats.hits++;
+	else
+		cg_stats.boundary++;
+	return contents;
+}
+
+/*
+==================
+CM_ContentsStats_f
+==================
+*/
+static void CM_ContentsStats_f (void)
+{
+	int		total, blocks;
+
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+		memset (&cg_stats, 0, sizeof(cg_stats));
+		return;
+	}
+
+	if (!cg_blocks) {
+		Com_Printf ("no contents grid%s\n", cm_contentsgrid.value ? " (takes effect on the next map)" : "");
+		return;
+	}
+
+	blocks = cg_dims[0] * cg_dims[1] * cg_dims[2];
+	total = cg_stats.hits + cg_stats.boundary + cg_stats.outside;
+	Com_Printf ("%i x %i x %i cells of %i units\n", cg_dims[0] * CG_BLOCK,
+		cg_dims[1] * CG_BLOCK, cg_dims[2] * CG_BLOCK, (int)cg_cellsize);
+	Com_Printf ("%i blocks, %i uniform, memory %i KB\n", blocks, blocks - cg_numcells,
+		(blocks * (int)sizeof(*cg_blocks) + cg_numcells * CG_BLOCKCELLS + 1023) / 1024);
+	Com_Printf ("hits: %i  boundary: %i  outside: %i  (%.1f%% hits)\n", cg_stats.hits,
+		cg_stats.boundary, cg_stats.outside, total ? 100.0 * cg_stats.hits / total : 0.0);
+}
+
+
 /*
 ===============================================================================
 
@@ -135,6 +445,7 @@ static void CM_InitBoxHull (void)
 		box_planes[i].normal[i>>1] = 1;
 	}
 
+	CM_FillTraceNodes (box_tracenodes, box_clipnodes, box_planes, 6);
 }
 
 
@@ -153,6 +464,13 @@ hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs)
 	box_planes[4].dist = maxs[2];
 	box_planes[5].dist = mins[2];
 
+	box_tracenodes[0].dist = maxs[0];
+	box_tracenodes[1].dist = mins[0];
+	box_tracenodes[2].dist = maxs[1];
+	box_tracenodes[3].dist = mins[1];
+	box_tracenodes[4].dist = maxs[2];
+	box_tracenodes[5].dist = mins[2];
+
 	return &box_hull;
 }
 
@@ -160,9 +478,17 @@ hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs)
 int CM_HullPointContents (hull_t *hull, int num, vec3_t p)
 {
 	float		d;
+	int			contents;
 	dclipnode_t	*node;
 	mplane_t	*plane;
 
+	if (cg_blocks && num == cg_headnode && hull->clipnodes == map_hull0clipnodes)
+	{
+		contents = CM_GridContents (p);
+		if (contents)
+			return contents;
+	}
+
 	while (num >= 0)
 	{
 		if (num < hull->firstclipnode || num > hull->lastclipnode)
@@ -332,9 +658,209 @@ static qbool RecursiveHullTrace (int num, float p1f, float p2f, vec3_t p1, vec3_
 	return false;
 }
 
-// trace a line through the supplied clipping hull
-// does not fill trace.e.ent
-trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
+// returns NULL for clipnodes we didn't build trace nodes for
+static tracenode_t *CM_TraceNodesForHull (hull_t *hull)
+{
+	if (hull->clipnodes == map_clipnodes && hull->planes == map_planes)
+		return map_tracenodes;
+	if (hull->clipnodes == map_hull0clipnodes && hull->planes == map_planes)
+		return map_hull0tracenodes;
+	if (hull->clipnodes == box_clipnodes)
+		return box_tracenodes;
+	return NULL;
+}
+
+
+static int CM_TracePointContents (const tracenode_t *nodes, int num, vec3_t p)
+{
+	const tracenode_t	*node;
+	float		d;
+
+	while (num >= 0)
+	{
+		if (num < trace_hull.firstclipnode || num > trace_hull.lastclipnode)
+			Sys_Error ("CM_HullPointContents: bad node number");
+
+		node = nodes + num;
+		if (node->type < 3)
+			d = p[node->type] - node->dist;
+		else
+			d = DotProduct (node->normal, p) - node->dist;
+		if (d < 0)
+			num = node->children[1];
+		else
+			num = node->children[0];
+	}
+
+	return num;
+}
+
+#define	TRACE_STACK		256
+
+typedef struct
+{
+	const tracenode_t	*node;
+	int		side;
+	float	frac;
+	float	p1f, p2f, midf;
+	vec3_t	p1, p2, mid;
+} traceframe_t;
+
+/*
+==================
+CM_TraceNodes
+
+The same walk as RecursiveHullTrace from node num, with the pending far
+sides kept on an explicit stack.  Every float is computed by the same expression in the
+same order, so the results are bit-identical.  Returns false if the tree
+is too deep for the stack, then trace_trace is garbage.
+==================
+*/
+static qbool CM_TraceNodes (const tracenode_t *nodes, int num, vec3_t start, vec3_t end)
+{
+	traceframe_t		stack[TRACE_STACK], *f;
+	const tracenode_t	*node;
+	vec3_t	p1, p2;
+	float	p1f, p2f;
+	float	t1, t2;
+	float	frac;
+	int		side, depth;
+	int		i;
+
+	p1f = 0;
+	p2f = 1;
+	VectorCopy (start, p1);
+	VectorCopy (end, p2);
+	depth = 0;
+
+	while (1)
+	{
+		while (num >= 0)
+		{
+			if (num < trace_hull.firstclipnode || num > trace_hull.lastclipnode)
+				Sys_Error ("RecursiveHullTrace: bad node number");
+
+			node = nodes + num;
+			if (node->type < 3)
+			{
+				t1 = p1[node->type] - node->dist;
+				t2 = p2[node->type] - node->dist;
+			}
+			else
+			{
+				t1 = DotProduct (node->normal, p1) - node->dist;
+				t2 = DotProduct (node->normal, p2) - node->dist;
+			}
+
+			if (t1 >= 0 && t2 >= 0) {
+				num = node->children[0];
+				continue;
+			}
+			if (t1 < 0 && t2 < 0) {
+				num = node->children[1];
+				continue;
+			}
+
+			// put the crosspoint DIST_EPSILON pixels on the near side
+			if (t1 < 0)
+				frac = (t1 + DIST_EPSILON)/(t1-t2);
+			else
+				frac = (t1 - DIST_EPSILON)/(t1-t2);
+			if (frac < 0)
+				frac = 0;
+			if (frac > 1)
+				frac = 1;
+
+			if (depth == TRACE_STACK)
+				return false;
+			f = &stack[depth++];
+
+			side = (t1 < 0);
+			f->node = node;
+			f->side = side;
+			f->frac = frac;
+			f->p1f = p1f;
+			f->p2f = p2f;
+			f->midf = p1f + (p2f - p1f)*frac;
+			for (i=0 ; i<3 ; i++)
+				f->mid[i] = p1[i] + frac*(p2[i] - p1[i]);
+			VectorCopy (p1, f->p1);
+			VectorCopy (p2, f->p2);
+
+			// move up to the node
+			num = node->children[side];
+			p2f = f->midf;
+			VectorCopy (f->mid, p2);
+		}
+
+		// reached a leaf
+		if (num != CONTENTS_SOLID)
+		{
+			trace_trace.allsolid = false;
+			if (num == CONTENTS_EMPTY)
+				trace_trace.inopen = true;
+			else
+				trace_trace.inwater = true;
+		}
+		else
+			trace_trace.startsolid = true;
+
+		if (!depth)
+			return true;		// went all the way through
+		f = &stack[--depth];
+		node = f->node;
+		side = f->side;
+
+		if (CM_TracePointContents (nodes, node->children[side^1], f->mid)
+		!= CONTENTS_SOLID)
+		{	// go past the node
+			num = node->children[side^1];
+			p1f = f->midf;
+			p2f = f->p2f;
+			VectorCopy (f->mid, p1);
+			VectorCopy (f->p2, p2);
+			continue;
+		}
+
+		if (trace_trace.allsolid)
+			return true;		// never got out of the solid area
+
+		// the other side of the node is solid, this is the impact point
+		if (!side)
+		{
+			VectorCopy (node->normal, trace_trace.plane.normal);
+			trace_trace.plane.dist = node->dist;
+		}
+		else
+		{
+			VectorNegate (node->normal, trace_trace.plane.normal);
+			trace_trace.plane.dist = -node->dist;
+		}
+
+		frac = f->frac;
+		while (CM_TracePointContents (nodes, trace_hull.firstclipnode, f->mid)
+		== CONTENTS_SOLID)
+		{ // shouldn't really happen, but does occasionally
+			frac -= 0.1;
+			if (frac < 0)
+			{
+				trace_trace.fraction = f->midf;
+				VectorCopy (f->mid, trace_trace.endpos);
+				Com_DPrintf ("backup past 0\n");
+				return true;
+			}
+			f->midf = f->p1f + (f->p2f - f->p1f)*frac;
+			for (i=0 ; i<3 ; i++)
+				f->mid[i] = f->p1[i] + frac*(f->p2[i] - f->p1[i]);
+		}
+
+		trace_trace.fraction = f->midf;
+		VectorCopy (f->mid, trace_trace.endpos);
+		return true;
+	}
+}
+
+static void CM_StartTrace (hull_t *hull, vec3_t end)
 {
 	// fill in a default trace
 	memset (&trace_trace, 0, sizeof(trace_trace));
@@ -344,12 +870,251 @@ trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 	VectorCopy (end, trace_trace.endpos);
 
 	trace_hull = *hull;
+}
+
+// trace a line through the supplied clipping hull
+// does not fill trace.e.ent
+trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
+{
+	tracenode_t	*nodes;
 
-	RecursiveHullTrace (trace_hull.firstclipnode, 0, 1, start, end);
+	CM_StartTrace (hull, end);
+
+	nodes = CM_TraceNodesForHull (hull);
+	if (!nodes || !CM_TraceNodes (nodes, trace_hull.firstclipnode, start, end))
+	{
+		CM_StartTrace (hull, end);
+		RecursiveHullTrace (trace_hull.firstclipnode, 0, 1, start, end);
+	}
 
 	return trace_trace;
 }
 
+static hull_t	*batch_hull;
+static vec3_t	*batch_starts, *batch_ends;
+static trace_t	*batch_traces;
+
+// finishes ray i on its own from node num
+static void CM_TraceBatchRay (const tracenode_t *nodes, int num, int i)
+{
+	CM_StartTrace (batch_hull, batch_ends[i]);
+	if (!CM_TraceNodes (nodes, num, batch_starts[i], batch_ends[i]))
+	{
+		CM_StartTrace (batch_hull, batch_ends[i]);
+		RecursiveHullTrace (trace_hull.firstclipnode, 0, 1, batch_starts[i], batch_ends[i]);
+	}
+	batch_traces[i] = trace_trace;
+}
+
+static void CM_TraceBatch_r (const tracenode_t *nodes, int num, int *rays, int count)
+{
+	const tracenode_t	*node;
+	float	t1, t2;
+	int		i, r, front, back;
+
+	while (count)
+	{
+		if (num < 0)
+		{
+			for (i = 0; i < count; i++)
+				CM_TraceBatchRay (nodes, num, rays[i]);
+			return;
+		}
+
+		if (num < batch_hull->firstclipnode || num > batch_hull->lastclipnode)
+			Sys_Error ("CM_HullTraceBatch: bad node number");
+
+		node = nodes + num;
+
+		// sort the rays into the ones entirely in front, which go to the
+		// start of the list, and the ones entirely behind, which go to the
+		// end; the rest cross the plane and are finished right away
+		front = 0;
+		back = count;
+		for (i = 0; i < back; )
+		{
+			r = rays[i];
+			if (node->type < 3)
+			{
+				t1 = batch_starts[r][node->type] - node->dist;
+				t2 = batch_ends[r][node->type] - node->dist;
+			}
+			else
+			{
+				t1 = DotProduct (node->normal, batch_starts[r]) - node->dist;
+				t2 = DotProduct (node->normal, batch_ends[r]) - node->dist;
+			}
+
+			if (t1 >= 0 && t2 >= 0) {
+				rays[i++] = rays[front];
+				rays[front++] = r;
+			}
+			else if (t1 < 0 && t2 < 0) {
+				rays[i] = rays[--back];
+				rays[back] = r;
+			}
+			else {
+				CM_TraceBatchRay (nodes, num, r);
+				i++;
+			}
+		}
+
+		if (front)
+			CM_TraceBatch_r (nodes, node->children[0], rays, front);
+
+		num = node->children[1];
+		rays += back;
+		count -= back;
+	}
+}
+
+/*
+==================
+CM_HullTraceBatch
+
+Gives the same results as count calls to CM_HullTrace.  The rays go down
+the tree together while they stay on one side of each plane, and a ray is
+split off at the first node it crosses, which is where a single trace would
+start recursing anyway.
+==================
+*/
+void CM_HullTraceBatch (hull_t *hull, int count, vec3_t *starts, vec3_t *ends, trace_t *traces)
+{
+	tracenode_t	*nodes;
+	int			rays[CM_MAX_TRACEBATCH];
+	int			i, n;
+
+	nodes = CM_TraceNodesForHull (hull);
+	if (!nodes)
+	{
+		for (i = 0; i < count; i++)
+			traces[i] = CM_HullTrace (hull, starts[i], ends[i]);
+		return;
+	}
+
+	for ( ; count > 0; count -= n, starts += n, ends += n, traces += n)
+	{
+		n = min (count, CM_MAX_TRACEBATCH);
+		for (i = 0; i < n; i++)
+			rays[i] = i;
+
+		batch_hull = hull;
+		batch_starts = starts;
+		batch_ends = ends;
+		batch_traces = traces;
+		CM_TraceBatch_r (nodes, hull->firstclipnode, rays, n);
+	}
+}
+
+static qbool CM_SameTrace (trace_t *a, trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->inopen == b->inopen && a->inwater == b->inwater
+		&& !memcmp (&a->fraction, &b->fraction, sizeof(a->fraction))
+		&& !memcmp (a->endpos, b->endpos, sizeof(a->endpos))
+		&& !memcmp (&a->plane, &b->plane, sizeof(a->plane));
+}
+
+/*
+==================
+CM_BenchTrace_f
+
+Runs the same set of traces through the world hulls with RecursiveHullTrace,
+CM_TraceNodes and CM_HullTraceBatch, times them and checks that the results
+match bit for bit.
+The rays come from a fixed seed, so a map always gets the same set.
+==================
+*/
+static void CM_BenchTrace_f (void)
+{
+	vec3_t		*rays, *starts, *ends;
+	trace_t		*results, *batch, trace;
+	hull_t		*hull;
+	tracenode_t	*nodes;
+	double		start, time[3];
+	int			i, j, h, count, mismatches;
+	unsigned	seed;
+
+	if (!map_name[0]) {
+		Com_Printf ("no map loaded\n");
+		return;
+	}
+
+	count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 10000;
+	if (count < 1)
+		count = 1;
+
+	rays = Q_malloc (count * 2 * sizeof(*rays));
+	starts = Q_malloc (count * sizeof(*starts));
+	ends = Q_malloc (count * sizeof(*ends));
+	results = Q_malloc (count * sizeof(*results));
+	batch = Q_malloc (count * sizeof(*batch));
+
+	// mostly short moves like a player or a missile would make,
+	// and every fourth one across the map
+	seed = 1;
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < 3; j++) {
+			seed = seed * 1103515245 + 12345;
+			rays[i*2][j] = map_cmodels[0].mins[j] + (map_cmodels[0].maxs[j]
+				- map_cmodels[0].mins[j]) * ((seed >> 8) & 0xffff) / 0xffff;
+			seed = seed * 1103515245 + 12345;
+			if (i & 3)
+				rays[i*2+1][j] = rays[i*2][j] + (int)((seed >> 8) & 511) - 256;
+			else
+				rays[i*2+1][j] = map_cmodels[0].mins[j] + (map_cmodels[0].maxs[j]
+					- map_cmodels[0].mins[j]) * ((seed >> 8) & 0xffff) / 0xffff;
+		}
+		VectorCopy (rays[i*2], starts[i]);
+		VectorCopy (rays[i*2+1], ends[i]);
+	}
+
+	Com_Printf ("%i traces per hull\n", count);
+	Com_Printf ("hull  recursive usec  iterative usec  batch usec  mismatches\n");
+	for (h = 0; h < 3; h++)
+	{
+		hull = &map_cmodels[0].hulls[h];
+		nodes = CM_TraceNodesForHull (hull);
+
+		start = Sys_DoubleTime ();
+		for (i = 0; i < count; i++) {
+			CM_StartTrace (hull, rays[i*2+1]);
+			RecursiveHullTrace (trace_hull.firstclipnode, 0, 1, rays[i*2], rays[i*2+1]);
+			results[i] = trace_trace;
+		}
+		time[0] = Sys_DoubleTime () - start;
+
+		mismatches = 0;
+		start = Sys_DoubleTime ();
+		for (i = 0; i < count; i++) {
+			CM_StartTrace (hull, rays[i*2+1]);
+			if (!CM_TraceNodes (nodes, trace_hull.firstclipnode, rays[i*2], rays[i*2+1]))
+				Com_Printf ("trace %i: tree too deep\n", i);
+			trace = trace_trace;
+			if (!CM_SameTrace (&trace, &results[i]))
+				mismatches++;
+		}
+		time[1] = Sys_DoubleTime () - start;
+
+		start = Sys_DoubleTime ();
+		CM_HullTraceBatch (hull, count, starts, ends, batch);
+		time[2] = Sys_DoubleTime () - start;
+		for (i = 0; i < count; i++)
+			if (!CM_SameTrace (&batch[i], &results[i]))
+				mismatches++;
+
+		Com_Printf ("%4i  %14.3f  %14.3f  %10.3f  %10i\n", h, time[0] * 1000000 / count,
+			time[1] * 1000000 / count, time[2] * 1000000 / count, mismatches);
+	}
+
+	Q_free (rays);
+	Q_free (starts);
+	Q_free (ends);
+	Q_free (results);
+	Q_free (batch);
+}
+
 //===========================================================================
 
 
@@ -434,11 +1199,9 @@ crosses a waterline.
 
 =============================================================================
 */
-static int	fatbytes;
 static byte	fatpvs[MAX_MAP_LEAFS/8];
-static vec3_t	fatpvs_org;
 
-static void AddToFatPVS_r (cnode_t *node)
+static void AddToFatPVS_r (cnode_t *node, vec3_t org, byte *fat, int fatbytes)
 {
 	int		i;
 	byte	*pvs;
@@ -454,25 +1217,42 @@ static void AddToFatPVS_r (cnode_t *node)
 			{
 				pvs = CM_LeafPVS ( (cleaf_t *)node);
 				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
+					fat[i] |= pvs[i];
 			}
 			return;
 		}
 
 		plane = node->plane;
-		d = DotProduct (fatpvs_org, plane->normal) - plane->dist;
+		d = DotProduct (org, plane->normal) - plane->dist;
 		if (d > 8)
 			node = node->children[0];
 		else if (d < -8)
 			node = node->children[1];
 		else
 		{	// go down both
-			AddToFatPVS_r (node->children[0]);
+			AddToFatPVS_r (node->children[0], org, fat, fatbytes);
 			node = node->children[1];
 		}
 	}
 }
 
+/*
+=============
+CM_MakeFatPVS
+
+Same as CM_FatPVS, but writes to a caller supplied buffer of
+MAX_MAP_LEAFS/8 bytes so it can be used from several threads at once
+=============
+*/
+void CM_MakeFatPVS (vec3_t org, byte *pvs)
+{
+	int		fatbytes;
+
+	fatbytes = (visleafs+31)>>3;
+	memset (pvs, 0, fatbytes);
+	AddToFatPVS_r (map_nodes, org, pvs, fatbytes);
+}
+
 /*
 =============
 CM_FatPVS
@@ -483,11 +1263,7 @@ given point.
 */
 byte *CM_FatPVS (vec3_t org)
 {
-	VectorCopy (org, fatpvs_org);
-
-	fatbytes = (visleafs+31)>>3;
-	memset (fatpvs, 0, fatbytes);
-	AddToFatPVS_r (map_nodes);
+	CM_MakeFatPVS (org, fatpvs);
 	return fatpvs;
 }
 
@@ -771,6 +1547,8 @@ static void CM_MakeHull0 (void)
 	count = numnodes;
 	out = Hunk_AllocName ( count*sizeof(*out), loadname);
 
+	map_hull0clipnodes = out;
+
 	// fix up hull 0 in all cmodels
 	for (i = 0; i < numcmodels; i++) {
 		map_cmodels[i].hulls[0].clipnodes = out;
@@ -971,6 +1749,11 @@ void CM_InvalidateMap (void)
 	map_planes = NULL;
 	map_nodes = NULL;
 	map_clipnodes = NULL;
+	map_hull0clipnodes = NULL;
+	map_tracenodes = NULL;
+	map_hull0tracenodes = NULL;
+	cg_blocks = NULL;
+	cg_cells = NULL;
 	map_leafs = NULL;
 	map_pvs = NULL;
 	map_phs = NULL;
@@ -983,8 +1766,8 @@ void CM_InvalidateMap (void)
 cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned *checksum2)
 {
 	int			i;
-	dheader_t	*header;
-	unsigned int *buf;
+	dheader_t	header;
+	byte		*buf;
 
 	if (map_name[0]) {
 		assert(!strcmp(name, map_name));
@@ -995,16 +1778,18 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 		return &map_cmodels[0];		// still have the right version
 	}
 
-	// load the file
-	buf = (unsigned int *)FS_LoadTempFile (name);
+	// load the file, the data may be a read-only view into a mapped pak
+	buf = FS_ViewFile (name);
 	if (!buf)
 		Host_Error ("CM_LoadMap: %s not found", name);
+	if (fs_filesize < (int)sizeof(dheader_t))
+		Host_Error ("CM_LoadMap: %s is too short", name);
 
 	COM_FileBase (name, loadname);
 
-	header = (dheader_t *)buf;
+	memcpy (&header, buf, sizeof(header));
 
-	i = LittleLong (header->version);
+	i = LittleLong (header.version);
 	if (i != BSPVERSION && i != HL_BSPVERSION)
 		Host_Error ("CM_LoadMap: %s has wrong version number (%i should be %i)", name, i, BSPVERSION);
 
@@ -1015,39 +1800,44 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 		Cvar_ForceSet(Cvar_Get("sv_halflifebsp", "0", CVAR_ROM), map_halflife ? "1" : "0");
 
 	// swap all the lumps
-	cmod_base = (byte *)header;
+	cmod_base = buf;
 
 	for (i = 0; i < sizeof(dheader_t)/4; i++)
-		((int *)header)[i] = LittleLong(((int *)header)[i]);
+		((int *)&header)[i] = LittleLong(((int *)&header)[i]);
 
 	// checksum all of the map, except for entities
 	map_checksum = map_checksum2 = 0;
 	for (i = 0; i < HEADER_LUMPS; i++) {
 		if (i == LUMP_ENTITIES)
 			continue;
-		map_checksum ^= LittleLong(Com_BlockChecksum(cmod_base + header->lumps[i].fileofs,
-			header->lumps[i].filelen));
+		map_checksum ^= LittleLong(Com_BlockChecksum(cmod_base + header.lumps[i].fileofs,
+			header.lumps[i].filelen));
 
 		if (i == LUMP_VISIBILITY || i == LUMP_LEAFS || i == LUMP_NODES)
 			continue;
-		map_checksum2 ^= LittleLong(Com_BlockChecksum(cmod_base + header->lumps[i].fileofs,
-			header->lumps[i].filelen));
+		map_checksum2 ^= LittleLong(Com_BlockChecksum(cmod_base + header.lumps[i].fileofs,
+			header.lumps[i].filelen));
 	}
 	if (checksum)
 		*checksum = map_checksum;
 	*checksum2 = map_checksum2;
 
 	// load into heap
-	CM_LoadPlanes (&header->lumps[LUMP_PLANES]);
-	CM_LoadLeafs (&header->lumps[LUMP_LEAFS]);
-	CM_LoadNodes (&header->lumps[LUMP_NODES]);
-	CM_LoadClipnodes (&header->lumps[LUMP_CLIPNODES]);
-	CM_LoadEntities (&header->lumps[LUMP_ENTITIES]);
-	CM_LoadSubmodels (&header->lumps[LUMP_MODELS]);
+	CM_LoadPlanes (&header.lumps[LUMP_PLANES]);
+	CM_LoadLeafs (&header.lumps[LUMP_LEAFS]);
+	CM_LoadNodes (&header.lumps[LUMP_NODES]);
+	CM_LoadClipnodes (&header.lumps[LUMP_CLIPNODES]);
+	CM_LoadEntities (&header.lumps[LUMP_ENTITIES]);
+	CM_LoadSubmodels (&header.lumps[LUMP_MODELS]);
 
 	CM_MakeHull0 ();
 
-	CM_BuildPVS (&header->lumps[LUMP_VISIBILITY], &header->lumps[LUMP_LEAFS]);
+	map_tracenodes = CM_MakeTraceNodes (map_clipnodes, numclipnodes);
+	map_hull0tracenodes = CM_MakeTraceNodes (map_hull0clipnodes, numnodes);
+
+	CM_BuildContentsGrid ();
+
+	CM_BuildPVS (&header.lumps[LUMP_VISIBILITY], &header.lumps[LUMP_LEAFS]);
 
 	if (!clientload)			// client doesn't need PHS
 		CM_BuildPHS ();
@@ -1076,6 +1866,10 @@ void CM_Init (void)
 {
 	memset (map_novis, 0xff, sizeof(map_novis));
 	CM_InitBoxHull ();
+
+	Cvar_Register (&cm_contentsgrid);
+	Cmd_AddCommand ("bench_hulltrace", CM_BenchTrace_f);
+	Cmd_AddCommand ("contents_stats", CM_ContentsStats_f);
 }
 
 /* vi: set noet ts=4 sts=4 ai sw=4: */
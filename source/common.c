@@ -21,6 +21,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "common.h"
 #include "crc.h"
+#include <threads.h>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
 
 
 void R_BeginDisc (void);
@@ -35,6 +39,7 @@ static char	*largv[MAX_NUM_ARGVS + 1];
 
 cvar_t	developer = {"developer","0"};
 cvar_t	registered = {"registered","0"};
+cvar_t	fs_threads = {"fs_threads","2"};
 
 qbool	com_serveractive = false;
 
@@ -44,6 +49,7 @@ FILE	*logfile;
 
 void FS_InitFilesystem (void);
 void COM_Path_f (void);
+void FS_Stats_f (void);
 
 char	com_gamedirfile[MAX_QPATH];
 
@@ -373,11 +379,13 @@ void COM_Init (void)
 	Cvar_Register (&developer);
 	Cvar_Register (&registered);
 	Cvar_Register (&logfile_var);
+	Cvar_Register (&fs_threads);
 
 	if (COM_CheckParm("-condebug") || COM_CheckParm("-conlog"))
 		Cvar_SetValue (&logfile_var, 2);	// flush every write
 
 	Cmd_AddCommand ("path", COM_Path_f);
+	Cmd_AddCommand ("fs_stats", FS_Stats_f);
 }
 
 
@@ -461,10 +469,17 @@ int	fs_filesize;
 // in memory
 //
 
-typedef struct
+#define	PACK_STORED		0		// zip compression methods
+#define	PACK_DEFLATED	8
+
+typedef struct packfile_s
 {
 	char	name[MAX_QPATH];
 	int		filepos, filelen;
+	int		method;			// PACK_STORED for everything but deflated .pk3 entries
+	int		complen;		// .pk3: size of the data on disk
+	int		headerpos;		// .pk3: local header, filepos is -1 until it's read
+	struct packfile_s	*hash_next;
 } packfile_t;
 
 typedef struct pack_s
@@ -473,6 +488,10 @@ typedef struct pack_s
 	FILE	*handle;
 	int		numfiles;
 	packfile_t	*files;
+	packfile_t	**hash;		// hashsize chains, built by FS_LoadPackFile
+	int		hashsize;		// power of two
+	byte	*mapped;		// whole pak mapped read-only with -mappak, or NULL
+	int		mappedlen;
 } pack_t;
 
 //
@@ -493,6 +512,18 @@ typedef struct
 
 #define	MAX_FILES_IN_PACK	2048
 
+// .pk3 (zip) records, little endian and unaligned so they are read bytewise
+#define	ZIP_LOCAL_SIG		0x04034b50
+#define	ZIP_CENTRAL_SIG		0x02014b50
+#define	ZIP_END_SIG			0x06054b50
+#define	ZIP_LOCAL_SIZE		30
+#define	ZIP_CENTRAL_SIZE	46
+#define	ZIP_END_SIZE		22
+#define	ZIP_MAX_COMMENT		65535
+
+#define	FS_PREFETCH_MINSIZE	(32*1024)	// smaller files aren't worth a thread
+#define	FS_MAX_THREADS		8
+
 char	com_gamedir[MAX_OSPATH];
 char	com_basedir[MAX_OSPATH];
 
@@ -506,6 +537,38 @@ typedef struct searchpath_s
 searchpath_t	*com_searchpaths;
 searchpath_t	*com_base_searchpaths;	// without gamedirs
 
+//
+// merged index of all pak entries on com_searchpaths, so that the first
+// pak holding a given name can be found without walking every pak
+//
+typedef struct
+{
+	packfile_t		*file;		// NULL if the slot is empty
+	searchpath_t	*search;	// pak search path file belongs to
+} fsindex_t;
+
+static qbool		fs_mappaks;		// -mappak
+
+static fsindex_t	*fs_index;
+static int			fs_indexsize;		// power of two, 0 if not built
+static qbool		fs_index_dirty = true;
+
+typedef struct
+{
+	int		lookups;
+	int		pakhits;
+	int		dirhits;
+	int		misses;
+	int		rebuilds;
+	int		views;			// loads served straight from a mapped pak
+	int		inflated;		// deflated .pk3 entries expanded on the caller's thread
+	int		prefetched;		// deflated .pk3 entries expanded by a worker
+	double	time;			// total seconds spent in FS_FOpenFile lookups
+	double	maxtime;
+} fsstats_t;
+
+static fsstats_t	fs_stats;
+
 /*
 ================
 COM_filelength
@@ -539,6 +602,485 @@ int COM_FileOpenRead (char *path, FILE **hndl)
 	return COM_filelength(f);
 }
 
+/*
+================
+FS_HashFileName
+
+Pak lookups are case sensitive, like the strcmp they replace
+================
+*/
+static unsigned int FS_HashFileName (char *name)
+{
+	unsigned int	v;
+	unsigned char	c;
+
+	v = 2166136261u;
+	while ( (c = *name++) != 0 )
+	{
+		v ^= c;
+		v *= 16777619u;
+	}
+
+	return v;
+}
+
+/*
+================
+FS_FindInPack
+
+Returns the directory entry for filename, or NULL if pack doesn't hold it
+================
+*/
+static packfile_t *FS_FindInPack (pack_t *pack, char *filename)
+{
+	packfile_t	*file;
+
+	file = pack->hash[FS_HashFileName(filename) & (pack->hashsize - 1)];
+	for ( ; file ; file = file->hash_next)
+		if (!strcmp (file->name, filename))
+			return file;
+
+	return NULL;
+}
+
+/*
+================
+FS_BuildIndex
+
+Merges the directories of every pak on com_searchpaths into fs_index.
+Earlier search paths are inserted first, so they win just like they
+do in a linear walk of the path.
+================
+*/
+static void FS_BuildIndex (void)
+{
+	searchpath_t	*search;
+	fsindex_t		*slot;
+	packfile_t		*file;
+	int				i, total, size;
+	unsigned int	mask, h;
+
+	total = 0;
+	for (search = com_searchpaths ; search ; search = search->next)
+		if (search->pack)
+			total += search->pack->numfiles;
+
+	for (size = 64 ; size < total * 2 ; size <<= 1)
+		;
+
+	if (size != fs_indexsize)
+	{
+		Q_free (fs_index);
+		fs_index = Q_malloc (size * sizeof(fsindex_t));
+		fs_indexsize = size;
+	}
+	memset (fs_index, 0, fs_indexsize * sizeof(fsindex_t));
+	mask = fs_indexsize - 1;
+
+	for (search = com_searchpaths ; search ; search = search->next)
+	{
+		if (!search->pack)
+			continue;
+
+		for (i = 0, file = search->pack->files ; i < search->pack->numfiles ; i++, file++)
+		{
+			if (FS_FindInPack (search->pack, file->name) != file)
+				continue;	// duplicate name inside the pak, first one wins
+
+			for (h = FS_HashFileName(file->name) & mask ; ; h = (h + 1) & mask)
+			{
+				slot = &fs_index[h];
+				if (!slot->file)
+				{
+					slot->file = file;
+					slot->search = search;
+					break;
+				}
+				if (!strcmp (slot->file->name, file->name))
+					break;		// overridden by an earlier search path
+			}
+		}
+	}
+
+	fs_index_dirty = false;
+	fs_stats.rebuilds++;
+}
+
+/*
+================
+FS_LookupIndex
+================
+*/
+static fsindex_t *FS_LookupIndex (char *filename)
+{
+	fsindex_t		*slot;
+	unsigned int	mask, h;
+
+	if (fs_index_dirty)
+		FS_BuildIndex ();
+
+	mask = fs_indexsize - 1;
+	for (h = FS_HashFileName(filename) & mask ; ; h = (h + 1) & mask)
+	{
+		slot = &fs_index[h];
+		if (!slot->file)
+			return NULL;
+		if (!strcmp (slot->file->name, filename))
+			return slot;
+	}
+}
+
+/*
+================
+FS_FreePack
+
+Call FS_FlushPrefetch first
+================
+*/
+static void FS_FreePack (pack_t *pack)
+{
+	if (pack->mapped)
+		Sys_UnmapFile (pack->mapped, pack->mappedlen);
+	fclose (pack->handle);
+	Q_free (pack->hash);
+	Q_free (pack->files);
+	Q_free (pack);
+}
+
+/*
+=============================================================================
+
+.PK3 ENTRIES
+
+=============================================================================
+*/
+
+static int FS_ZipShort (byte *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static int FS_ZipLong (byte *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+/*
+================
+FS_ResolveZipEntry
+
+Zip central directories only give the offset of the local header, which
+has its own variable sized name and extra fields ahead of the data.
+Must be called from the main thread, it uses the pak's shared handle.
+================
+*/
+static qbool FS_ResolveZipEntry (pack_t *pack, packfile_t *file)
+{
+	byte	local[ZIP_LOCAL_SIZE];
+
+	if (file->filepos >= 0)
+		return true;
+
+	if (pack->mapped)
+	{
+		if (file->headerpos < 0 || file->headerpos > pack->mappedlen - ZIP_LOCAL_SIZE)
+			return false;
+		memcpy (local, pack->mapped + file->headerpos, ZIP_LOCAL_SIZE);
+	}
+	else
+	{
+		fseek (pack->handle, file->headerpos, SEEK_SET);
+		if (fread (local, 1, ZIP_LOCAL_SIZE, pack->handle) != ZIP_LOCAL_SIZE)
+			return false;
+	}
+
+	if (FS_ZipLong(local) != ZIP_LOCAL_SIG)
+		return false;
+
+	file->filepos = file->headerpos + ZIP_LOCAL_SIZE
+		+ FS_ZipShort(local + 26) + FS_ZipShort(local + 28);
+	return true;
+}
+
+/*
+================
+FS_MappedData
+
+Returns the file's bytes on disk inside its mapped pak, or NULL if the pak
+isn't mapped (or the directory entry points outside of it).
+For deflated entries that's the compressed data.
+================
+*/
+static byte *FS_MappedData (pack_t *pak, packfile_t *pakfile)
+{
+	int		len;
+
+	if (!pak->mapped)
+		return NULL;
+
+	len = pakfile->method == PACK_STORED ? pakfile->filelen : pakfile->complen;
+	if (pakfile->filepos < 0 || len < 0
+		|| pakfile->filepos > pak->mappedlen - len)
+		return NULL;
+
+	return pak->mapped + pakfile->filepos;
+}
+
+/*
+================
+FS_Inflate
+
+Expands raw deflate data (no zlib header, as stored in zip files)
+================
+*/
+static qbool FS_Inflate (byte *in, int inlen, byte *out, int outlen)
+{
+#ifdef WITH_ZLIB
+	z_stream	z;
+	int			ret;
+
+	memset (&z, 0, sizeof(z));
+	z.next_in = in;
+	z.avail_in = inlen;
+	z.next_out = out;
+	z.avail_out = outlen;
+
+	if (inflateInit2 (&z, -MAX_WBITS) != Z_OK)
+		return false;
+	ret = inflate (&z, Z_FINISH);
+	inflateEnd (&z);
+
+	return ret == Z_STREAM_END && z.total_out == (uLong)outlen;
+#else
+	(void)in; (void)inlen; (void)out; (void)outlen;
+	return false;
+#endif
+}
+
+/*
+================
+FS_InflateEntry
+
+Thread safe as long as the entry was resolved, the pak is only read
+through the mapping or a private handle.
+================
+*/
+static qbool FS_InflateEntry (pack_t *pack, packfile_t *file, byte *out)
+{
+	FILE	*f;
+	byte	*in;
+	qbool	ok;
+
+	if (file->filepos < 0)
+		return false;
+
+	if ( (in = FS_MappedData (pack, file)) != NULL )
+		return FS_Inflate (in, file->complen, out, file->filelen);
+
+	if ( !(f = fopen (pack->filename, "rb")) )
+		return false;
+	in = Q_malloc (file->complen);
+	fseek (f, file->filepos, SEEK_SET);
+	ok = (int)fread (in, 1, file->complen, f) == file->complen
+		&& FS_Inflate (in, file->complen, out, file->filelen);
+	fclose (f);
+	Q_free (in);
+
+	return ok;
+}
+
+
+/*
+=============================================================================
+
+.PK3 PREFETCHING
+
+Large deflated entries that are known to be needed soon (model and sound
+precache lists) are queued with FS_PrefetchFile and expanded on fs_threads
+worker threads, so the loaders only have to copy them out.
+
+=============================================================================
+*/
+
+typedef enum {FSJOB_QUEUED, FSJOB_RUNNING, FSJOB_DONE} fsjobstate_t;
+
+typedef struct fsjob_s
+{
+	pack_t		*pack;
+	packfile_t	*file;
+	byte		*data;			// Q_malloc'ed contents when done, NULL on failure
+	fsjobstate_t	state;
+	struct fsjob_s	*next;
+} fsjob_t;
+
+static fsjob_t	*fs_jobs;
+static mtx_t	fs_joblock;
+static cnd_t	fs_jobqueued;	// signalled when a job is added
+static cnd_t	fs_jobdone;		// broadcast when a job finishes
+static int		fs_numworkers;
+static int		fs_triedworkers = -1;	// fs_threads of the last start
+
+static int FS_Worker (void *unused)
+{
+	fsjob_t	*job;
+	byte	*data;
+
+	(void)unused;
+	mtx_lock (&fs_joblock);
+	while (1)
+	{
+		for (job = fs_jobs ; job ; job = job->next)
+			if (job->state == FSJOB_QUEUED)
+				break;
+		if (!job)
+		{
+			cnd_wait (&fs_jobqueued, &fs_joblock);
+			continue;
+		}
+
+		job->state = FSJOB_RUNNING;
+		mtx_unlock (&fs_joblock);
+
+		data = Q_malloc (job->file->filelen + 1);
+		if (!FS_InflateEntry (job->pack, job->file, data))
+		{
+			Q_free (data);
+			data = NULL;
+		}
+
+		mtx_lock (&fs_joblock);
+		job->data = data;
+		job->state = FSJOB_DONE;
+		cnd_broadcast (&fs_jobdone);
+	}
+
+	return 0;
+}
+
+// called once from FS_InitFilesystem
+static void FS_InitWorkers (void)
+{
+	mtx_init (&fs_joblock, mtx_plain);
+	cnd_init (&fs_jobqueued);
+	cnd_init (&fs_jobdone);
+}
+
+// tried once for each fs_threads value, not on every precache
+static void FS_StartWorkers (void)
+{
+	thrd_t	thread;
+	int		i, count;
+
+	count = bound (0, (int)fs_threads.value, FS_MAX_THREADS);
+	if (count == fs_triedworkers)
+		return;
+	fs_triedworkers = count;
+
+	for (i = 0 ; i < count ; i++)
+	{
+		if (thrd_create (&thread, FS_Worker, NULL) != thrd_success)
+			break;
+		thrd_detach (thread);
+		fs_numworkers++;
+	}
+}
+
+/*
+================
+FS_TakePrefetched
+
+If file was queued for prefetching, waits for it and returns the expanded
+data (Q_free it when done).  Returns NULL if it wasn't queued or failed.
+================
+*/
+static byte *FS_TakePrefetched (packfile_t *file)
+{
+	fsjob_t	*job, **prev;
+	byte	*data;
+
+	if (!fs_numworkers)
+		return NULL;
+
+	mtx_lock (&fs_joblock);
+	for (prev = &fs_jobs ; (job = *prev) != NULL ; prev = &job->next)
+		if (job->file == file)
+			break;
+	if (!job)
+	{
+		mtx_unlock (&fs_joblock);
+		return NULL;
+	}
+
+	while (job->state != FSJOB_DONE)
+		cnd_wait (&fs_jobdone, &fs_joblock);
+
+	// the list may have changed while we waited
+	for (prev = &fs_jobs ; *prev != job ; prev = &(*prev)->next)
+		;
+	*prev = job->next;
+	mtx_unlock (&fs_joblock);
+
+	data = job->data;
+	Q_free (job);
+	return data;
+}
+
+/*
+================
+FS_FlushPrefetch
+
+Waits for the workers and throws away everything nobody claimed.
+Must be called before any pak goes away.
+================
+*/
+void FS_FlushPrefetch (void)
+{
+	fsjob_t	*job;
+
+	if (!fs_numworkers)
+		return;
+
+	mtx_lock (&fs_joblock);
+	while (fs_jobs)
+	{
+		job = fs_jobs;
+		if (job->state != FSJOB_DONE)
+		{
+			cnd_wait (&fs_jobdone, &fs_joblock);
+			continue;
+		}
+		fs_jobs = job->next;
+		Q_free (job->data);
+		Q_free (job);
+	}
+	mtx_unlock (&fs_joblock);
+}
+
+/*
+================
+FS_ExpandEntry
+
+Fills out with the contents of a deflated entry, from the prefetch
+queue if a worker has (or is) expanding it
+================
+*/
+static void FS_ExpandEntry (pack_t *pack, packfile_t *file, byte *out)
+{
+	byte	*data;
+
+	if ( (data = FS_TakePrefetched (file)) != NULL )
+	{
+		memcpy (out, data, file->filelen);
+		Q_free (data);
+		fs_stats.prefetched++;
+		return;
+	}
+
+	if (!FS_ResolveZipEntry (pack, file) || !FS_InflateEntry (pack, file, out))
+		Sys_Error ("Couldn't inflate %s from %s", file->name, pack->filename);
+	fs_stats.inflated++;
+}
+
 /*
 ============
 COM_Path_f
@@ -658,92 +1200,213 @@ Sets fs_filesize and one of handle or file
 qbool	file_from_pak;		// global indicating file came from a packfile
 qbool	file_from_gamedir;	// global indicating file came from a gamedir (and gamedir wasn't id1/qw)
 
-int FS_FOpenFile (char *filename, FILE **file)
+/*
+===========
+FS_FindFile
+
+Pak hits only return the directory entry in *pakfile and the pak's
+search path, without opening anything.  Files found in a plain
+directory are opened into *file and NULL is returned.
+===========
+*/
+static searchpath_t *FS_FindFile (char *filename, packfile_t **pakfile, FILE **file)
 {
 	searchpath_t	*search;
+	fsindex_t		*found;
 	char		netpath[MAX_OSPATH];
-	pack_t		*pak;
-	int			i;
 
 	file_from_pak = false;
 	file_from_gamedir = true;
-	
+	*pakfile = NULL;
+
+	found = FS_LookupIndex (filename);
+
 //
-// search through the path, one element at a time
+// only plain directories can hold the file ahead of the indexed pak,
+// so those are the only elements that still have to be probed
 //
 	for (search = com_searchpaths ; search ; search = search->next)
 	{
 		if (search == com_base_searchpaths)
 			file_from_gamedir = false;
 
-	// is the element a pak file?
-		if (search->pack)
-		{
-		// look through all the pak file elements
-			pak = search->pack;
-			for (i=0 ; i<pak->numfiles ; i++)
-				if (!strcmp (pak->files[i].name, filename))
-				{	// found it!
-					if (developer.value)
-						Sys_Printf ("PackFile: %s : %s\n", pak->filename, filename);
-				// open a new file on the pakfile
-					*file = fopen (pak->filename, "rb");
-					if (!*file)
-						Sys_Error ("Couldn't reopen %s", pak->filename);
-					fseek (*file, pak->files[i].filepos, SEEK_SET);
-					fs_filesize = pak->files[i].filelen;
-					file_from_pak = true;
-					return fs_filesize;
-				}
+		if (found && search == found->search)
+		{	// found it!
+			if (developer.value)
+				Sys_Printf ("PackFile: %s : %s\n", search->pack->filename, filename);
+			*pakfile = found->file;
+			*file = NULL;
+			fs_filesize = found->file->filelen;
+			file_from_pak = true;
+			fs_stats.pakhits++;
+			return search;
 		}
-		else
-		{	
-			Q_snprintfz (netpath, sizeof(netpath), "%s/%s", search->filename, filename);
 
-			*file = fopen (netpath, "rb");
-			if (!*file)
-				continue;
-		
-			if (developer.value)
-				Sys_Printf ("FindFile: %s\n",netpath);
+		if (search->pack)
+			continue;
 
-			return COM_filelength (*file);
-		}
-	
+		Q_snprintfz (netpath, sizeof(netpath), "%s/%s", search->filename, filename);
+
+		*file = fopen (netpath, "rb");
+		if (!*file)
+			continue;
+
+		if (developer.value)
+			Sys_Printf ("FindFile: %s\n",netpath);
+
+		fs_filesize = COM_filelength (*file);
+		fs_stats.dirhits++;
+		return NULL;
 	}
 
 	if (developer.value)
 		Sys_Printf ("FindFile: can't find %s\n", filename);
 
+	fs_stats.misses++;
 	*file = NULL;
 	fs_filesize = -1;
-	return -1;
+	return NULL;
 }
 
 /*
-============
-FS_LoadFile
+===========
+FS_FindFileTimed
+===========
+*/
+static searchpath_t *FS_FindFileTimed (char *filename, packfile_t **pakfile, FILE **file)
+{
+	searchpath_t	*search;
+	double	start, elapsed;
 
-Filename are relative to the quake directory.
-Always appends a 0 byte to the loaded data.
+	start = Sys_DoubleTime ();
+	search = FS_FindFile (filename, pakfile, file);
+	elapsed = Sys_DoubleTime () - start;
+
+	fs_stats.lookups++;
+	fs_stats.time += elapsed;
+	if (elapsed > fs_stats.maxtime)
+		fs_stats.maxtime = elapsed;
+
+	return search;
+}
+
+int FS_FOpenFile (char *filename, FILE **file)
+{
+	searchpath_t	*search;
+	packfile_t		*pakfile;
+
+	byte			*data;
+
+	search = FS_FindFileTimed (filename, &pakfile, file);
+	if (!pakfile)
+		return fs_filesize;
+
+	if (pakfile->method == PACK_DEFLATED)
+	{	// callers want a stream, so hand them the expanded data in a temp file
+		data = Q_malloc (pakfile->filelen + 1);
+		FS_ExpandEntry (search->pack, pakfile, data);
+		*file = tmpfile ();
+		if (*file)
+		{
+			fwrite (data, 1, pakfile->filelen, *file);
+			rewind (*file);
+		}
+		Q_free (data);
+		if (!*file)
+		{
+			Com_Printf ("Couldn't create a temp file for %s\n", filename);
+			fs_filesize = -1;
+		}
+		return fs_filesize;
+	}
+
+	if (!FS_ResolveZipEntry (search->pack, pakfile))
+		Sys_Error ("Bad zip entry %s in %s", pakfile->name, search->pack->filename);
+
+// open a new file on the pakfile
+	*file = fopen (search->pack->filename, "rb");
+	if (!*file)
+		Sys_Error ("Couldn't reopen %s", search->pack->filename);
+	fseek (*file, pakfile->filepos, SEEK_SET);
+
+	return fs_filesize;
+}
+
+/*
+============
+FS_Stats_f
 ============
 */
+void FS_Stats_f (void)
+{
+	searchpath_t	*search;
+	int				paks, mapped, files, used, i;
+
+	paks = mapped = files = 0;
+	for (search = com_searchpaths ; search ; search = search->next)
+		if (search->pack)
+		{
+			paks++;
+			if (search->pack->mapped)
+				mapped++;
+			files += search->pack->numfiles;
+		}
+
+	used = 0;
+	for (i = 0 ; i < fs_indexsize ; i++)
+		if (fs_index[i].file)
+			used++;
+
+	Com_Printf ("%i files in %i paks (%i mapped), %i unique (index size %i, %i rebuilds)\n",
+		files, paks, mapped, used, fs_indexsize, fs_stats.rebuilds);
+	Com_Printf ("lookups: %i  pak: %i  dir: %i  missed: %i  mapped views: %i\n",
+		fs_stats.lookups, fs_stats.pakhits, fs_stats.dirhits, fs_stats.misses,
+		fs_stats.views);
+	Com_Printf ("inflated: %i  prefetched: %i (%i worker threads)\n",
+		fs_stats.inflated, fs_stats.prefetched, fs_numworkers);
+	if (fs_stats.lookups)
+		Com_Printf ("time: %.1f ms total, %.1f us avg, %.1f us max\n",
+			fs_stats.time * 1000.0, fs_stats.time * 1000000.0 / fs_stats.lookups,
+			fs_stats.maxtime * 1000000.0);
+
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset"))
+		memset (&fs_stats, 0, sizeof(fs_stats));
+}
+
 cache_user_t *loadcache;
 byte	*loadbuf;
 int		loadsize;
-byte *FS_LoadFile (char *path, int usehunk)
+
+/*
+============
+FS_LoadFoundFile
+
+Loads a file FS_FindFileTimed has just found (and set fs_filesize for)
+============
+*/
+static byte *FS_LoadFoundFile (char *path, searchpath_t *search, packfile_t *pakfile, FILE *h, int usehunk)
 {
-	FILE	*h;
-	byte	*buf;
+	byte	*buf, *mapped;
 	char	base[32];
 	int		len;
 
 	buf = NULL;	// quiet compiler warning
+	len = fs_filesize;
 
-// look for it in the filesystem or pack files
-	len = fs_filesize = FS_FOpenFile (path, &h);
-	if (!h)
-		return NULL;
+	mapped = NULL;
+	if (pakfile && pakfile->method == PACK_STORED)
+	{
+		if (!FS_ResolveZipEntry (search->pack, pakfile))
+			Sys_Error ("Bad zip entry %s in %s", pakfile->name, search->pack->filename);
+		mapped = FS_MappedData (search->pack, pakfile);
+	}
+	if (pakfile && pakfile->method == PACK_STORED && !mapped)
+	{	// open a new file on the pakfile
+		h = fopen (search->pack->filename, "rb");
+		if (!h)
+			Sys_Error ("Couldn't reopen %s", search->pack->filename);
+		fseek (h, pakfile->filepos, SEEK_SET);
+	}
 
 // extract the filename base name for hunk tag
 	COM_FileBase (path, base);
@@ -770,6 +1433,19 @@ byte *FS_LoadFile (char *path, int usehunk)
 		Sys_Error ("FS_LoadFile: not enough space for %s", path);
 	
 	((byte *)buf)[len] = 0;
+
+	if (mapped)
+	{	// no syscalls, the pages are already mapped
+		memcpy (buf, mapped, len);
+		return buf;
+	}
+
+	if (pakfile && pakfile->method == PACK_DEFLATED)
+	{
+		FS_ExpandEntry (search->pack, pakfile, buf);
+		return buf;
+	}
+
 #ifndef SERVERONLY
 	R_BeginDisc ();
 #endif
@@ -782,6 +1458,28 @@ byte *FS_LoadFile (char *path, int usehunk)
 	return buf;
 }
 
+/*
+============
+FS_LoadFile
+
+Filename are relative to the quake directory.
+Always appends a 0 byte to the loaded data.
+============
+*/
+byte *FS_LoadFile (char *path, int usehunk)
+{
+	searchpath_t	*search;
+	packfile_t		*pakfile;
+	FILE	*h;
+
+// look for it in the filesystem or pack files
+	search = FS_FindFileTimed (path, &pakfile, &h);
+	if (!h && !pakfile)
+		return NULL;
+
+	return FS_LoadFoundFile (path, search, pakfile, h, usehunk);
+}
+
 byte *FS_LoadHunkFile (char *path)
 {
 	return FS_LoadFile (path, 1);
@@ -815,6 +1513,130 @@ byte *FS_LoadHeapFile (char *path)
 	return FS_LoadFile (path, 5);
 }
 
+/*
+============
+FS_ViewFile
+
+Returns the contents of path for reading only, with fs_filesize set.
+If the file sits in a mapped pak this points straight into the mapping
+and stays valid until the gamedir changes; otherwise the file is loaded
+like FS_LoadTempFile.  The data is not guaranteed to be 0 terminated.
+============
+*/
+byte *FS_ViewFile (char *path)
+{
+	searchpath_t	*search;
+	packfile_t		*pakfile;
+	FILE	*h;
+	byte	*mapped;
+
+	if (!fs_mappaks)
+		return FS_LoadTempFile (path);
+
+	search = FS_FindFileTimed (path, &pakfile, &h);
+	if (!h && !pakfile)
+		return NULL;
+
+	if (pakfile && pakfile->method == PACK_STORED && FS_ResolveZipEntry (search->pack, pakfile)
+		&& (mapped = FS_MappedData (search->pack, pakfile)) != NULL)
+	{
+		fs_stats.views++;
+		return mapped;
+	}
+
+	// loose or compressed, load it without looking it up again
+	return FS_LoadFoundFile (path, search, pakfile, h, 2);
+}
+
+/*
+============
+FS_PrefetchFile
+
+Hint that path will be loaded soon.  If it's a large deflated .pk3 entry
+it's queued for expansion on a worker thread.  Call FS_FlushPrefetch once
+the batch of loads is done to drop anything that wasn't used.
+============
+*/
+void FS_PrefetchFile (char *path)
+{
+	searchpath_t	*search;
+	packfile_t		*pakfile;
+	fsjob_t			*job;
+	FILE			*h;
+
+	if (!fs_numworkers)
+	{
+		FS_StartWorkers ();
+		if (!fs_numworkers)
+			return;
+	}
+
+	search = FS_FindFileTimed (path, &pakfile, &h);
+	if (h)
+		fclose (h);
+	if (!pakfile || pakfile->method != PACK_DEFLATED || pakfile->filelen < FS_PREFETCH_MINSIZE)
+		return;
+	if (!FS_ResolveZipEntry (search->pack, pakfile))
+		return;		// will fail loudly when actually loaded
+
+	mtx_lock (&fs_joblock);
+	for (job = fs_jobs ; job ; job = job->next)
+		if (job->file == pakfile)
+			break;
+	if (!job)
+	{
+		job = Q_malloc (sizeof(fsjob_t));
+		job->pack = search->pack;
+		job->file = pakfile;
+		job->data = NULL;
+		job->state = FSJOB_QUEUED;
+		job->next = fs_jobs;
+		fs_jobs = job;
+		cnd_signal (&fs_jobqueued);
+	}
+	mtx_unlock (&fs_joblock);
+}
+
+/*
+=================
+FS_NewPack
+
+Wraps a parsed directory into a pack_t and hashes it
+=================
+*/
+static pack_t *FS_NewPack (char *packfile, FILE *packhandle, packfile_t *files, int numfiles)
+{
+	pack_t			*pack;
+	int				i;
+	unsigned int	h;
+
+	pack = Q_malloc (sizeof (pack_t));
+	strcpy (pack->filename, packfile);
+	pack->handle = packhandle;
+	pack->numfiles = numfiles;
+	pack->files = files;
+
+	for (pack->hashsize = 16 ; pack->hashsize < numfiles ; pack->hashsize <<= 1)
+		;
+	pack->hash = Q_malloc (pack->hashsize * sizeof(packfile_t *));
+	memset (pack->hash, 0, pack->hashsize * sizeof(packfile_t *));
+
+// chain in reverse so the first of any duplicate names is found first
+	for (i=numfiles-1 ; i>=0 ; i--)
+	{
+		h = FS_HashFileName (files[i].name) & (pack->hashsize - 1);
+		files[i].hash_next = pack->hash[h];
+		pack->hash[h] = &files[i];
+	}
+
+// with -mappak the pak stays mapped for as long as it's on the search path
+	pack->mapped = NULL;
+	if (fs_mappaks)
+		pack->mapped = Sys_MapFile (packfile, &pack->mappedlen);
+
+	return pack;
+}
+
 /*
 =================
 FS_LoadPackFile
@@ -855,24 +1677,158 @@ pack_t *FS_LoadPackFile (char *packfile)
 	fseek (packhandle, header.dirofs, SEEK_SET);
 	fread (&info, 1, header.dirlen, packhandle);
 
+// parse the directory
 // parse the directory
 	for (i=0 ; i<numpackfiles ; i++)
 	{
-		strcpy (newfiles[i].name, info[i].name);
+		strlcpy (newfiles[i].name, info[i].name, sizeof(newfiles[i].name));
 		newfiles[i].filepos = LittleLong(info[i].filepos);
 		newfiles[i].filelen = LittleLong(info[i].filelen);
+		newfiles[i].method = PACK_STORED;
+		newfiles[i].complen = newfiles[i].filelen;
+		newfiles[i].headerpos = -1;
 	}
 
-	pack = Q_malloc (sizeof (pack_t));
-	strcpy (pack->filename, packfile);
-	pack->handle = packhandle;
-	pack->numfiles = numpackfiles;
-	pack->files = newfiles;
+	pack = FS_NewPack (packfile, packhandle, newfiles, numpackfiles);
 
 	Com_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
 	return pack;
 }
 
+/*
+=================
+FS_LoadZipFile
+
+Takes an explicit path to a .pk3 file and indexes its central directory
+into the same structures id pak files use.  Entries that are neither
+stored nor deflated are skipped, and so are deflated ones in builds
+without zlib.  Returns NULL if the file can't be opened, or with a
+warning if it isn't a usable zip file.
+=================
+*/
+pack_t *FS_LoadZipFile (char *packfile)
+{
+	FILE			*packhandle;
+	byte			*tail, *dir, *p, *end;
+	int				len, taillen, i;
+	int				numentries, dirofs, dirlen, namelen;
+	int				numpackfiles, skipped;
+	packfile_t		*newfiles, *file;
+
+	if ((len = COM_FileOpenRead (packfile, &packhandle)) == -1)
+		return NULL;
+
+	dir = NULL;
+	newfiles = NULL;
+
+// find the end of central directory record, it's followed by a comment
+	taillen = min (len, ZIP_END_SIZE + ZIP_MAX_COMMENT);
+	tail = Q_malloc (taillen);
+	fseek (packhandle, len - taillen, SEEK_SET);
+	if ((int)fread (tail, 1, taillen, packhandle) != taillen)
+		taillen = 0;
+	for (p = tail + taillen - ZIP_END_SIZE ; p >= tail ; p--)
+		if (FS_ZipLong(p) == ZIP_END_SIG)
+			break;
+	if (p < tail)
+	{
+		Q_free (tail);
+		Com_Printf ("WARNING: %s is not a zip file, ignored\n", packfile);
+		goto bad;
+	}
+
+	numentries = FS_ZipShort (p + 10);
+	dirlen = FS_ZipLong (p + 12);
+	dirofs = FS_ZipLong (p + 16);
+	Q_free (tail);
+
+	if (dirofs < 0 || dirlen < 0 || dirofs > len - dirlen)
+		goto baddir;
+
+	dir = Q_malloc (dirlen);
+	fseek (packhandle, dirofs, SEEK_SET);
+	if ((int)fread (dir, 1, dirlen, packhandle) != dirlen)
+	{
+		Com_Printf ("WARNING: error reading %s, ignored\n", packfile);
+		goto bad;
+	}
+
+// parse the central directory
+	newfiles = Q_malloc (max(numentries, 1) * sizeof(packfile_t));
+	numpackfiles = skipped = 0;
+	end = dir + dirlen;
+	for (i = 0, p = dir ; i < numentries ; i++)
+	{
+		if (p + ZIP_CENTRAL_SIZE > end || FS_ZipLong(p) != ZIP_CENTRAL_SIG)
+			goto baddir;
+
+		namelen = FS_ZipShort (p + 28);
+		if (p + ZIP_CENTRAL_SIZE + namelen > end)
+			goto baddir;
+
+		file = &newfiles[numpackfiles];
+		file->method = FS_ZipShort (p + 10);
+		file->complen = FS_ZipLong (p + 20);
+		file->filelen = FS_ZipLong (p + 24);
+		file->headerpos = FS_ZipLong (p + 42);
+		file->filepos = -1;
+
+		if (namelen == 0 || namelen >= MAX_QPATH
+			|| p[ZIP_CENTRAL_SIZE + namelen - 1] == '/')	// directory
+			;
+		else if ((FS_ZipShort(p + 8) & 1)		// encrypted
+			|| file->filelen < 0 || file->complen < 0
+#ifndef WITH_ZLIB
+			|| file->method != PACK_STORED
+#endif
+			|| (file->method != PACK_STORED && file->method != PACK_DEFLATED))
+			skipped++;
+		else
+		{
+			memcpy (file->name, p + ZIP_CENTRAL_SIZE, namelen);
+			file->name[namelen] = 0;
+			numpackfiles++;
+		}
+
+		p += ZIP_CENTRAL_SIZE + namelen + FS_ZipShort(p + 30) + FS_ZipShort(p + 32);
+	}
+	Q_free (dir);
+
+	if (!numpackfiles)
+	{
+		Com_Printf ("Ignored %s (no usable files)\n", packfile);
+		Q_free (newfiles);
+		fclose (packhandle);
+		return NULL;
+	}
+
+	if (skipped)
+		Com_Printf ("Added packfile %s (%i files, %i skipped)\n", packfile, numpackfiles, skipped);
+	else
+		Com_Printf ("Added packfile %s (%i files)\n", packfile, numpackfiles);
+
+	return FS_NewPack (packfile, packhandle, newfiles, numpackfiles);
+
+baddir:
+	Com_Printf ("WARNING: %s has a bad central directory, ignored\n", packfile);
+bad:
+	Q_free (dir);
+	Q_free (newfiles);
+	fclose (packhandle);
+	return NULL;
+}
+
+// tells a pk3 that isn't there from one FS_LoadZipFile couldn't use
+static qbool FS_FileExists (char *path)
+{
+	FILE	*f;
+
+	if (!(f = fopen (path, "rb")))
+		return false;
+	fclose (f);
+	return true;
+}
+
 
 /*
 ================
@@ -919,6 +1875,27 @@ void FS_AddGameDirectory (char *dir)
 		search->next = com_searchpaths;
 		com_searchpaths = search;	
 	}
+
+//
+// then pak0.pk3 pak1.pk3 ..., which override the .pak files
+//
+	for (i=0 ; ; i++)
+	{
+		sprintf (pakfile, "%s/pak%i.pk3", dir, i);
+		pak = FS_LoadZipFile (pakfile);
+		if (!pak)
+		{
+			if (!FS_FileExists (pakfile))
+				break;
+			continue;	// a bad one doesn't hide the ones after it
+		}
+		search = Hunk_Alloc (sizeof(searchpath_t));
+		search->pack = pak;
+		search->next = com_searchpaths;
+		com_searchpaths = search;
+	}
+
+	fs_index_dirty = true;
 }
 
 /*
@@ -949,14 +1926,12 @@ void FS_SetGamedir (char *dir)
 	//
 	// free up any current game dir info
 	//
+	fs_index_dirty = true;
+	FS_FlushPrefetch ();
 	while (com_searchpaths != com_base_searchpaths)
 	{
 		if (com_searchpaths->pack)
-		{
-			fclose (com_searchpaths->pack->handle);
-			Q_free (com_searchpaths->pack->files);
-			Q_free (com_searchpaths->pack);
-		}
+			FS_FreePack (com_searchpaths->pack);
 		next = com_searchpaths->next;
 		Q_free (com_searchpaths);
 		com_searchpaths = next;
@@ -996,6 +1971,25 @@ void FS_SetGamedir (char *dir)
 		com_searchpaths = search;	
 	}
 
+	//
+	// then pak0.pk3 pak1.pk3 ..., which override the .pak files
+	//
+	for (i=0 ; ; i++)
+	{
+		sprintf (pakfile, "%s/pak%i.pk3", com_gamedir, i);
+		pak = FS_LoadZipFile (pakfile);
+		if (!pak)
+		{
+			if (!FS_FileExists (pakfile))
+				break;
+			continue;	// a bad one doesn't hide the ones after it
+		}
+		search = Q_malloc (sizeof(searchpath_t));
+		search->pack = pak;
+		search->next = com_searchpaths;
+		com_searchpaths = search;
+	}
+
 breakOut:
 	// notify the client so that it reloads its data, etc
 	CL_GamedirChanged ();
@@ -1024,6 +2018,14 @@ void FS_InitFilesystem (void)
 	if ((i >= 0) && (com_basedir[i]=='/' || com_basedir[i]=='\\'))
 		com_basedir[i] = '\0';
 
+//
+// -mappak
+// Keep pak files mapped into memory instead of reopening them for each file
+//
+	fs_mappaks = COM_CheckParm ("-mappak") != 0;
+
+	FS_InitWorkers ();
+
 //
 // start up with id1 by default
 //
@@ -1042,6 +2044,7 @@ void FS_InitFilesystem (void)
 
 	// any set gamedirs will be freed up to here
 	com_base_searchpaths = com_searchpaths;
+	fs_index_dirty = true;
 
 // the user might want to override default game directory
 	i = COM_CheckParm ("-game");
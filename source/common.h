@@ -230,6 +230,9 @@ byte *FS_LoadTempFile (char *path);
 byte *FS_LoadHunkFile (char *path);
 void FS_LoadCacheFile (char *path, struct cache_user_s *cu);
 byte *FS_LoadHeapFile (char *path);
+byte *FS_ViewFile (char *path);		// read only!
+void FS_PrefetchFile (char *path);
+void FS_FlushPrefetch (void);
 
 void COM_WriteFile (char *filename, void *data, int len);
 void COM_CreatePath (char *path);
@@ -50,6 +50,19 @@ void	NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to);
 void	NET_ClearLoopback (void);
 void	NET_Sleep (int msec);
 
+// between these NET_SendPacket may hold datagrams back, so that the flush
+// can send them with as few system calls as the platform allows
+void	NET_BeginBatch (netsrc_t sock);
+void	NET_FlushBatch (netsrc_t sock);
+
+typedef struct
+{
+	int		recvcalls, recvpackets;
+	int		sendcalls, sendpackets;
+} netstats_t;
+
+extern netstats_t	net_stats[2];	// indexed by netsrc_t, cleared by the user
+
 qbool	NET_CompareAdr (netadr_t a, netadr_t b);
 qbool	NET_CompareBaseAdr (netadr_t a, netadr_t b);
 qbool	NET_IsLocalAddress (netadr_t a);
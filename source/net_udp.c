@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 // net_udp.c
 
+#ifdef __linux__
+#define _GNU_SOURCE		// recvmmsg, sendmmsg
+#endif
+
 #include "quakedef.h"
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -40,6 +44,11 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <libc.h>
 #endif
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#define	NET_MMSG	// batch datagrams with recvmmsg/sendmmsg, sleep with epoll
+#endif
+
 netadr_t	net_from;
 netadr_t	net_null = {NA_NULL};
 netadr_t	net_local_adr;
@@ -48,6 +57,34 @@ sizebuf_t	net_message;
 
 byte		net_message_buffer[MAX_BIG_MSGLEN];
 
+netstats_t	net_stats[2];
+
+extern qbool	do_stdin, stdin_ready;
+
+#ifdef NET_MMSG
+#define	NET_BATCH	64		// datagrams per recvmmsg/sendmmsg call
+
+typedef struct
+{
+	struct mmsghdr		hdrs[NET_BATCH];
+	struct iovec		iovs[NET_BATCH];
+	struct sockaddr_in	addrs[NET_BATCH];
+	byte				data[NET_BATCH][MAX_BIG_MSGLEN];
+	int					count;		// datagrams in the batch
+	int					next;		// next received one to hand out
+} netbatch_t;
+
+static netbatch_t	net_recvbatch[2];
+static netbatch_t	net_sendbatch[2];
+static qbool		net_batching[2];	// NET_SendPacket queues into net_sendbatch
+
+static int			net_epollfd = -1;
+static int			net_epollsocket = -1;	// server socket registered with net_epollfd
+static qbool		net_epollstdin;			// stdin is in the epoll set
+static qbool		net_stdinclosed;		// hung up, stop watching it
+static qbool		net_noepoll;			// fall back to select for good
+#endif
+
 #define	MAX_LOOPBACK	4	// must be a power of two
 
 typedef struct
@@ -256,12 +293,144 @@ void NET_ClearLoopback (void)
 
 //=============================================================================
 
+#ifdef NET_MMSG
+/*
+====================
+NET_GetBatchedPacket
+
+Hands out the datagrams of the last recvmmsg one at a time,
+and only goes back to the kernel when they have all been used
+====================
+*/
+static qbool NET_GetBatchedPacket (netsrc_t sock, int net_socket)
+{
+	netbatch_t	*batch;
+	int			i, ret;
+
+	batch = &net_recvbatch[sock];
+again:
+	if (batch->next == batch->count)
+	{
+		batch->next = batch->count = 0;
+		for (i = 0 ; i < NET_BATCH ; i++)
+		{
+			batch->iovs[i].iov_base = batch->data[i];
+			batch->iovs[i].iov_len = sizeof(batch->data[i]);
+			memset (&batch->hdrs[i].msg_hdr, 0, sizeof(batch->hdrs[i].msg_hdr));
+			batch->hdrs[i].msg_hdr.msg_name = &batch->addrs[i];
+			batch->hdrs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+			batch->hdrs[i].msg_hdr.msg_iov = &batch->iovs[i];
+			batch->hdrs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		ret = recvmmsg (net_socket, batch->hdrs, NET_BATCH, MSG_DONTWAIT, NULL);
+		net_stats[sock].recvcalls++;
+		if (ret == -1) {
+			if (errno == EWOULDBLOCK)
+				return false;
+			if (errno == ECONNREFUSED)
+				return false;
+			Sys_Printf ("NET_GetPacket: %s\n", strerror(errno));
+			return false;
+		}
+		if (!ret)
+			return false;
+		batch->count = ret;
+	}
+
+	i = batch->next++;
+	SockadrToNetadr (&batch->addrs[i], &net_from);
+	if (batch->hdrs[i].msg_hdr.msg_flags & MSG_TRUNC)
+	{
+		Com_Printf ("Oversize packet from %s\n", NET_AdrToString (net_from));
+		goto again;
+	}
+
+	memcpy (net_message_buffer, batch->data[i], batch->hdrs[i].msg_len);
+	net_message.cursize = batch->hdrs[i].msg_len;
+	net_stats[sock].recvpackets++;
+
+	return true;
+}
+
+/*
+====================
+NET_SendBatch
+====================
+*/
+static void NET_SendBatch (netsrc_t sock)
+{
+	netbatch_t	*batch;
+	int			i, ret, sent;
+
+	batch = &net_sendbatch[sock];
+	if (ip_sockets[sock] == -1)
+	{
+		batch->count = 0;
+		return;
+	}
+
+	for (i = 0 ; i < batch->count ; i++)
+	{
+		batch->iovs[i].iov_base = batch->data[i];
+		memset (&batch->hdrs[i].msg_hdr, 0, sizeof(batch->hdrs[i].msg_hdr));
+		batch->hdrs[i].msg_hdr.msg_name = &batch->addrs[i];
+		batch->hdrs[i].msg_hdr.msg_namelen = sizeof(batch->addrs[i]);
+		batch->hdrs[i].msg_hdr.msg_iov = &batch->iovs[i];
+		batch->hdrs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	for (sent = 0 ; sent < batch->count ; )
+	{
+		ret = sendmmsg (ip_sockets[sock], batch->hdrs + sent, batch->count - sent, 0);
+		net_stats[sock].sendcalls++;
+		if (ret == -1) {
+			if (errno != EWOULDBLOCK && errno != ECONNREFUSED)
+				Sys_Printf ("NET_SendPacket: %s\n", strerror(errno));
+			sent++;		// drop the one that failed, just like sendto would
+			continue;
+		}
+		net_stats[sock].sendpackets += ret;
+		sent += ret;
+	}
+
+	batch->count = 0;
+}
+#endif
+
+/*
+====================
+NET_BeginBatch
+====================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+#ifdef NET_MMSG
+	net_batching[sock] = true;
+#endif
+}
+
+/*
+====================
+NET_FlushBatch
+====================
+*/
+void NET_FlushBatch (netsrc_t sock)
+{
+#ifdef NET_MMSG
+	NET_SendBatch (sock);
+	net_batching[sock] = false;
+#endif
+}
+
 qbool NET_GetPacket (netsrc_t sock)
 {
+	int		net_socket;
+#ifndef NET_MMSG
 	int 	ret;
 	struct sockaddr_in	from;
 	int		fromlen;
-	int		net_socket;
+#endif
 
 	if (NET_GetLoopPacket (sock))
 		return true;
@@ -270,8 +439,12 @@ qbool NET_GetPacket (netsrc_t sock)
 	if (net_socket == -1)
 		return false;
 
+#ifdef NET_MMSG
+	return NET_GetBatchedPacket (sock, net_socket);
+#else
 	fromlen = sizeof(from);
 	ret = recvfrom (net_socket, net_message_buffer, sizeof(net_message_buffer), 0, (struct sockaddr *)&from, &fromlen);
+	net_stats[sock].recvcalls++;
 	if (ret == -1) {
 		if (errno == EWOULDBLOCK)
 			return false;
@@ -283,8 +456,10 @@ qbool NET_GetPacket (netsrc_t sock)
 
 	net_message.cursize = ret;
 	SockadrToNetadr (&from, &net_from);
+	net_stats[sock].recvpackets++;
 
 	return ret;
+#endif
 }
 
 //=============================================================================
@@ -307,9 +482,27 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	if (net_socket == -1)
 		return;
 
+#ifdef NET_MMSG
+	if (net_batching[sock] && length <= MAX_BIG_MSGLEN)
+	{
+		netbatch_t	*batch = &net_sendbatch[sock];
+
+		if (batch->count == NET_BATCH)
+			NET_SendBatch (sock);
+		memcpy (batch->data[batch->count], data, length);
+		batch->iovs[batch->count].iov_len = length;
+		NetadrToSockadr (&to, &batch->addrs[batch->count]);
+		batch->count++;
+		return;
+	}
+#endif
+
 	NetadrToSockadr (&to, &addr);
 
 	ret = sendto (net_socket, data, length, 0, (struct sockaddr *)&addr, sizeof(addr) );
+	net_stats[sock].sendcalls++;
+	if (ret != -1)
+		net_stats[sock].sendpackets++;
 	if (ret == -1) {
 		if (errno == EWOULDBLOCK)
 			return;
@@ -377,6 +570,9 @@ void NET_ClientConfig (qbool enable)
 		if (ip_sockets[NS_CLIENT] != -1) {
 			close (ip_sockets[NS_CLIENT]);
 			ip_sockets[NS_CLIENT] = -1;
+#ifdef NET_MMSG
+			net_recvbatch[NS_CLIENT].count = net_recvbatch[NS_CLIENT].next = 0;
+#endif
 		}
 	}
 }
@@ -417,11 +613,79 @@ void NET_ServerConfig (qbool enable)
 		if (ip_sockets[NS_SERVER] != -1) {
 			close (ip_sockets[NS_SERVER]);
 			ip_sockets[NS_SERVER] = -1;
+#ifdef NET_MMSG
+			net_recvbatch[NS_SERVER].count = net_recvbatch[NS_SERVER].next = 0;
+			net_epollsocket = -1;	// closing removed it from the epoll set
+#endif
 		}
 	}
 }
 
 
+#ifdef NET_MMSG
+/*
+====================
+NET_EpollSleep
+
+Returns false if epoll can't be used, e.g. when stdin is a regular file
+====================
+*/
+static qbool NET_EpollSleep (int msec)
+{
+	struct epoll_event	ev, events[2];
+	int		i, n;
+
+	if (net_noepoll)
+		return false;
+
+	if (net_epollfd == -1 && (net_epollfd = epoll_create1 (EPOLL_CLOEXEC)) == -1)
+		goto noepoll;
+
+	memset (&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+
+	if (net_epollsocket != ip_sockets[NS_SERVER] && ip_sockets[NS_SERVER] != -1)
+	{
+		ev.data.fd = ip_sockets[NS_SERVER];
+		if (epoll_ctl (net_epollfd, EPOLL_CTL_ADD, ip_sockets[NS_SERVER], &ev) == -1)
+			goto noepoll;
+		net_epollsocket = ip_sockets[NS_SERVER];
+	}
+
+	// epoll is level triggered, so stdin must not stay in the set once
+	// nobody reads it, or every wait would return right away
+	if (net_epollstdin && (!do_stdin || net_stdinclosed))
+	{
+		epoll_ctl (net_epollfd, EPOLL_CTL_DEL, 0, &ev);
+		net_epollstdin = false;
+	}
+	else if (do_stdin && !net_epollstdin && !net_stdinclosed)
+	{
+		ev.data.fd = 0;
+		if (epoll_ctl (net_epollfd, EPOLL_CTL_ADD, 0, &ev) == -1)
+			goto noepoll;
+		net_epollstdin = true;
+	}
+
+	n = epoll_wait (net_epollfd, events, 2, msec);
+
+	stdin_ready = false;
+	for (i = 0 ; i < n ; i++)
+	{
+		if (events[i].data.fd != 0)
+			continue;
+		stdin_ready = true;
+		if ((events[i].events & (EPOLLHUP|EPOLLERR)) && !(events[i].events & EPOLLIN))
+			net_stdinclosed = true;		// nothing left to read
+	}
+	return true;
+
+noepoll:
+	net_noepoll = true;
+	return false;
+}
+#endif
+
 /*
 ====================
 NET_Sleep
@@ -433,7 +697,16 @@ void NET_Sleep (int msec)
 {
 	struct timeval timeout;
 	fd_set	fdset;
-	extern qbool do_stdin, stdin_ready;
+
+#ifdef NET_MMSG
+	if (net_recvbatch[NS_SERVER].next < net_recvbatch[NS_SERVER].count)
+	{	// still holding datagrams from the last recvmmsg
+		stdin_ready = false;
+		return;
+	}
+	if (NET_EpollSleep (msec))
+		return;
+#endif
 
 //	if (ip_sockets[NS_SERVER] == -1)
 //		return; // we're not a server, just run full speed
@@ -30,6 +30,8 @@ sizebuf_t	net_message;
 
 byte		net_message_buffer[MAX_BIG_MSGLEN];
 
+netstats_t	net_stats[2];
+
 WSADATA		winsockdata;
 
 #define	MAX_LOOPBACK	4	// must be a power of two
@@ -257,6 +259,7 @@ qbool NET_GetPacket (netsrc_t sock)
 	fromlen = sizeof(from);
 	ret = recvfrom (net_socket, (char *)net_message_buffer, sizeof(net_message_buffer), 0, (struct sockaddr *)&from, &fromlen);
 	SockadrToNetadr (&from, &net_from);
+	net_stats[sock].recvcalls++;
 
 	if (ret == -1)
 	{
@@ -283,12 +286,30 @@ qbool NET_GetPacket (netsrc_t sock)
 		Com_Printf ("Oversize packet from %s\n", NET_AdrToString (net_from));
 		return false;
 	}
+	net_stats[sock].recvpackets++;
 
 	return ret;
 }
 
 //=============================================================================
 
+/*
+====================
+NET_BeginBatch / NET_FlushBatch
+
+Winsock has no multi-datagram send, packets always go out right away
+====================
+*/
+void NET_BeginBatch (netsrc_t sock)
+{
+	(void)sock;
+}
+
+void NET_FlushBatch (netsrc_t sock)
+{
+	(void)sock;
+}
+
 void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 {
 	int		ret;
@@ -310,6 +331,9 @@ void NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to)
 	NetadrToSockadr (&to, &addr);
 
 	ret = sendto (net_socket, data, length, 0, (struct sockaddr *)&addr, sizeof(addr));
+	net_stats[sock].sendcalls++;
+	if (ret != -1)
+		net_stats[sock].sendpackets++;
 	if (ret == -1)
 	{
 		int err = WSAGetLastError();
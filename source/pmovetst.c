@@ -237,4 +237,77 @@ trace_t PM_TraceLine (vec3_t start, vec3_t end)
 	return total;
 }
 
+/*
+================
+PM_TraceLineBatch
+
+Same as count calls to PM_TraceLine, each hull is walked once for all rays
+================
+*/
+void PM_TraceLineBatch (int count, vec3_t *starts, vec3_t *ends, trace_t *traces)
+{
+	trace_t		trace[CM_MAX_TRACEBATCH];
+	vec3_t		starts_l[CM_MAX_TRACEBATCH], ends_l[CM_MAX_TRACEBATCH];
+	vec3_t		offset;
+	hull_t		*hull;
+	int			i, j;
+	physent_t	*pe;
+
+	if (count > CM_MAX_TRACEBATCH)
+	{
+		PM_TraceLineBatch (CM_MAX_TRACEBATCH, starts, ends, traces);
+		PM_TraceLineBatch (count - CM_MAX_TRACEBATCH, starts + CM_MAX_TRACEBATCH,
+			ends + CM_MAX_TRACEBATCH, traces + CM_MAX_TRACEBATCH);
+		return;
+	}
+
+// fill in default traces
+	for (j=0 ; j<count ; j++)
+	{
+		memset (&traces[j], 0, sizeof(trace_t));
+		traces[j].fraction = 1;
+		traces[j].e.entnum = -1;
+		VectorCopy (ends[j], traces[j].endpos);
+	}
+
+	for (i=0 ; i< pmove.numphysent ; i++)
+	{
+		pe = &pmove.physents[i];
+	// get the clipping hull
+		if (pe->model)
+			hull = &pmove.physents[i].model->hulls[0];
+		else
+			hull = CM_HullForBox (pe->mins, pe->maxs);
+
+		VectorCopy (pe->origin, offset);
+
+		for (j=0 ; j<count ; j++)
+		{
+			VectorSubtract (starts[j], offset, starts_l[j]);
+			VectorSubtract (ends[j], offset, ends_l[j]);
+		}
+
+		// trace the lines through the apropriate clipping hull
+		CM_HullTraceBatch (hull, count, starts_l, ends_l, trace);
+
+		for (j=0 ; j<count ; j++)
+		{
+			// fix trace up by the offset
+			VectorAdd (trace[j].endpos, offset, trace[j].endpos);
+
+			if (trace[j].allsolid)
+				trace[j].startsolid = true;
+			if (trace[j].startsolid)
+				trace[j].fraction = 0;
+
+			// did we clip the move?
+			if (trace[j].fraction < traces[j].fraction)
+			{
+				traces[j] = trace[j];
+				traces[j].e.entnum = i;
+			}
+		}
+	}
+}
+
 /* vi: set noet ts=4 sts=4 ai sw=4: */
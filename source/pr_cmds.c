@@ -204,6 +204,9 @@ ok:
 
 	e->v.model = G_INT(OFS_PARM1);
 	e->v.modelindex = i;
+	ED_EdictChanged (e);
+	ED_UpdateHotFields (e);
+	SV_TraceFieldChanged (e);
 
 // if it is an inline model, get the size information for it
 	if (m[0] == '*') {
@@ -893,43 +896,7 @@ entity findradius(vector origin, float radius) = #22
 */
 static void PF_findradius (void)
 {
-	int			i, j, numtouch;
-	edict_t		*touchlist[MAX_EDICTS], *ent, *chain;
-	float		rad, rad2, *org;
-	vec3_t		mins, maxs, eorg;
-
-	org = G_VECTOR(OFS_PARM0);
-	rad = G_FLOAT(OFS_PARM1);
-	rad2 = rad * rad;
-
-	for (i = 0; i < 3; i++)
-	{
-		mins[i] = org[i] - rad - 1;		// enlarge the bbox a bit
-		maxs[i] = org[i] + rad + 1;
-	}
-
-	numtouch = SV_AreaEdicts (mins, maxs, touchlist, MAX_EDICTS, AREA_SOLID);
-	numtouch += SV_AreaEdicts (mins, maxs, &touchlist[numtouch], MAX_EDICTS - numtouch, AREA_TRIGGERS);
-
-	chain = (edict_t *)sv.edicts;
-
-// touch linked edicts
-	for (i = 0; i < numtouch; i++)
-	{
-		ent = touchlist[i];
-		if (ent->v.solid == SOLID_NOT)
-			continue;	// FIXME?
-
-		for (j = 0; j < 3; j++)
-			eorg[j] = org[j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);		
-		if (DotProduct(eorg, eorg) > rad2)
-			continue;
-
-		ent->v.chain = EDICT_TO_PROG(chain);
-		chain = ent;
-	}
-
-	RETURN_EDICT(chain);
+	RETURN_EDICT(SV_FindRadius (G_VECTOR(OFS_PARM0), G_FLOAT(OFS_PARM1)));
 }
 
 
@@ -1052,31 +1019,15 @@ static void PF_Find (void)
 {
 	int		e;
 	int		f;
-	char	*s, *t;
-	edict_t	*ed;
+	char	*s;
 
 	e = G_EDICTNUM(OFS_PARM0);
 	f = G_INT(OFS_PARM1);
 	s = G_STRING(OFS_PARM2);
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
-	
-	for (e++ ; e < sv.num_edicts ; e++)
-	{
-		ed = EDICT_NUM(e);
-		if (!ed->inuse)
-			continue;
-		t = E_STRING(ed,f);
-		if (!t)
-			continue;
-		if (!strcmp(t,s))
-		{
-			RETURN_EDICT(ed);
-			return;
-		}
-	}
 
-	RETURN_EDICT(sv.edicts);
+	RETURN_EDICT(ED_FindString (e, f, s));
 }
 
 
@@ -2296,7 +2247,6 @@ string strzone(string s) = #118
 */
 static void PF_strzone (void)
 {
-	int i;
 	char *s;
 
 	if (pr_argc >= 1)
@@ -2304,16 +2254,7 @@ static void PF_strzone (void)
 	else
 		s = "";
 
-	for (i = MAX_PRSTR; i < MAX_PRSTR + MAX_DYN_PRSTR; i++) {
-		if (pr_strtbl[i] != pr_strings)
-			continue;
-		// found an empty slot
-		pr_strtbl[i] = Q_strdup(s);
-		G_INT(OFS_RETURN) = -i;
-		return;
-	}
-
-	Host_Error ("PF_strzone: no free strings");
+	G_INT(OFS_RETURN) = PR_NewDynString (s);
 }
 
 
@@ -2327,20 +2268,7 @@ void strunzone(string s) = #119
 */
 static void PF_strunzone (void)
 {
-	int num;
-
-	num = G_INT(OFS_PARM0);
-	if (num > -MAX_PRSTR)
-		Host_Error ("PF_strunzone: not a dynamic string");
-
-	if (num <= -(MAX_PRSTR + MAX_DYN_PRSTR))
-		Host_Error ("PF_strunzone: bad string");
-
-	if (pr_strtbl[-num] == pr_strings)
-		return;	// allow multiple strunzone on the same string (like free in C)
-
-	Q_free (pr_strtbl[-num]);
-	pr_strtbl[-num] = pr_strings;
+	PR_FreeDynString (G_INT(OFS_PARM0));
 }
 
 
@@ -52,6 +52,419 @@ int		fofs_vw_index, fofs_vw_frame;
 ddef_t *ED_FieldAtOfs (int ofs);
 qbool	ED_ParseEpair (void *base, ddef_t *key, char *s);
 
+/*
+===============================================================================
+
+FIND INDEXES
+
+PF_Find looks up string fields through hash indexes instead of comparing
+every edict.  An index for a field is built the first time find is called
+on it, and after that is kept current by ED_EdictChanged (edicts cleared,
+parsed or written to from C), ED_Free, and ED_StringStored, which the
+interpreter calls for OP_STOREP_S.
+
+Only strings that can't change are hashed by their contents: progs
+strings and the map's strings (PR_StringIsConstant).  Other strings can
+point at buffers that get rewritten in place, like a client's name after
+a rename, so entities with those are kept on one extra chain that every
+lookup checks as well.
+
+Each chain is kept sorted by entity number, and every candidate is
+checked with strcmp just like the linear scan, so find returns the same
+entity it always did.  Stale entries are harmless; entities that got the
+value without going through one of the hooks would be missed, which is
+why pr_findindex 0 turns the indexes off.
+
+===============================================================================
+*/
+
+cvar_t	pr_findindex = {"pr_findindex", "1"};
+
+#define	FIND_INDEXES	8
+#define	FIND_HASH		1024		// must be a power of two
+#define	FIND_VOLATILE	FIND_HASH	// bucket for strings that can change
+
+typedef struct
+{
+	int		field;					// in floats, -1 if the slot is free
+	short	buckets[FIND_HASH + 1];	// first entity, -1 if none
+	short	next[MAX_EDICTS];		// in the same bucket, by entnum
+	short	prev[MAX_EDICTS];
+	short	bucket[MAX_EDICTS];		// -1 if the entity isn't in the index
+} findindex_t;
+
+static findindex_t	find_indexes[FIND_INDEXES];
+static int			find_numindexes;
+static byte			*find_indexed;	// per field, index number + 1
+
+static unsigned ED_HashFindString (char *s)
+{
+	unsigned	hash;
+
+	for (hash = 2166136261u; *s; s++)
+		hash = (hash ^ (byte)*s) * 16777619u;
+
+	return (hash ^ (hash >> 16)) & (FIND_HASH - 1);
+}
+
+static void ED_UnindexFind (findindex_t *fi, int e)
+{
+	if (fi->bucket[e] == -1)
+		return;
+
+	if (fi->prev[e] == -1)
+		fi->buckets[fi->bucket[e]] = fi->next[e];
+	else
+		fi->next[fi->prev[e]] = fi->next[e];
+	if (fi->next[e] != -1)
+		fi->prev[fi->next[e]] = fi->prev[e];
+
+	fi->bucket[e] = -1;
+}
+
+// puts e in the bucket of its current value
+static void ED_IndexFind (findindex_t *fi, int e)
+{
+	edict_t	*ed;
+	char	*s;
+	int		b, p, n;
+
+	ED_UnindexFind (fi, e);
+
+	ed = EDICT_NUM(e);
+	s = E_STRING(ed, fi->field);
+	if (!s)
+		return;		// find never matches these
+
+	if (PR_StringIsConstant (*(string_t *)&((float *)&ed->v)[fi->field]))
+		b = ED_HashFindString (s);
+	else
+		b = FIND_VOLATILE;
+
+	// keep the chain sorted
+	for (p = -1, n = fi->buckets[b]; n != -1 && n < e; p = n, n = fi->next[n])
+		;
+
+	fi->bucket[e] = b;
+	fi->prev[e] = p;
+	fi->next[e] = n;
+	if (p == -1)
+		fi->buckets[b] = e;
+	else
+		fi->next[p] = e;
+	if (n != -1)
+		fi->prev[n] = e;
+}
+
+static findindex_t *ED_FindIndexForField (int field)
+{
+	findindex_t	*fi;
+	int		e;
+
+	if (field < 0 || field >= progs->entityfields)
+		return NULL;
+
+	if (find_indexed[field])
+		return &find_indexes[find_indexed[field] - 1];
+
+	if (find_numindexes == FIND_INDEXES)
+		return NULL;
+
+	fi = &find_indexes[find_numindexes++];
+	find_indexed[field] = find_numindexes;
+
+	fi->field = field;
+	memset (fi->buckets, -1, sizeof(fi->buckets));
+	memset (fi->bucket, -1, sizeof(fi->bucket));
+
+	// the edicts are sorted already, so appending would do too
+	for (e = 1; e < sv.num_edicts; e++)
+		if (EDICT_NUM(e)->inuse)
+			ED_IndexFind (fi, e);
+
+	return fi;
+}
+
+/*
+=================
+ED_ClearFindIndexes
+
+Called when new progs are loaded, before any edicts exist
+=================
+*/
+void ED_ClearFindIndexes (void)
+{
+	find_numindexes = 0;
+	find_indexed = Hunk_AllocName (progs->entityfields, "findidx");
+}
+
+/*
+=================
+ED_EdictChanged
+
+Has to be called when C code changes a string field of an edict
+=================
+*/
+void ED_EdictChanged (edict_t *ed)
+{
+	int		i, e;
+
+	if (!find_numindexes)
+		return;
+
+	e = NUM_FOR_EDICT(ed);
+	for (i = 0; i < find_numindexes; i++)
+		ED_IndexFind (&find_indexes[i], e);
+}
+
+/*
+=================
+ED_EdictFreed
+=================
+*/
+static void ED_EdictFreed (edict_t *ed)
+{
+	int		i, e;
+
+	e = NUM_FOR_EDICT(ed);
+	for (i = 0; i < find_numindexes; i++)
+		ED_UnindexFind (&find_indexes[i], e);
+}
+
+/*
+=================
+ED_StringStored
+
+ofs is the edict field address an OP_STOREP_S wrote to
+=================
+*/
+void ED_StringStored (int ofs)
+{
+	int		e, field;
+
+	if (!find_numindexes)
+		return;
+
+	e = ofs / pr_edict_size;
+	if (e < 0 || e >= sv.num_edicts)
+		return;		// no Host_Error from EDICT_NUM, the JIT calls this
+	field = ((byte *)sv.edicts + ofs - (byte *)&EDICT_NUM(e)->v) / 4;
+
+	if (field >= 0 && field < progs->entityfields && find_indexed[field])
+		ED_IndexFind (&find_indexes[find_indexed[field] - 1], e);
+}
+
+/*
+=================
+ED_FindString
+
+Returns the first edict after start whose string field has the value s,
+sv.edicts if there is none.  Same result as checking them all in order
+=================
+*/
+edict_t *ED_FindString (int start, int field, char *s)
+{
+	findindex_t	*fi;
+	edict_t	*ed;
+	char	*t;
+	int		e, i, found;
+
+	fi = pr_findindex.value ? ED_FindIndexForField (field) : NULL;
+
+	if (!fi)
+	{
+		for (e = start + 1; e < sv.num_edicts; e++)
+		{
+			ed = EDICT_NUM(e);
+			if (!ed->inuse)
+				continue;
+			t = E_STRING(ed, field);
+			if (t && !strcmp(t, s))
+				return ed;
+		}
+		return sv.edicts;
+	}
+
+	// the first match in the hash bucket and in the volatile chain,
+	// whichever comes first
+	found = sv.num_edicts;
+	for (i = 0; i < 2; i++)
+	{
+		e = fi->buckets[i ? FIND_VOLATILE : ED_HashFindString (s)];
+		for ( ; e != -1 && e < found; e = fi->next[e])
+		{
+			if (e <= start)
+				continue;
+			ed = EDICT_NUM(e);
+			if (!ed->inuse)
+				continue;
+			t = E_STRING(ed, field);
+			if (t && !strcmp(t, s))
+			{
+				found = e;
+				break;
+			}
+		}
+	}
+
+	return found < sv.num_edicts ? EDICT_NUM(found) : sv.edicts;
+}
+
+//===========================================================================
+
+
+/*
+===============================================================================
+
+FIELD WATCH
+
+Progs can only write an edict field through OP_ADDRESS, so the interpreters
+check ed_fieldwatch for the entvars_t field being addressed, and call
+ED_FieldAddressed if the engine keeps something derived from it.  The call
+comes before the store, which is the next statement or after the right
+hand side has been worked out.
+===============================================================================
+*/
+
+byte	ed_fieldwatch[ED_WATCHFIELDS];
+
+#define	FOFS(f)		((int)((int *)&((entvars_t *)0)->f - (int *)0))
+
+static void ED_WatchField (int ofs, int count, int flags)
+{
+	while (count--)
+		ed_fieldwatch[ofs++] |= flags;
+}
+
+static void ED_InitFieldWatch (void)
+{
+	// what SV_ClipMoveToEntity and SV_ClipToLinks look at
+	ED_WatchField (FOFS(solid), 1, FW_TRACE);
+	ED_WatchField (FOFS(owner), 1, FW_TRACE);
+	ED_WatchField (FOFS(flags), 1, FW_TRACE);
+	ED_WatchField (FOFS(movetype), 1, FW_TRACE);
+	ED_WatchField (FOFS(modelindex), 1, FW_TRACE);
+	ED_WatchField (FOFS(origin), 3, FW_TRACE);
+	ED_WatchField (FOFS(mins), 3, FW_TRACE);
+	ED_WatchField (FOFS(maxs), 3, FW_TRACE);
+	ED_WatchField (FOFS(size), 3, FW_TRACE);
+
+	// what ED_UpdateHotFields copies
+	ED_WatchField (FOFS(origin), 3, FW_HOT);
+	ED_WatchField (FOFS(absmin), 3, FW_HOT);
+	ED_WatchField (FOFS(absmax), 3, FW_HOT);
+	ED_WatchField (FOFS(modelindex), 1, FW_HOT);
+	ED_WatchField (FOFS(model), 1, FW_HOT);
+	ED_WatchField (FOFS(solid), 1, FW_HOT);
+}
+
+static void ED_HotFieldWritten (edict_t *ed);
+
+/*
+=================
+ED_FieldAddressed
+=================
+*/
+void ED_FieldAddressed (edict_t *ed, int field)
+{
+	if (ed_fieldwatch[field] & FW_TRACE)
+		SV_TraceFieldAddressed (ed);
+	if (ed_fieldwatch[field] & FW_HOT)
+		ED_HotFieldWritten (ed);
+}
+
+/*
+===============================================================================
+
+HOT FIELDS
+
+ed_hot keeps the fields the per-client entity loops read in packed arrays,
+so those loops don't pull a whole edict through the cache for each entity
+they test.  The engine updates single entries where it changes these
+fields.  Progs writes to them are noted by ED_FieldAddressed, and the next
+ED_SyncHotFields copies just those edicts.  ed_hotstale makes it copy
+everything, for when edicts are filled in from a map or savegame.
+===============================================================================
+*/
+
+edhot_t		ed_hot;
+qbool		ed_hotstale = true;
+
+static int	ed_hotdirty[MAX_EDICTS];	// written by progs since the last sync
+static int	ed_numhotdirty;
+static byte	ed_hotmarked[MAX_EDICTS];
+
+// no Host_Error here, the JIT calls this from native code
+static void ED_HotFieldWritten (edict_t *ed)
+{
+	int		e = ((byte *)ed - (byte *)sv.edicts) / pr_edict_size;
+
+	if (e < 0 || e >= sv.num_edicts)
+		return;
+	if (ed_hotmarked[e])
+		return;
+	ed_hotmarked[e] = true;
+	ed_hotdirty[ed_numhotdirty++] = e;
+}
+
+/*
+=================
+ED_UpdateHotFields
+=================
+*/
+void ED_UpdateHotFields (edict_t *ed)
+{
+	int		e = NUM_FOR_EDICT(ed);
+
+	if (!ed->inuse)
+	{
+		VectorClear (ed_hot.origin[e]);
+		VectorClear (ed_hot.absmin[e]);
+		VectorClear (ed_hot.absmax[e]);
+		ed_hot.modelindex[e] = 0;
+		ed_hot.solid[e] = SOLID_NOT;
+		ed_hot.hasmodel[e] = false;
+		return;
+	}
+
+	VectorCopy (ed->v.origin, ed_hot.origin[e]);
+	VectorCopy (ed->v.absmin, ed_hot.absmin[e]);
+	VectorCopy (ed->v.absmax, ed_hot.absmax[e]);
+	ed_hot.modelindex[e] = ed->v.modelindex;
+	ed_hot.solid[e] = ed->v.solid;
+	ed_hot.hasmodel[e] = ed->v.modelindex && *PR_GetString(ed->v.model);
+}
+
+/*
+=================
+ED_SyncHotFields
+=================
+*/
+void ED_SyncHotFields (void)
+{
+	int		i, e;
+	edict_t	*ed;
+
+	if (ed_hotstale)
+	{
+		for (e = 0, ed = sv.edicts; e < sv.num_edicts; e++, ed = NEXT_EDICT(ed))
+			ED_UpdateHotFields (ed);
+		ed_hotstale = false;
+	}
+	else
+	{
+		for (i = 0; i < ed_numhotdirty; i++)
+		{
+			e = ed_hotdirty[i];
+			if (e < sv.num_edicts)
+				ED_UpdateHotFields (EDICT_NUM(e));
+		}
+	}
+
+	for (i = 0; i < ed_numhotdirty; i++)
+		ed_hotmarked[ed_hotdirty[i]] = false;
+	ed_numhotdirty = 0;
+}
 
 /*
 =================
@@ -64,6 +477,156 @@ void ED_ClearEdict (edict_t *e)
 {
 	memset (&e->v, 0, progs->entityfields * 4);
 	e->inuse = true;
+	ED_EdictChanged (e);
+	ED_UpdateHotFields (e);
+}
+
+/*
+===============================================================================
+
+FREE EDICTS
+
+ED_Alloc hands out the lowest numbered free edict that is old enough to
+reuse, the same one a scan from MAX_CLIENTS+1 would find.  Free edicts
+that can be reused right away have a bit set in ed_reusable; the others
+wait in ed_freequeue, which stays ordered by freetime because sv.time
+only goes forward, and move over to ed_reusable when their time is up.
+
+The queue keeps each entry's freetime, so an edict that gets freed again
+while it's waiting just leaves a stale entry behind.  Anything that sets
+up edicts wholesale (map spawn, loadgame) calls ED_RebuildFreeList.
+===============================================================================
+*/
+
+typedef struct
+{
+	int			num;
+	float		freetime;
+} edfree_t;
+
+static unsigned	ed_reusable[(MAX_EDICTS + 31) / 32];
+static edfree_t	ed_freequeue[MAX_EDICTS];
+static int		ed_freehead, ed_freecount;
+
+// the first couple seconds of server time can involve a lot of
+// freeing and allocating, so relax the replacement policy
+#define ED_REUSABLE(e) (!(e)->inuse && ((e)->freetime < 2 || sv.time - (e)->freetime > 0.5))
+
+static int ED_CompareFreetime (const void *a, const void *b)
+{
+	float	ta = ((edfree_t *)a)->freetime, tb = ((edfree_t *)b)->freetime;
+
+	if (ta != tb)
+		return ta < tb ? -1 : 1;
+	return ((edfree_t *)a)->num - ((edfree_t *)b)->num;
+}
+
+/*
+=================
+ED_RebuildFreeList
+=================
+*/
+void ED_RebuildFreeList (void)
+{
+	int			i;
+	edict_t		*e;
+
+	memset (ed_reusable, 0, sizeof(ed_reusable));
+	ed_freehead = ed_freecount = 0;
+
+	for (i = MAX_CLIENTS + 1; i < sv.num_edicts; i++)
+	{
+		e = EDICT_NUM(i);
+		if (e->inuse)
+			continue;
+		if (ED_REUSABLE(e))
+			ed_reusable[i >> 5] |= 1u << (i & 31);
+		else
+		{
+			ed_freequeue[ed_freecount].num = i;
+			ed_freequeue[ed_freecount].freetime = e->freetime;
+			ed_freecount++;
+		}
+	}
+
+	qsort (ed_freequeue, ed_freecount, sizeof(ed_freequeue[0]), ED_CompareFreetime);
+}
+
+static void ED_QueueFree (edict_t *e)
+{
+	int		num = NUM_FOR_EDICT(e);
+	int		slot;
+
+	if (num <= MAX_CLIENTS)
+		return;
+
+	if (ED_REUSABLE(e))
+	{
+		ed_reusable[num >> 5] |= 1u << (num & 31);
+		return;
+	}
+	ed_reusable[num >> 5] &= ~(1u << (num & 31));
+
+	slot = (ed_freehead + ed_freecount) % MAX_EDICTS;
+	if (ed_freecount == MAX_EDICTS
+		|| (ed_freecount && e->freetime < ed_freequeue[(slot + MAX_EDICTS - 1) % MAX_EDICTS].freetime))
+	{
+		// full of stale entries from edicts freed more than once,
+		// or freetime went back
+		ED_RebuildFreeList ();
+		return;
+	}
+
+	ed_freequeue[slot].num = num;
+	ed_freequeue[slot].freetime = e->freetime;
+	ed_freecount++;
+}
+
+/*
+=================
+ED_FindFree
+
+Returns the number of the edict ED_Alloc should reuse, or 0 if there is none
+=================
+*/
+static int ED_FindFree (void)
+{
+	int			i, word;
+	unsigned	bits;
+	edfree_t	*f;
+	edict_t		*e;
+
+	// move edicts that are done waiting over to the reusable set
+	while (ed_freecount)
+	{
+		f = &ed_freequeue[ed_freehead];
+		e = EDICT_NUM(f->num);
+		if (!e->inuse && e->freetime == f->freetime)
+		{
+			if (!ED_REUSABLE(e))
+				break;
+			ed_reusable[f->num >> 5] |= 1u << (f->num & 31);
+		}
+		ed_freehead = (ed_freehead + 1) % MAX_EDICTS;
+		ed_freecount--;
+	}
+
+	for (word = (MAX_CLIENTS + 1) >> 5; word < (sv.num_edicts + 31) >> 5; word++)
+	{
+		for (bits = ed_reusable[word]; bits; bits &= bits - 1)
+		{
+			for (i = 0; !(bits & (1u << i)); i++)
+				;
+			i += word << 5;
+			if (i >= sv.num_edicts)
+				return 0;
+			if (i > MAX_CLIENTS && ED_REUSABLE(EDICT_NUM(i)))
+				return i;
+			ed_reusable[word] &= ~(1u << (i & 31));	// shouldn't happen
+		}
+	}
+
+	return 0;
 }
 
 /*
@@ -82,18 +645,16 @@ edict_t *ED_Alloc (void)
 	int			i;
 	edict_t		*e;
 
-	for ( i=MAX_CLIENTS+1 ; i<sv.num_edicts ; i++)
+	i = ED_FindFree ();
+	if (i)
 	{
+		ed_reusable[i >> 5] &= ~(1u << (i & 31));
 		e = EDICT_NUM(i);
-		// the first couple seconds of server time can involve a lot of
-		// freeing and allocating, so relax the replacement policy
-		if (!e->inuse && ( e->freetime < 2 || sv.time - e->freetime > 0.5 ) )
-		{
-			ED_ClearEdict (e);
-			return e;
-		}
+		ED_ClearEdict (e);
+		return e;
 	}
 
+	i = sv.num_edicts;
 	if (i == MAX_EDICTS)
 	{
 		Com_Printf ("WARNING: ED_Alloc: no free edicts\n");
@@ -120,6 +681,8 @@ FIXME: walk all entities and NULL out references to this entity
 void ED_Free (edict_t *ed)
 {
 	SV_UnlinkEdict (ed);		// unlink from world bsp
+	if (find_numindexes)
+		ED_EdictFreed (ed);
 
 	ed->inuse = false;
 	ed->v.model = 0;
@@ -134,6 +697,53 @@ void ED_Free (edict_t *ed)
 	ed->v.solid = 0;
 
 	ed->freetime = sv.time;
+	ED_QueueFree (ed);
+	ED_UpdateHotFields (ed);
+}
+
+/*
+=================
+ED_BenchAlloc_f
+
+Times the edict lookup ED_Alloc does against the old scan over all
+edicts, on the current map and without allocating anything
+=================
+*/
+void ED_BenchAlloc_f (void)
+{
+	int		i, j, count, found, scanned;
+	double	start, t_list, t_scan;
+
+	if (sv.state != ss_active)
+	{
+		Com_Printf ("no map running\n");
+		return;
+	}
+
+	count = Cmd_Argc() > 1 ? Q_atoi (Cmd_Argv(1)) : 100000;
+	if (count < 1)
+		count = 1;
+
+	start = Sys_DoubleTime ();
+	for (i = 0, found = 0; i < count; i++)
+		found = ED_FindFree ();
+	t_list = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (i = 0, scanned = 0; i < count; i++)
+	{
+		for (j = MAX_CLIENTS + 1; j < sv.num_edicts; j++)
+			if (ED_REUSABLE(EDICT_NUM(j)))
+				break;
+		scanned = j < sv.num_edicts ? j : 0;
+	}
+	t_scan = Sys_DoubleTime () - start;
+
+	Com_Printf ("%i edicts, %i waiting to be reused\n", sv.num_edicts, ed_freecount);
+	Com_Printf ("free list: %.1f ns, edict %i\n", t_list * 1e9 / count, found);
+	Com_Printf ("scan     : %.1f ns, edict %i\n", t_scan * 1e9 / count, scanned);
+	if (found != scanned)
+		Com_Printf ("WARNING: free list and scan disagree\n");
 }
 
 //===========================================================================
@@ -731,7 +1341,7 @@ qbool ED_ParseEpair (void *base, ddef_t *key, char *s)
 	switch (key->type & ~DEF_SAVEGLOBAL)
 	{
 	case ev_string:
-		*(string_t *)d = PR_SetString(ED_NewString (s));
+		*(string_t *)d = PR_SetConstString(ED_NewString (s));
 		break;
 	
 	case ev_float:
@@ -874,7 +1484,13 @@ sprintf (com_token, "0 %s 0", temp);
 	}
 
 	if (!init)
+	{
 		ent->inuse = false;
+		ED_QueueFree (ent);
+	}
+
+	ED_EdictChanged (ent);
+	ed_hotstale = true;
 
 	return data;
 }
@@ -1089,6 +1705,8 @@ void PR_LoadProgs (void)
 
 	pr_edict_size = progs->entityfields * 4 + sizeof (edict_t) - sizeof(entvars_t);
 
+	ED_ClearFindIndexes ();
+
 // byte swap the lumps
 	for (i=0 ; i<progs->numstatements ; i++)
 	{
@@ -1098,6 +1716,8 @@ void PR_LoadProgs (void)
 		pr_statements[i].c = LittleShort(pr_statements[i].c);
 	}
 
+	PR_DecodeStatements ();
+
 	for (i=0 ; i<progs->numfunctions; i++)
 	{
 	pr_functions[i].first_statement = LittleLong (pr_functions[i].first_statement);
@@ -1149,6 +1769,9 @@ void PR_LoadProgs (void)
 
 	PR_CheckExtensions ();
 	PR_FindCmdFunctions ();
+
+	PR_JitLoadProgs ();
+	PR_ResetProfile ();
 }
 
 
@@ -1163,6 +1786,19 @@ void PR_Init (void)
 	Cmd_AddCommand ("edicts", ED_PrintEdicts_f);
 	Cmd_AddCommand ("edictcount", ED_EdictCount_f);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("profile_report", PR_ProfileReport_f);
+	Cmd_AddCommand ("profile_flame", PR_ProfileFlame_f);
+	Cmd_AddCommand ("profile_clear", PR_ProfileClear_f);
+	Cmd_AddCommand ("jit_stats", PR_JitStats_f);
+	Cmd_AddCommand ("bench_strings", PR_BenchStrings_f);
+	Cmd_AddCommand ("bench_edalloc", ED_BenchAlloc_f);
+
+	Cvar_Register (&pr_findindex);
+	Cvar_Register (&pr_fastexec);
+	Cvar_Register (&pr_jit);
+	Cvar_Register (&pr_profile);
+
+	ED_InitFieldWatch ();
 }
 
 
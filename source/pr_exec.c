@@ -253,6 +253,341 @@ void PR_Profile_f (void)
 }
 
 
+/*
+============================================================================
+TIME PROFILE
+
+With pr_profile 1, PR_EnterFunction, PR_LeaveFunction and PR_CallBuiltin
+take the time around every QC function and builtin.  A function's self
+time leaves out the functions and builtins it calls; its total time
+includes them, counted once for recursive calls.  The time of each call
+path is also kept in a tree, for profile_flame.
+
+Everything is kept per map: the summary is printed and the data dropped
+when the next map is spawned.
+============================================================================
+*/
+
+cvar_t	pr_profile = {"pr_profile", "0"};
+
+typedef struct
+{
+	double		self;
+	double		total;
+	int			calls;
+	int			active;			// activations on the stack
+} prprofile_t;
+
+typedef struct
+{
+	int			func;
+	int			parent;
+	int			child;
+	int			sibling;
+	double		self;
+} prpathnode_t;
+
+typedef struct
+{
+	int			func;
+	int			node;
+	double		start;
+	double		children;		// time spent in calls from this one
+} prprofframe_t;
+
+#define	MAX_PROFILE_NODES	16384
+#define	MAX_PROFILE_DEPTH	128
+
+qbool			pr_profiling;		// only changes outside of progs calls
+
+static prprofile_t		*prof_funcs;
+static int				prof_numfuncs;
+static prpathnode_t		*prof_nodes;		// node 0 is the engine
+static int				prof_numnodes;
+static int				prof_lostnodes;
+static prprofframe_t	prof_stack[MAX_PROFILE_DEPTH];
+static int				prof_depth;
+static double			prof_time;			// total time in progs
+static double			prof_start;			// realtime of first sample
+
+/*
+====================
+PR_ClearProfile
+====================
+*/
+static void PR_ClearProfile (void)
+{
+	if (prof_funcs)
+		memset (prof_funcs, 0, prof_numfuncs * sizeof(*prof_funcs));
+	if (prof_nodes)
+		memset (prof_nodes, 0, sizeof(*prof_nodes));
+	prof_numnodes = 1;
+	prof_lostnodes = 0;
+	prof_depth = 0;
+	prof_time = 0;
+	prof_start = 0;
+}
+
+/*
+====================
+PR_ResetProfile
+
+Called when progs are loaded
+====================
+*/
+void PR_ResetProfile (void)
+{
+	if (prof_funcs)
+		Q_free (prof_funcs);
+	prof_numfuncs = progs->numfunctions;
+	prof_funcs = Q_malloc (prof_numfuncs * sizeof(*prof_funcs));
+	PR_ClearProfile ();
+}
+
+/*
+====================
+PR_StartProfile
+
+Called by PR_ExecuteProgram when no progs are running
+====================
+*/
+static void PR_StartProfile (void)
+{
+	// frames left behind by a PR_RunError
+	for ( ; prof_depth > 0; prof_depth--)
+		if (prof_depth <= MAX_PROFILE_DEPTH)
+			prof_funcs[prof_stack[prof_depth - 1].func].active--;
+
+	pr_profiling = pr_profile.value && prof_funcs;
+	if (!pr_profiling)
+		return;
+
+	if (!prof_nodes)
+	{
+		prof_nodes = Q_malloc (MAX_PROFILE_NODES * sizeof(*prof_nodes));
+		memset (prof_nodes, 0, sizeof(*prof_nodes));
+	}
+	if (!prof_start)
+		prof_start = Sys_DoubleTime ();
+}
+
+static int PR_ProfileNode (int parent, int func)
+{
+	prpathnode_t	*node;
+	int				n;
+
+	for (n = prof_nodes[parent].child; n; n = prof_nodes[n].sibling)
+		if (prof_nodes[n].func == func)
+			return n;
+
+	if (prof_numnodes == MAX_PROFILE_NODES)
+	{
+		prof_lostnodes++;
+		return parent;		// charge it to the caller
+	}
+
+	n = prof_numnodes++;
+	node = &prof_nodes[n];
+	node->func = func;
+	node->parent = parent;
+	node->child = 0;
+	node->sibling = prof_nodes[parent].child;
+	node->self = 0;
+	prof_nodes[parent].child = n;
+	return n;
+}
+
+void PR_ProfileEnter (dfunction_t *f)
+{
+	prprofframe_t	*frame;
+
+	if (prof_depth++ >= MAX_PROFILE_DEPTH)
+		return;
+
+	frame = &prof_stack[prof_depth - 1];
+	frame->func = f - pr_functions;
+	frame->node = PR_ProfileNode (prof_depth > 1 ? frame[-1].node : 0, frame->func);
+	frame->children = 0;
+	prof_funcs[frame->func].active++;
+	frame->start = Sys_DoubleTime ();
+}
+
+void PR_ProfileLeave (void)
+{
+	prprofframe_t	*frame;
+	prprofile_t		*func;
+	double			time;
+
+	if (prof_depth <= 0)
+		return;
+	if (prof_depth-- > MAX_PROFILE_DEPTH)
+		return;
+
+	frame = &prof_stack[prof_depth];
+	time = Sys_DoubleTime () - frame->start;
+
+	func = &prof_funcs[frame->func];
+	func->calls++;
+	func->self += time - frame->children;
+	if (--func->active == 0)
+		func->total += time;
+	prof_nodes[frame->node].self += time - frame->children;
+
+	if (prof_depth)
+		frame[-1].children += time;
+	else
+		prof_time += time;
+}
+
+static int PR_CompareProfileSelf (const void *a, const void *b)
+{
+	double	sa = prof_funcs[*(int *)a].self, sb = prof_funcs[*(int *)b].self;
+
+	if (sa != sb)
+		return sa > sb ? -1 : 1;
+	return *(int *)a - *(int *)b;
+}
+
+static void PR_PrintProfile (int count)
+{
+	int		*order;
+	int		i, num;
+	dfunction_t	*f;
+
+	order = Q_malloc (prof_numfuncs * sizeof(*order));
+	for (i = 0, num = 0; i < prof_numfuncs; i++)
+		if (prof_funcs[i].calls)
+			order[num++] = i;
+	qsort (order, num, sizeof(*order), PR_CompareProfileSelf);
+
+	Com_Printf ("%.1f ms in progs over %.1f s, %i functions called\n",
+		prof_time * 1000, Sys_DoubleTime () - prof_start, num);
+	Com_Printf ("   calls    self ms   total ms  function\n");
+	for (i = 0; i < num && i < count; i++)
+	{
+		f = &pr_functions[order[i]];
+		Com_Printf ("%8i %10.3f %10.3f  %s%s\n", prof_funcs[order[i]].calls,
+			prof_funcs[order[i]].self * 1000, prof_funcs[order[i]].total * 1000,
+			PR_GetString(f->s_name), f->first_statement < 0 ? " (builtin)" : "");
+	}
+
+	Q_free (order);
+}
+
+/*
+====================
+PR_ProfileMapSummary
+
+Prints the profile of the map that is ending and drops it
+====================
+*/
+void PR_ProfileMapSummary (void)
+{
+	if (!prof_funcs || !prof_time)
+		return;
+
+	Com_Printf ("QC profile for %s:\n", sv.mapname);
+	PR_PrintProfile (10);
+	PR_ClearProfile ();
+}
+
+/*
+====================
+PR_ProfileReport_f
+====================
+*/
+void PR_ProfileReport_f (void)
+{
+	if (sv.state != ss_active || !prof_time)
+	{
+		Com_Printf ("no profile, set pr_profile 1 while a map is running\n");
+		return;
+	}
+
+	PR_PrintProfile (Cmd_Argc() > 1 ? Q_atoi (Cmd_Argv(1)) : 20);
+}
+
+/*
+====================
+PR_ProfileClear_f
+====================
+*/
+void PR_ProfileClear_f (void)
+{
+	if (pr_depth)
+		return;		// can't happen from the console, but be safe
+	PR_ClearProfile ();
+}
+
+/*
+====================
+PR_ProfileFlame_f
+
+Writes the time of every call path in the collapsed stack format
+flamegraph.pl reads: "func;func;func microseconds" per line
+====================
+*/
+void PR_ProfileFlame_f (void)
+{
+	char	name[MAX_OSPATH];
+	int		path[MAX_PROFILE_DEPTH];
+	FILE	*f;
+	int		i, n, depth, lines;
+	prpathnode_t	*node;
+
+	if (sv.state != ss_active || !prof_time)
+	{
+		Com_Printf ("no profile, set pr_profile 1 while a map is running\n");
+		return;
+	}
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf ("usage: profile_flame <filename>\n");
+		return;
+	}
+
+	// this can come in over rcon, so keep it inside the gamedir
+	if (strstr(Cmd_Argv(1), "..") || strchr(Cmd_Argv(1), ':')
+		|| Cmd_Argv(1)[0] == '/' || Cmd_Argv(1)[0] == '\\')
+	{
+		Com_Printf ("profile_flame: bad filename\n");
+		return;
+	}
+
+	Q_snprintfz (name, sizeof(name), "%s/%s", com_gamedir, Cmd_Argv(1));
+	COM_ForceExtension (name, ".txt");
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Com_Printf ("couldn't open %s\n", name);
+		return;
+	}
+
+	lines = 0;
+	for (i = 1; i < prof_numnodes; i++)
+	{
+		node = &prof_nodes[i];
+		if ((int)(node->self * 1000000) <= 0)
+			continue;
+
+		depth = 0;
+		for (n = i; n && depth < MAX_PROFILE_DEPTH; n = prof_nodes[n].parent)
+			path[depth++] = n;
+
+		while (depth--)
+			fprintf (f, "%s%s", PR_GetString(pr_functions[prof_nodes[path[depth]].func].s_name),
+				depth ? ";" : "");
+		fprintf (f, " %i\n", (int)(node->self * 1000000));
+		lines++;
+	}
+
+	fclose (f);
+	Com_Printf ("wrote %i call paths to %s\n", lines, name);
+	if (prof_lostnodes)
+		Com_Printf ("%i calls were charged to their caller, too many call paths\n", prof_lostnodes);
+}
+
 /*
 ============
 PR_RunError
@@ -329,6 +664,10 @@ int PR_EnterFunction (dfunction_t *f)
 	}
 
 	pr_xfunction = f;
+
+	if (pr_profiling)
+		PR_ProfileEnter (f);
+
 	return f->first_statement - 1;	// offset the s++
 }
 
@@ -344,6 +683,9 @@ int PR_LeaveFunction (void)
 	if (pr_depth <= 0)
 		Host_Error ("prog stack underflow");
 
+	if (pr_profiling)
+		PR_ProfileLeave ();
+
 // restore locals from the stack
 	c = pr_xfunction->locals;
 	localstack_used -= c;
@@ -359,40 +701,49 @@ int PR_LeaveFunction (void)
 	return pr_stack[pr_depth].s;
 }
 
-
 /*
 ====================
-PR_ExecuteProgram
+PR_CallBuiltin
 ====================
 */
-void PR_ExecuteProgram (func_t fnum)
+void PR_CallBuiltin (dfunction_t *f)
 {
-	eval_t	*a, *b, *c;
-	int		s;
-	dstatement_t	*st;
-	dfunction_t	*f, *newf;
-	int		runaway;
-	int		i;
-	edict_t	*ed;
-	int		exitdepth;
-	eval_t	*ptr;
+	int		i = -f->first_statement;
 
-	if (!fnum || fnum >= progs->numfunctions)
-	{
-		if (pr_global_struct->self)
-			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
-		Host_Error ("PR_ExecuteProgram: NULL function");
+	if (pr_profiling)
+		PR_ProfileEnter (f);
+
+	if (i >= pr_numbuiltins) {
+		if (i < ZQ_BUILTINS || i >= ZQ_BUILTINS + pr_numextbuiltins)
+			PR_RunError ("Bad builtin call number");
+		pr_extbuiltins[i - ZQ_BUILTINS] ();
 	}
+	else
+		pr_builtins[i] ();
 
-	f = &pr_functions[fnum];
+	if (pr_profiling)
+		PR_ProfileLeave ();
+}
 
-	runaway = 100000;
-	pr_trace = false;
 
-// make a stack frame
-	exitdepth = pr_depth;
+static int	pr_segmentrunaway;
 
-	s = PR_EnterFunction (f);
+/*
+====================
+PR_ExecuteStatements
+
+The plain interpreter, used when pr_fastexec is 0 and for tracing.
+A negative exitdepth stops it before the first call or return (see
+PR_ExecuteSegment).
+====================
+*/
+static void PR_ExecuteStatements (int s, int exitdepth, int runaway)
+{
+	eval_t	*a, *b, *c;
+	dstatement_t	*st;
+	dfunction_t	*newf;
+	edict_t	*ed;
+	eval_t	*ptr;
 
 while (1)
 {
@@ -553,11 +904,15 @@ while (1)
 	case OP_STOREP_F:
 	case OP_STOREP_ENT:
 	case OP_STOREP_FLD:		// integers
-	case OP_STOREP_S:
 	case OP_STOREP_FNC:		// pointers
 		ptr = (eval_t *)((byte *)sv.edicts + b->_int);
 		ptr->_int = a->_int;
 		break;
+	case OP_STOREP_S:
+		ptr = (eval_t *)((byte *)sv.edicts + b->_int);
+		ptr->_int = a->_int;
+		ED_StringStored (b->_int);		// for find
+		break;
 	case OP_STOREP_V:
 		ptr = (eval_t *)((byte *)sv.edicts + b->_int);
 		ptr->vector[0] = a->vector[0];
@@ -572,6 +927,8 @@ while (1)
 #endif
 		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
 			PR_RunError ("assignment to world entity");
+		if ((unsigned)b->_int < ED_WATCHFIELDS && ed_fieldwatch[b->_int])
+			ED_FieldAddressed (ed, b->_int);
 		c->_int = (byte *)((int *)&ed->v + b->_int) - (byte *)sv.edicts;
 		break;
 
@@ -624,6 +981,8 @@ while (1)
 	case OP_CALL6:
 	case OP_CALL7:
 	case OP_CALL8:
+		if (exitdepth < 0)
+			goto segmentend;
 		pr_argc = st->op - OP_CALL0;
 		if (!a->function)
 			PR_RunError ("NULL function");
@@ -632,14 +991,7 @@ while (1)
 
 		if (newf->first_statement < 0)
 		{	// negative statements are built-in functions
-			i = -newf->first_statement;
-			if (i >= pr_numbuiltins) {
-				if (i < ZQ_BUILTINS || i >= ZQ_BUILTINS + pr_numextbuiltins)
-					PR_RunError ("Bad builtin call number");
-				pr_extbuiltins[i - ZQ_BUILTINS] ();
-				break;
-			}
-			pr_builtins[i] ();
+			PR_CallBuiltin (newf);
 			break;
 		}
 
@@ -648,6 +1000,8 @@ while (1)
 
 	case OP_DONE:
 	case OP_RETURN:
+		if (exitdepth < 0)
+			goto segmentend;
 		pr_globals[OFS_RETURN] = pr_globals[st->a];
 		pr_globals[OFS_RETURN+1] = pr_globals[st->a+1];
 		pr_globals[OFS_RETURN+2] = pr_globals[st->a+2];
@@ -669,54 +1023,823 @@ while (1)
 	}
 }
 
+segmentend:
+	pr_segmentrunaway = runaway;
 }
 
-/*----------------------*/
+/*
+====================
+PR_ExecuteSegment
 
-char *pr_strtbl[MAX_PRSTR + MAX_DYN_PRSTR];
-int num_prstr;
+Runs statements from s up to, but not including, the next call or
+return, and returns the index of that statement.  runaway is counted
+through that statement, as the JIT does.  pr_jit 2 checks the JIT's
+code against this.
+====================
+*/
+int PR_ExecuteSegment (int s, int *runaway)
+{
+	PR_ExecuteStatements (s - 1, -1, *runaway);
+	*runaway = pr_segmentrunaway;
+	return pr_xstatement;
+}
 
-char *PR_GetString(int num)
+/*
+============================================================================
+THREADED CODE
+
+PR_DecodeStatements turns pr_statements into a parallel array of
+prthread_t when progs are loaded: operand pointers into pr_globals are
+resolved once, and each statement carries the address of its handler in
+PR_ExecuteThreaded, so dispatch is a single indirect jump.
+
+The fast path does not check pr_trace or bump dfunction_t::profile on
+every statement.  Profile counts are still exact: the runaway counter
+drops by one per statement, so the difference is added to the current
+function whenever a call or return changes pr_xfunction.  pr_xstatement
+is only stored where something can read it (calls, returns and errors).
+If a builtin turns tracing on, execution carries on in
+PR_ExecuteStatements.
+
+Needs GCC's labels as values; other compilers always use the switch.
+============================================================================
+*/
+
+#ifdef __GNUC__
+#define PR_THREADED
+#endif
+
+cvar_t	pr_fastexec = {"pr_fastexec", "1"};
+
+#ifdef PR_THREADED
+
+typedef struct
+{
+	const void	*handler;		// filled in by the first PR_ExecuteThreaded
+	eval_t		*a, *b, *c;
+	short		op;
+	short		jump;			// branch offset for OP_IF, OP_IFNOT, OP_GOTO
+} prthread_t;
+
+static prthread_t	*pr_threaded;
+static qbool		pr_threadlinked;
+
+/*
+====================
+PR_DecodeStatements
+====================
+*/
+void PR_DecodeStatements (void)
 {
-	if (num < 0) {
-//Com_DPrintf ("GET:%d == %s\n", num, pr_strtbl[-num]);
-		return pr_strtbl[-num];
+	int			i;
+	dstatement_t	*st;
+	prthread_t	*th;
+
+	pr_threaded = Hunk_AllocName (progs->numstatements * sizeof(prthread_t), "threaded");
+	pr_threadlinked = false;
+
+	for (i = 0, st = pr_statements, th = pr_threaded; i < progs->numstatements; i++, st++, th++)
+	{
+		th->a = (eval_t *)&pr_globals[st->a];
+		th->b = (eval_t *)&pr_globals[st->b];
+		th->c = (eval_t *)&pr_globals[st->c];
+		th->op = st->op;
+		if (st->op == OP_GOTO)
+			th->jump = (short)st->a;
+		else if (st->op == OP_IF || st->op == OP_IFNOT)
+			th->jump = (short)st->b;
+		else
+			th->jump = 0;
+	}
+}
+
+/*
+====================
+PR_ExecuteThreaded
+====================
+*/
+static void PR_ExecuteThreaded (int s, int exitdepth, int runaway)
+{
+	static const void *dispatch[] =
+	{
+		&&op_done,
+		&&op_mul_f, &&op_mul_v, &&op_mul_fv, &&op_mul_vf,
+		&&op_div_f,
+		&&op_add_f, &&op_add_v,
+		&&op_sub_f, &&op_sub_v,
+		&&op_eq_f, &&op_eq_v, &&op_eq_s, &&op_eq_e, &&op_eq_fnc,
+		&&op_ne_f, &&op_ne_v, &&op_ne_s, &&op_ne_e, &&op_ne_fnc,
+		&&op_le, &&op_ge, &&op_lt, &&op_gt,
+		&&op_load, &&op_load_v, &&op_load, &&op_load, &&op_load, &&op_load,
+		&&op_address,
+		&&op_store, &&op_store_v, &&op_store, &&op_store, &&op_store, &&op_store,
+		&&op_storep, &&op_storep_v, &&op_storep_s, &&op_storep, &&op_storep, &&op_storep,
+		&&op_done,
+		&&op_not_f, &&op_not_v, &&op_not_s, &&op_not_ent, &&op_not_fnc,
+		&&op_if, &&op_ifnot,
+		&&op_call, &&op_call, &&op_call, &&op_call, &&op_call,
+		&&op_call, &&op_call, &&op_call, &&op_call,
+		&&op_state,
+		&&op_goto,
+		&&op_and, &&op_or,
+		&&op_bitand, &&op_bitor
+	};
+	prthread_t	*st;
+	dfunction_t	*newf;
+	int			i;
+	int			mark;
+	edict_t		*ed;
+	eval_t		*ptr;
+
+	if (!pr_threadlinked)
+	{
+		for (i = 0; i < progs->numstatements; i++)
+		{
+			if ((unsigned)pr_threaded[i].op < sizeof(dispatch)/sizeof(dispatch[0]))
+				pr_threaded[i].handler = dispatch[pr_threaded[i].op];
+			else
+				pr_threaded[i].handler = &&op_bad;
+		}
+		pr_threadlinked = true;
+	}
+
+// the runaway check comes first so that pr_xstatement can be set to
+// the last statement run, as PR_ExecuteStatements reports it
+#define JUMP(n)							\
+	do {								\
+		if (--runaway == 0)				\
+			goto op_runaway;			\
+		st += (n);						\
+		goto *st->handler;				\
+	} while (0)
+#define NEXT	JUMP(1)
+
+// after a call or return pr_xstatement is already right
+#define NEXTENTERED						\
+	do {								\
+		if (--runaway == 0)				\
+			goto op_runaway_entered;	\
+		st++;							\
+		goto *st->handler;				\
+	} while (0)
+
+// charge the statements run since the last call or return to pr_xfunction
+#define FLUSHPROFILE					\
+	do {								\
+		pr_xfunction->profile += mark - runaway;	\
+		mark = runaway;					\
+	} while (0)
+
+	mark = runaway;
+	st = pr_threaded + s;
+	NEXTENTERED;
+
+op_add_f:
+	st->c->_float = st->a->_float + st->b->_float;
+	NEXT;
+op_add_v:
+	st->c->vector[0] = st->a->vector[0] + st->b->vector[0];
+	st->c->vector[1] = st->a->vector[1] + st->b->vector[1];
+	st->c->vector[2] = st->a->vector[2] + st->b->vector[2];
+	NEXT;
+
+op_sub_f:
+	st->c->_float = st->a->_float - st->b->_float;
+	NEXT;
+op_sub_v:
+	st->c->vector[0] = st->a->vector[0] - st->b->vector[0];
+	st->c->vector[1] = st->a->vector[1] - st->b->vector[1];
+	st->c->vector[2] = st->a->vector[2] - st->b->vector[2];
+	NEXT;
+
+op_mul_f:
+	st->c->_float = st->a->_float * st->b->_float;
+	NEXT;
+op_mul_v:
+	st->c->_float = st->a->vector[0]*st->b->vector[0]
+			+ st->a->vector[1]*st->b->vector[1]
+			+ st->a->vector[2]*st->b->vector[2];
+	NEXT;
+op_mul_fv:
+	st->c->vector[0] = st->a->_float * st->b->vector[0];
+	st->c->vector[1] = st->a->_float * st->b->vector[1];
+	st->c->vector[2] = st->a->_float * st->b->vector[2];
+	NEXT;
+op_mul_vf:
+	st->c->vector[0] = st->b->_float * st->a->vector[0];
+	st->c->vector[1] = st->b->_float * st->a->vector[1];
+	st->c->vector[2] = st->b->_float * st->a->vector[2];
+	NEXT;
+
+op_div_f:
+	st->c->_float = st->a->_float / st->b->_float;
+	NEXT;
+
+op_bitand:
+	st->c->_float = (int)st->a->_float & (int)st->b->_float;
+	NEXT;
+op_bitor:
+	st->c->_float = (int)st->a->_float | (int)st->b->_float;
+	NEXT;
+
+op_ge:
+	st->c->_float = st->a->_float >= st->b->_float;
+	NEXT;
+op_le:
+	st->c->_float = st->a->_float <= st->b->_float;
+	NEXT;
+op_gt:
+	st->c->_float = st->a->_float > st->b->_float;
+	NEXT;
+op_lt:
+	st->c->_float = st->a->_float < st->b->_float;
+	NEXT;
+op_and:
+	st->c->_float = st->a->_float && st->b->_float;
+	NEXT;
+op_or:
+	st->c->_float = st->a->_float || st->b->_float;
+	NEXT;
+
+op_not_f:
+	st->c->_float = !st->a->_float;
+	NEXT;
+op_not_v:
+	st->c->_float = !st->a->vector[0] && !st->a->vector[1] && !st->a->vector[2];
+	NEXT;
+op_not_s:
+	st->c->_float = !st->a->string || !*PR_GetString(st->a->string);
+	NEXT;
+op_not_fnc:
+	st->c->_float = !st->a->function;
+	NEXT;
+op_not_ent:
+	st->c->_float = (PROG_TO_EDICT(st->a->edict) == sv.edicts);
+	NEXT;
+
+op_eq_f:
+	st->c->_float = st->a->_float == st->b->_float;
+	NEXT;
+op_eq_v:
+	st->c->_float = (st->a->vector[0] == st->b->vector[0]) &&
+				(st->a->vector[1] == st->b->vector[1]) &&
+				(st->a->vector[2] == st->b->vector[2]);
+	NEXT;
+op_eq_s:
+	st->c->_float = !strcmp(PR_GetString(st->a->string), PR_GetString(st->b->string));
+	NEXT;
+op_eq_e:
+	st->c->_float = st->a->_int == st->b->_int;
+	NEXT;
+op_eq_fnc:
+	st->c->_float = st->a->function == st->b->function;
+	NEXT;
+
+op_ne_f:
+	st->c->_float = st->a->_float != st->b->_float;
+	NEXT;
+op_ne_v:
+	st->c->_float = (st->a->vector[0] != st->b->vector[0]) ||
+				(st->a->vector[1] != st->b->vector[1]) ||
+				(st->a->vector[2] != st->b->vector[2]);
+	NEXT;
+op_ne_s:
+	st->c->_float = strcmp(PR_GetString(st->a->string), PR_GetString(st->b->string));
+	NEXT;
+op_ne_e:
+	st->c->_float = st->a->_int != st->b->_int;
+	NEXT;
+op_ne_fnc:
+	st->c->_float = st->a->function != st->b->function;
+	NEXT;
+
+//==================
+op_store:
+	st->b->_int = st->a->_int;
+	NEXT;
+op_store_v:
+	st->b->vector[0] = st->a->vector[0];
+	st->b->vector[1] = st->a->vector[1];
+	st->b->vector[2] = st->a->vector[2];
+	NEXT;
+
+op_storep:
+	ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+	ptr->_int = st->a->_int;
+	NEXT;
+op_storep_s:
+	ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+	ptr->_int = st->a->_int;
+	ED_StringStored (st->b->_int);		// for find
+	NEXT;
+op_storep_v:
+	ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+	ptr->vector[0] = st->a->vector[0];
+	ptr->vector[1] = st->a->vector[1];
+	ptr->vector[2] = st->a->vector[2];
+	NEXT;
+
+op_address:
+	ed = PROG_TO_EDICT(st->a->edict);
+#ifdef PARANOID
+	pr_xstatement = st - pr_threaded;
+	NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+	if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+	{
+		pr_xstatement = st - pr_threaded;
+		PR_RunError ("assignment to world entity");
+	}
+	if ((unsigned)st->b->_int < ED_WATCHFIELDS && ed_fieldwatch[st->b->_int])
+		ED_FieldAddressed (ed, st->b->_int);
+	st->c->_int = (byte *)((int *)&ed->v + st->b->_int) - (byte *)sv.edicts;
+	NEXT;
+
+op_load:
+	ed = PROG_TO_EDICT(st->a->edict);
+#ifdef PARANOID
+	pr_xstatement = st - pr_threaded;
+	NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+	st->c->_int = ((eval_t *)((int *)&ed->v + st->b->_int))->_int;
+	NEXT;
+op_load_v:
+	ed = PROG_TO_EDICT(st->a->edict);
+#ifdef PARANOID
+	pr_xstatement = st - pr_threaded;
+	NUM_FOR_EDICT(ed);		// make sure it's in range
+#endif
+	ptr = (eval_t *)((int *)&ed->v + st->b->_int);
+	st->c->vector[0] = ptr->vector[0];
+	st->c->vector[1] = ptr->vector[1];
+	st->c->vector[2] = ptr->vector[2];
+	NEXT;
+
+//==================
+
+op_ifnot:
+	if (!st->a->_int)
+		JUMP(st->jump);
+	NEXT;
+op_if:
+	if (st->a->_int)
+		JUMP(st->jump);
+	NEXT;
+op_goto:
+	JUMP(st->jump);
+
+op_call:
+	pr_xstatement = st - pr_threaded;
+	FLUSHPROFILE;
+	pr_argc = st->op - OP_CALL0;
+	if (!st->a->function)
+		PR_RunError ("NULL function");
+
+	newf = &pr_functions[st->a->function];
+
+	if (newf->first_statement < 0)
+	{	// negative statements are built-in functions
+		PR_CallBuiltin (newf);
+
+		if (pr_trace)
+		{	// traceon was called, finish in the plain interpreter
+			PR_Interpret (st - pr_threaded, exitdepth, runaway);
+			return;
+		}
+		NEXT;
+	}
+
+	st = pr_threaded + PR_EnterFunction (newf);
+	NEXTENTERED;
+
+op_done:
+	pr_xstatement = st - pr_threaded;
+	FLUSHPROFILE;
+	pr_globals[OFS_RETURN] = st->a->vector[0];
+	pr_globals[OFS_RETURN+1] = st->a->vector[1];
+	pr_globals[OFS_RETURN+2] = st->a->vector[2];
+
+	st = pr_threaded + PR_LeaveFunction ();
+	if (pr_depth == exitdepth)
+		return;		// all done
+	NEXTENTERED;
+
+op_state:
+	ed = PROG_TO_EDICT(pr_global_struct->self);
+	ed->v.nextthink = pr_global_struct->time + 0.1;
+	ed->v.frame = st->a->_float;
+	ed->v.think = st->b->function;
+	NEXT;
+
+op_bad:
+	pr_xstatement = st - pr_threaded;
+	PR_RunError ("Bad opcode %i", st->op);
+	return;
+
+op_runaway:
+	pr_xstatement = st - pr_threaded;
+op_runaway_entered:
+	FLUSHPROFILE;
+	pr_xfunction->profile--;	// the statement that tripped it never ran
+	PR_RunError ("runaway loop error");
+
+#undef JUMP
+#undef NEXTENTERED
+#undef NEXT
+#undef FLUSHPROFILE
+}
+
+#else	// !PR_THREADED
+
+void PR_DecodeStatements (void)
+{
+}
+
+#endif	// PR_THREADED
+
+/*
+====================
+PR_Interpret
+
+Carries on from statement s (which has already been run) with the
+threaded interpreter when it can be used, else with the switch loop.
+====================
+*/
+void PR_Interpret (int s, int exitdepth, int runaway)
+{
+#ifdef PR_THREADED
+	if (pr_fastexec.value && !pr_trace)
+	{
+		PR_ExecuteThreaded (s, exitdepth, runaway);
+		return;
+	}
+#endif
+	PR_ExecuteStatements (s, exitdepth, runaway);
+}
+
+/*
+====================
+PR_ExecuteProgram
+====================
+*/
+void PR_ExecuteProgram (func_t fnum)
+{
+	dfunction_t	*f;
+	int		s;
+	int		exitdepth;
+
+	if (!fnum || fnum >= progs->numfunctions)
+	{
+		if (pr_global_struct->self)
+			ED_Print (PROG_TO_EDICT(pr_global_struct->self));
+		Host_Error ("PR_ExecuteProgram: NULL function");
 	}
-	return pr_strings + num;
-}
-
-int PR_SetString(char *s) {
-    int i;
-    ptrdiff_t offset = s - pr_strings;
-    if (offset >= 0 && offset < progs->numstrings) {
-        return (int)offset;
-    }
-    for (i = 1; i <= num_prstr; i++)
-        if (pr_strtbl[i] == s)
-            return -i;
-    if (num_prstr == MAX_PRSTR - 1)
-        Sys_Error("MAX_PRSTR");
-    num_prstr++;
-    pr_strtbl[num_prstr] = s;
-    return -num_prstr;
-}
-
-// reset static string counter and init dynamic strings array
+
+	f = &pr_functions[fnum];
+
+	pr_trace = false;
+
+	if (!pr_depth)
+		PR_StartProfile ();
+
+// make a stack frame
+	exitdepth = pr_depth;
+
+	s = PR_EnterFunction (f);
+
+	if (pr_jit.value && PR_JitReady ())
+		PR_ExecuteJit (s, exitdepth, 100000);
+	else
+		PR_Interpret (s, exitdepth, 100000);
+}
+
+/*
+============================================================================
+STRINGS
+
+Strings that aren't in the progs string table are passed to progs as
+negative numbers: -(slot + (generation << PRSTR_SLOTBITS)).
+
+Builtins return pointers to static buffers (pr_string_temp, the Info
+buffers, client names) and ED_ParseEpair returns a fresh copy for every
+string field on the map, so PR_SetString keeps one slot per pointer,
+found through a hash on the pointer value.  These are only dropped by
+PR_InitStrings when new progs are loaded.
+
+strzone strings get slots of their own, which strunzone puts on a free
+list for reuse.  Each reuse bumps the slot's generation, so a stale
+reference to a freed string reads as "" rather than as whatever string
+got the slot next.
+============================================================================
+*/
+
+#define	PRSTR_SLOTBITS	20
+#define	PRSTR_SLOTMASK	((1 << PRSTR_SLOTBITS) - 1)
+#define	PRSTR_GENMASK	((1 << (31 - PRSTR_SLOTBITS)) - 1)
+
+typedef enum {prstr_static, prstr_dynamic, prstr_free} prstrkind_t;
+
+typedef struct
+{
+	char		*s;
+	prstrkind_t	kind;
+	qbool		constant;		// contents never change, see PR_SetConstString
+	int			generation;
+	int			next;			// hash chain for static strings, free list for dynamic
+} prstring_t;
+
+static prstring_t	*pr_strtbl;
+static int			pr_strtblsize;
+int					num_prstr;			// slots in use, including slot 0
+
+static int			*pr_strhash;		// first slot of each chain, 0 for none
+static int			pr_strhashsize;		// a power of two
+static int			pr_strfree;			// first free dynamic slot, 0 for none
+
+static int PR_HashStringPointer (char *s)
+{
+	unsigned	h;
+
+	h = (unsigned)((size_t)s >> 2);
+	h ^= h >> 15;
+	h *= 2654435761u;
+	h ^= h >> 13;
+	return h & (pr_strhashsize - 1);
+}
+
+static int PR_StringNum (int slot)
+{
+	return -(slot | (pr_strtbl[slot].generation << PRSTR_SLOTBITS));
+}
+
+/*
+====================
+PR_NewStringSlot
+====================
+*/
+static int PR_NewStringSlot (void)
+{
+	prstring_t	*old;
+	int			i, h;
+
+	if (num_prstr == pr_strtblsize)
+	{
+		if (pr_strtblsize == PRSTR_SLOTMASK + 1)
+			Host_Error ("PR_NewStringSlot: too many strings");
+		old = pr_strtbl;
+		pr_strtblsize = pr_strtblsize ? pr_strtblsize * 2 : 1024;
+		pr_strtbl = Q_malloc (pr_strtblsize * sizeof(*pr_strtbl));
+		if (old)
+		{
+			memcpy (pr_strtbl, old, num_prstr * sizeof(*pr_strtbl));
+			Q_free (old);
+		}
+	}
+
+	// keep chains short
+	if (num_prstr >= pr_strhashsize)
+	{
+		if (pr_strhash)
+			Q_free (pr_strhash);
+		pr_strhashsize = pr_strhashsize ? pr_strhashsize * 2 : 1024;
+		pr_strhash = Q_malloc (pr_strhashsize * sizeof(*pr_strhash));
+		memset (pr_strhash, 0, pr_strhashsize * sizeof(*pr_strhash));
+		for (i = 1; i < num_prstr; i++)
+		{
+			if (pr_strtbl[i].kind != prstr_static)
+				continue;
+			h = PR_HashStringPointer (pr_strtbl[i].s);
+			pr_strtbl[i].next = pr_strhash[h];
+			pr_strhash[h] = i;
+		}
+	}
+
+	pr_strtbl[num_prstr].generation = 0;
+	return num_prstr++;
+}
+
+char *PR_GetString (int num)
+{
+	unsigned	n;
+	prstring_t	*str;
+
+	if (num >= 0)
+		return pr_strings + num;
+
+	n = -(unsigned)num;
+	if ((n & PRSTR_SLOTMASK) >= (unsigned)num_prstr)
+		return pr_strings;
+	str = &pr_strtbl[n & PRSTR_SLOTMASK];
+	if (str->generation != (int)(n >> PRSTR_SLOTBITS) || str->kind == prstr_free)
+		return pr_strings;		// freed with strunzone
+	return str->s;
+}
+
+int PR_SetString (char *s)
+{
+	int		slot, h;
+	ptrdiff_t offset = s - pr_strings;
+
+	if (offset >= 0 && offset < progs->numstrings)
+		return (int)offset;
+
+	h = PR_HashStringPointer (s);
+	for (slot = pr_strhash[h]; slot; slot = pr_strtbl[slot].next)
+	{
+		if (pr_strtbl[slot].s == s)
+			return PR_StringNum (slot);
+	}
+
+	slot = PR_NewStringSlot ();
+	h = PR_HashStringPointer (s);		// the hash may have grown
+	pr_strtbl[slot].s = s;
+	pr_strtbl[slot].kind = prstr_static;
+	pr_strtbl[slot].constant = false;
+	pr_strtbl[slot].next = pr_strhash[h];
+	pr_strhash[h] = slot;
+	return PR_StringNum (slot);
+}
+
+/*
+====================
+PR_SetConstString
+
+For strings that will never be written to again, like the copies
+ED_NewString makes.  Other pointers given to PR_SetString can be static
+buffers that get reused (pr_string_temp, client names)
+====================
+*/
+int PR_SetConstString (char *s)
+{
+	int		num;
+
+	num = PR_SetString (s);
+	if (num < 0)
+		pr_strtbl[-num & PRSTR_SLOTMASK].constant = true;
+	return num;
+}
+
+/*
+====================
+PR_StringIsConstant
+
+True if what PR_GetString returns for num will always read the same
+====================
+*/
+qbool PR_StringIsConstant (int num)
+{
+	unsigned	n;
+	prstring_t	*str;
+
+	if (num >= 0)
+		return true;
+
+	n = -(unsigned)num;
+	if ((n & PRSTR_SLOTMASK) >= (unsigned)num_prstr)
+		return false;
+	str = &pr_strtbl[n & PRSTR_SLOTMASK];
+	return str->kind == prstr_static && str->constant
+		&& str->generation == (int)(n >> PRSTR_SLOTBITS);
+}
+
+/*
+====================
+PR_NewDynString
+
+Returns a copy of s that stays until PR_FreeDynString or PR_FreeStrings
+====================
+*/
+int PR_NewDynString (char *s)
+{
+	int		slot;
+
+	if (pr_strfree)
+	{
+		slot = pr_strfree;
+		pr_strfree = pr_strtbl[slot].next;
+	}
+	else
+		slot = PR_NewStringSlot ();
+
+	pr_strtbl[slot].s = Q_strdup (s);
+	pr_strtbl[slot].kind = prstr_dynamic;
+	return PR_StringNum (slot);
+}
+
+/*
+====================
+PR_FreeDynString
+
+Freeing a string that has already been freed is allowed, like free in C
+====================
+*/
+void PR_FreeDynString (int num)
+{
+	unsigned	n;
+	int			slot;
+
+	if (num >= 0)
+		Host_Error ("PR_FreeDynString: not a dynamic string");
+
+	n = -(unsigned)num;
+	slot = n & PRSTR_SLOTMASK;
+	if (slot == 0 || slot >= num_prstr)
+		Host_Error ("PR_FreeDynString: bad string");
+
+	if (pr_strtbl[slot].kind == prstr_static)
+		Host_Error ("PR_FreeDynString: not a dynamic string");
+
+	if (pr_strtbl[slot].kind == prstr_free || pr_strtbl[slot].generation != (int)(n >> PRSTR_SLOTBITS))
+		return;
+
+	Q_free (pr_strtbl[slot].s);
+	pr_strtbl[slot].s = pr_strings;
+	pr_strtbl[slot].kind = prstr_free;
+	pr_strtbl[slot].generation = (pr_strtbl[slot].generation + 1) & PRSTR_GENMASK;
+	pr_strtbl[slot].next = pr_strfree;
+	pr_strfree = slot;
+}
+
+// forget all strings; called when progs are loaded
 void PR_InitStrings (void)
 {
-	int i;
-	for (i = MAX_PRSTR; i < MAX_PRSTR + MAX_DYN_PRSTR; i++)
-		pr_strtbl[i] = pr_strings;
+	PR_FreeStrings ();
+
 	num_prstr = 0;
+	pr_strfree = 0;
+	if (pr_strhash)
+		memset (pr_strhash, 0, pr_strhashsize * sizeof(*pr_strhash));
+
+	PR_NewStringSlot ();		// slot 0 isn't used, -0 is a progs string
+	pr_strtbl[0].s = pr_strings;
+	pr_strtbl[0].kind = prstr_free;
 }
 
+// free the strzone strings
 void PR_FreeStrings (void)
 {
 	int i;
-	for (i = MAX_PRSTR; i < MAX_PRSTR + MAX_DYN_PRSTR; i++) {
-		if (pr_strtbl[i] && pr_strtbl[i] != pr_strings) {
-			Q_free (pr_strtbl[i]);
-			pr_strtbl[i] = NULL;
-		}
+
+	for (i = 1; i < num_prstr; i++)
+	{
+		if (pr_strtbl[i].kind == prstr_dynamic)
+			PR_FreeDynString (PR_StringNum (i));
 	}
 }
+
+/*
+====================
+PR_BenchStrings_f
+
+Times PR_SetString for a pointer registered when the table was empty
+and for one registered last, plus strzone/strunzone churn, to show that
+neither the number of strings nor time spent on the map slows them down.
+====================
+*/
+void PR_BenchStrings_f (void)
+{
+	int		i, count, first, last, before;
+	double	start, t_first, t_last, t_zone;
+
+	if (sv.state != ss_active || num_prstr < 2)
+	{
+		Com_Printf ("no strings, start a map first\n");
+		return;
+	}
+
+	count = Cmd_Argc() > 1 ? Q_atoi (Cmd_Argv(1)) : 1000000;
+	if (count < 1)
+		count = 1;
+
+	for (first = 1; first < num_prstr && pr_strtbl[first].kind != prstr_static; first++)
+		;
+	for (last = num_prstr - 1; last > 0 && pr_strtbl[last].kind != prstr_static; last--)
+		;
+	if (first == num_prstr)
+	{
+		Com_Printf ("no static strings\n");
+		return;
+	}
+
+	start = Sys_DoubleTime ();
+	for (i = 0; i < count; i++)
+		PR_SetString (pr_strtbl[first].s);
+	t_first = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (i = 0; i < count; i++)
+		PR_SetString (pr_strtbl[last].s);
+	t_last = Sys_DoubleTime () - start;
+
+	before = num_prstr;
+	start = Sys_DoubleTime ();
+	for (i = 0; i < count / 10; i++)
+		PR_FreeDynString (PR_NewDynString ("bench"));
+	t_zone = Sys_DoubleTime () - start;
+
+	Com_Printf ("%i string slots, %i hash buckets\n", num_prstr, pr_strhashsize);
+	Com_Printf ("PR_SetString, first slot: %.1f ns\n", t_first * 1e9 / count);
+	Com_Printf ("PR_SetString, last slot : %.1f ns\n", t_last * 1e9 / count);
+	Com_Printf ("strzone+strunzone       : %.1f ns (%i new slots)\n",
+		t_zone * 1e9 / (count / 10 ? count / 10 : 1), num_prstr - before);
+}
@@ -0,0 +1,1025 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// pr_jit.c -- translates progs statements to x86-64 code
+
+#include "server.h"
+#include "sys.h"
+
+/*
+============================================================================
+
+The whole statement table is compiled in one go, block by block.  A block
+starts at a function's first statement, a branch target, or the statement
+after a branch, call or return.  Native code covers everything between
+calls and returns: arithmetic, stores, edict field loads and stores, and
+branches.  Calls and returns leave the native code and are done by
+PR_ExecuteJit with PR_EnterFunction and PR_LeaveFunction, so the progs
+stack, builtins and PR_RunError work as they do in the interpreter.  A
+few rare or error checking opcodes call PR_JitHelper.  Nothing called from
+native code may longjmp out through it (Windows x64 can't unwind frames
+without registered unwind data), so PR_JitHelper returns errors and the
+native code leaves with JIT_ERROR for PR_ExecuteJit to report them.
+
+Each block subtracts its length from the runaway counter on entry.  If
+that would bring it below 2, the block is left to the interpreter
+instead, so "runaway loop error" happens at the same statement (and the
+interpreter never needs pr_xstatement for the statement before the
+block), and profile counts can still be worked out from the counter as
+in PR_ExecuteThreaded.
+
+Registers while in native code:
+	rbx		pr_globals
+	r12		sv.edicts
+	r13d	runaway counter
+	r14		where to store the runaway counter on exit
+
+pr_jit 2 runs each stretch of native code against PR_ExecuteSegment and
+compares globals and edicts afterwards.  It is very slow and only meant
+for checking a new progs.dat.
+
+============================================================================
+*/
+
+cvar_t	pr_jit = {"pr_jit", "0"};
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define PR_JIT
+#endif
+
+#ifdef PR_JIT
+
+#define JIT_CALL		0
+#define JIT_RETURN		1
+#define JIT_BAIL		2		// leave the rest to the interpreter
+#define JIT_ERROR		3		// PR_JitHelper found an error, see jit_error
+
+#define JIT_MAXSTATEMENT	128		// longest code for one statement, with block check
+
+typedef int (*jitentry_t) (int runaway, int *runawayout, byte *target);
+
+static enum {jit_none, jit_ready, jit_failed} jit_state;
+static byte			*jit_code;
+static int			jit_codesize;
+static byte			**jit_entry;		// native address of each block start
+static byte			*jit_ptr, *jit_end;
+static byte			*jit_exit;
+
+typedef struct
+{
+	byte	*at;			// rel32 to patch
+	int		target;			// statement
+} jitfixup_t;
+
+static jitfixup_t	*jit_fixups;
+static int			jit_numfixups;
+
+static char			jit_error[128];		// for PR_RunError
+static qbool		jit_errorhost;		// Host_Error without a progs trace instead
+
+// pr_jit 2
+static int			*jit_checkglobals;
+static byte			*jit_checkedicts;
+static int			jit_checked, jit_mismatches;
+
+/*
+============================================================================
+
+CODE EMISSION
+
+============================================================================
+*/
+
+// registers, as they go in the ModRM reg field
+#define	EAX		0
+#define	ECX		1
+#define	EDX		2
+#define	EDI		7
+#define	XMM0	0
+#define	XMM1	1
+
+// opcodes that take an [rbx + disp32] operand
+#define	MOVSS_LOAD		"\xF3\x0F\x10"
+#define	MOVSS_STORE		"\xF3\x0F\x11"
+#define	ADDSS			"\xF3\x0F\x58"
+#define	SUBSS			"\xF3\x0F\x5C"
+#define	MULSS			"\xF3\x0F\x59"
+#define	DIVSS			"\xF3\x0F\x5E"
+#define	UCOMISS			"\x0F\x2E"
+#define	CVTTSS2SI		"\xF3\x0F\x2C"
+#define	MOV_LOAD		"\x8B"
+#define	MOV_STORE		"\x89"
+#define	CMP_LOAD		"\x3B"
+#define	MOVSXD			"\x48\x63"
+
+#define	V_OFS	((int)(size_t)&((edict_t *)0)->v)
+
+#define J_Code(s)		J_Bytes (s, sizeof(s) - 1)
+#define J_Global(op, reg, ofs)	J_GlobalOp (op, sizeof(op) - 1, reg, ofs)
+
+static void J_Bytes (const char *bytes, int count)
+{
+	memcpy (jit_ptr, bytes, count);
+	jit_ptr += count;
+}
+
+static void J_Long (int l)
+{
+	memcpy (jit_ptr, &l, 4);
+	jit_ptr += 4;
+}
+
+static void J_Pointer (void *p)
+{
+	memcpy (jit_ptr, &p, sizeof(p));
+	jit_ptr += sizeof(p);
+}
+
+// op reg, [rbx + ofs*4]
+static void J_GlobalOp (const char *op, int oplen, int reg, int ofs)
+{
+	J_Bytes (op, oplen);
+	*jit_ptr++ = 0x83 | (reg << 3);
+	J_Long (ofs * 4);
+}
+
+// mov eax, code; jmp exit
+static void J_Exit (int s, int reason)
+{
+	J_Code ("\xB8");
+	J_Long ((s << 2) | reason);
+	J_Code ("\xE9");
+	J_Long (jit_exit - (jit_ptr + 4));
+}
+
+// a jump to statement target, patched once everything is emitted
+static void J_Fixup (int target)
+{
+	jit_fixups[jit_numfixups].at = jit_ptr;
+	jit_fixups[jit_numfixups].target = target;
+	jit_numfixups++;
+	J_Long (0);
+}
+
+// calls func (arg), and leaves with JIT_ERROR for statement arg if it returns nonzero
+static void J_CallHelper (void *func, int arg)
+{
+#ifdef _WIN32
+	J_Code ("\xB9");				// mov ecx, arg
+#else
+	J_Code ("\xBF");				// mov edi, arg
+#endif
+	J_Long (arg);
+	J_Code ("\x48\xB8");			// mov rax, func
+	J_Pointer (func);
+	J_Code ("\xFF\xD0");			// call rax
+	J_Code ("\x85\xC0");			// test eax, eax
+	J_Code ("\x74\x0A");			// jz over the exit
+	J_Exit (arg, JIT_ERROR);
+}
+
+// al (0 or 1) to a float in global ofs
+static void J_StoreBool (int ofs)
+{
+	J_Code ("\x0F\xB6\xC0");		// movzx eax, al
+	J_Code ("\xF3\x0F\x2A\xC0");	// cvtsi2ss xmm0, eax
+	J_Global (MOVSS_STORE, XMM0, ofs);
+}
+
+// al = (xmm0 != 0), the C truth value of a float; xmm1 is cleared
+static void J_FloatTrue (void)
+{
+	J_Code ("\x0F\x57\xC9");		// xorps xmm1, xmm1
+	J_Code ("\x0F\x2E\xC1");		// ucomiss xmm0, xmm1
+	J_Code ("\x0F\x95\xC0");		// setne al
+	J_Code ("\x0F\x9A\xC1");		// setp cl
+	J_Code ("\x08\xC8");			// or al, cl
+}
+
+// rax = byte offset of field b in edict a, from sv.edicts
+static void J_FieldAddress (int a, int b)
+{
+	J_Global (MOVSXD, EAX, a);
+	J_Global (MOVSXD, ECX, b);
+	J_Code ("\x48\x8D\x04\x88");	// lea rax, [rax + rcx*4]
+}
+
+/*
+============================================================================
+
+COMPILING
+
+============================================================================
+*/
+
+/*
+====================
+PR_JitHelper
+
+Opcodes that aren't worth inlining, or that can fail.  Returns true with
+jit_error set instead of calling PR_RunError
+====================
+*/
+static qbool PR_JitError (qbool host, char *fmt, ...)
+{
+	va_list		argptr;
+
+	va_start (argptr, fmt);
+#ifdef _WIN32
+	_vsnprintf (jit_error, sizeof(jit_error) - 1, fmt, argptr);
+	jit_error[sizeof(jit_error) - 1] = '\0';
+#else
+	vsnprintf (jit_error, sizeof(jit_error), fmt, argptr);
+#endif
+	va_end (argptr);
+	jit_errorhost = host;
+	return true;
+}
+
+// NUM_FOR_EDICT's check, without the Host_Error
+#define JIT_BADEDICT(ed)	((unsigned)(((byte *)(ed) - (byte *)sv.edicts) / pr_edict_size) >= (unsigned)sv.num_edicts)
+
+static int PR_JitHelper (int s)
+{
+	dstatement_t	*st;
+	eval_t	*a, *b, *c, *ptr;
+	edict_t	*ed;
+
+	st = &pr_statements[s];
+	a = (eval_t *)&pr_globals[st->a];
+	b = (eval_t *)&pr_globals[st->b];
+	c = (eval_t *)&pr_globals[st->c];
+
+	switch (st->op)
+	{
+	case OP_NOT_V:
+		c->_float = !a->vector[0] && !a->vector[1] && !a->vector[2];
+		break;
+	case OP_NOT_S:
+		c->_float = !a->string || !*PR_GetString(a->string);
+		break;
+	case OP_NOT_ENT:
+		c->_float = (PROG_TO_EDICT(a->edict) == sv.edicts);
+		break;
+
+	case OP_EQ_V:
+		c->_float = (a->vector[0] == b->vector[0]) &&
+					(a->vector[1] == b->vector[1]) &&
+					(a->vector[2] == b->vector[2]);
+		break;
+	case OP_EQ_S:
+		c->_float = !strcmp(PR_GetString(a->string), PR_GetString(b->string));
+		break;
+	case OP_NE_V:
+		c->_float = (a->vector[0] != b->vector[0]) ||
+					(a->vector[1] != b->vector[1]) ||
+					(a->vector[2] != b->vector[2]);
+		break;
+	case OP_NE_S:
+		c->_float = strcmp(PR_GetString(a->string), PR_GetString(b->string));
+		break;
+
+	case OP_STOREP_S:
+		ptr = (eval_t *)((byte *)sv.edicts + b->_int);
+		ptr->_int = a->_int;
+		ED_StringStored (b->_int);		// for find
+		break;
+
+	case OP_ADDRESS:
+		ed = PROG_TO_EDICT(a->edict);
+#ifdef PARANOID
+		if (JIT_BADEDICT(ed))		// make sure it's in range
+			return PR_JitError (true, "NUM_FOR_EDICT: bad pointer");
+#endif
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+			return PR_JitError (false, "assignment to world entity");
+		if ((unsigned)b->_int < ED_WATCHFIELDS && ed_fieldwatch[b->_int])
+			ED_FieldAddressed (ed, b->_int);
+		c->_int = (byte *)((int *)&ed->v + b->_int) - (byte *)sv.edicts;
+		break;
+
+#ifdef PARANOID
+	case OP_LOAD_F:
+	case OP_LOAD_FLD:
+	case OP_LOAD_ENT:
+	case OP_LOAD_S:
+	case OP_LOAD_FNC:
+		ed = PROG_TO_EDICT(a->edict);
+		if (JIT_BADEDICT(ed))		// make sure it's in range
+			return PR_JitError (true, "NUM_FOR_EDICT: bad pointer");
+		c->_int = ((eval_t *)((int *)&ed->v + b->_int))->_int;
+		break;
+	case OP_LOAD_V:
+		ed = PROG_TO_EDICT(a->edict);
+		if (JIT_BADEDICT(ed))		// make sure it's in range
+			return PR_JitError (true, "NUM_FOR_EDICT: bad pointer");
+		ptr = (eval_t *)((int *)&ed->v + b->_int);
+		c->vector[0] = ptr->vector[0];
+		c->vector[1] = ptr->vector[1];
+		c->vector[2] = ptr->vector[2];
+		break;
+#endif
+
+	case OP_STATE:
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		ed->v.frame = a->_float;
+		ed->v.think = b->function;
+		break;
+
+	default:
+		return PR_JitError (false, "Bad opcode %i", st->op);
+	}
+
+	return false;
+}
+
+/*
+====================
+PR_JitStatement
+====================
+*/
+static void PR_JitStatement (int s)
+{
+	dstatement_t	*st;
+	int		a, b, c, i;
+
+	st = &pr_statements[s];
+	a = st->a;
+	b = st->b;
+	c = st->c;
+
+	switch (st->op)
+	{
+	case OP_ADD_F:
+	case OP_SUB_F:
+	case OP_MUL_F:
+	case OP_DIV_F:
+		J_Global (MOVSS_LOAD, XMM0, a);
+		if (st->op == OP_ADD_F)
+			J_Global (ADDSS, XMM0, b);
+		else if (st->op == OP_SUB_F)
+			J_Global (SUBSS, XMM0, b);
+		else if (st->op == OP_MUL_F)
+			J_Global (MULSS, XMM0, b);
+		else
+			J_Global (DIVSS, XMM0, b);
+		J_Global (MOVSS_STORE, XMM0, c);
+		break;
+
+	// one component at a time, in case c overlaps a or b
+	case OP_ADD_V:
+	case OP_SUB_V:
+		for (i = 0; i < 3; i++)
+		{
+			J_Global (MOVSS_LOAD, XMM0, a + i);
+			if (st->op == OP_ADD_V)
+				J_Global (ADDSS, XMM0, b + i);
+			else
+				J_Global (SUBSS, XMM0, b + i);
+			J_Global (MOVSS_STORE, XMM0, c + i);
+		}
+		break;
+
+	case OP_MUL_V:
+		J_Global (MOVSS_LOAD, XMM0, a);
+		J_Global (MULSS, XMM0, b);
+		for (i = 1; i < 3; i++)
+		{
+			J_Global (MOVSS_LOAD, XMM1, a + i);
+			J_Global (MULSS, XMM1, b + i);
+			J_Code ("\xF3\x0F\x58\xC1");	// addss xmm0, xmm1
+		}
+		J_Global (MOVSS_STORE, XMM0, c);
+		break;
+	case OP_MUL_FV:
+		for (i = 0; i < 3; i++)
+		{
+			J_Global (MOVSS_LOAD, XMM0, a);
+			J_Global (MULSS, XMM0, b + i);
+			J_Global (MOVSS_STORE, XMM0, c + i);
+		}
+		break;
+	case OP_MUL_VF:
+		for (i = 0; i < 3; i++)
+		{
+			J_Global (MOVSS_LOAD, XMM0, b);
+			J_Global (MULSS, XMM0, a + i);
+			J_Global (MOVSS_STORE, XMM0, c + i);
+		}
+		break;
+
+	case OP_BITAND:
+	case OP_BITOR:
+		J_Global (CVTTSS2SI, EAX, a);
+		J_Global (CVTTSS2SI, ECX, b);
+		if (st->op == OP_BITAND)
+			J_Code ("\x21\xC8");		// and eax, ecx
+		else
+			J_Code ("\x09\xC8");		// or eax, ecx
+		J_Code ("\xF3\x0F\x2A\xC0");	// cvtsi2ss xmm0, eax
+		J_Global (MOVSS_STORE, XMM0, c);
+		break;
+
+	// unordered compares set CF, so NaNs come out false like in C
+	case OP_GE:
+	case OP_GT:
+		J_Global (MOVSS_LOAD, XMM0, a);
+		J_Global (UCOMISS, XMM0, b);
+		if (st->op == OP_GE)
+			J_Code ("\x0F\x93\xC0");	// setae al
+		else
+			J_Code ("\x0F\x97\xC0");	// seta al
+		J_StoreBool (c);
+		break;
+	case OP_LE:
+	case OP_LT:
+		J_Global (MOVSS_LOAD, XMM0, b);
+		J_Global (UCOMISS, XMM0, a);
+		if (st->op == OP_LE)
+			J_Code ("\x0F\x93\xC0");	// setae al
+		else
+			J_Code ("\x0F\x97\xC0");	// seta al
+		J_StoreBool (c);
+		break;
+
+	case OP_EQ_F:
+		J_Global (MOVSS_LOAD, XMM0, a);
+		J_Global (UCOMISS, XMM0, b);
+		J_Code ("\x0F\x94\xC0");		// sete al
+		J_Code ("\x0F\x9B\xC1");		// setnp cl
+		J_Code ("\x20\xC8");			// and al, cl
+		J_StoreBool (c);
+		break;
+	case OP_NE_F:
+		J_Global (MOVSS_LOAD, XMM0, a);
+		J_Global (UCOMISS, XMM0, b);
+		J_Code ("\x0F\x95\xC0");		// setne al
+		J_Code ("\x0F\x9A\xC1");		// setp cl
+		J_Code ("\x08\xC8");			// or al, cl
+		J_StoreBool (c);
+		break;
+	case OP_NOT_F:
+		J_Global (MOVSS_LOAD, XMM0, a);
+		J_FloatTrue ();
+		J_Code ("\x34\x01");			// xor al, 1
+		J_StoreBool (c);
+		break;
+
+	case OP_AND:
+	case OP_OR:
+		J_Global (MOVSS_LOAD, XMM0, a);
+		J_FloatTrue ();
+		J_Code ("\x88\xC2");			// mov dl, al
+		J_Global (MOVSS_LOAD, XMM0, b);
+		J_FloatTrue ();
+		if (st->op == OP_AND)
+			J_Code ("\x20\xD0");		// and al, dl
+		else
+			J_Code ("\x08\xD0");		// or al, dl
+		J_StoreBool (c);
+		break;
+
+	case OP_EQ_E:
+	case OP_EQ_FNC:
+	case OP_NE_E:
+	case OP_NE_FNC:
+		J_Global (MOV_LOAD, EAX, a);
+		J_Global (CMP_LOAD, EAX, b);
+		if (st->op == OP_EQ_E || st->op == OP_EQ_FNC)
+			J_Code ("\x0F\x94\xC0");	// sete al
+		else
+			J_Code ("\x0F\x95\xC0");	// setne al
+		J_StoreBool (c);
+		break;
+	case OP_NOT_FNC:
+		J_Code ("\x83\xBB");			// cmp dword [rbx + a*4], 0
+		J_Long (a * 4);
+		J_Code ("\x00");
+		J_Code ("\x0F\x94\xC0");		// sete al
+		J_StoreBool (c);
+		break;
+
+	case OP_STORE_F:
+	case OP_STORE_ENT:
+	case OP_STORE_FLD:
+	case OP_STORE_S:
+	case OP_STORE_FNC:
+		J_Global (MOV_LOAD, EAX, a);
+		J_Global (MOV_STORE, EAX, b);
+		break;
+	case OP_STORE_V:
+		for (i = 0; i < 3; i++)
+		{
+			J_Global (MOV_LOAD, EAX, a + i);
+			J_Global (MOV_STORE, EAX, b + i);
+		}
+		break;
+
+	case OP_STOREP_F:
+	case OP_STOREP_ENT:
+	case OP_STOREP_FLD:
+	case OP_STOREP_FNC:
+	case OP_STOREP_V:
+		J_Global (MOVSXD, EAX, b);
+		for (i = 0; i < (st->op == OP_STOREP_V ? 3 : 1); i++)
+		{
+			J_Global (MOV_LOAD, EDX, a + i);
+			J_Code ("\x41\x89\x94\x04");	// mov [r12 + rax + i*4], edx
+			J_Long (i * 4);
+		}
+		break;
+
+#ifndef PARANOID
+	case OP_LOAD_F:
+	case OP_LOAD_FLD:
+	case OP_LOAD_ENT:
+	case OP_LOAD_S:
+	case OP_LOAD_FNC:
+	case OP_LOAD_V:
+		J_FieldAddress (a, b);
+		for (i = 0; i < (st->op == OP_LOAD_V ? 3 : 1); i++)
+		{
+			J_Code ("\x41\x8B\x94\x04");	// mov edx, [r12 + rax + V_OFS + i*4]
+			J_Long (V_OFS + i * 4);
+			J_Global (MOV_STORE, EDX, c + i);
+		}
+		break;
+#endif
+
+	case OP_IF:
+	case OP_IFNOT:
+		J_Code ("\x83\xBB");			// cmp dword [rbx + a*4], 0
+		J_Long (a * 4);
+		J_Code ("\x00");
+		if (st->op == OP_IF)
+			J_Code ("\x0F\x85");		// jne
+		else
+			J_Code ("\x0F\x84");		// je
+		J_Fixup (s + (short)b);
+		break;
+
+	case OP_GOTO:
+		J_Code ("\xE9");
+		J_Fixup (s + (short)a);
+		break;
+
+	case OP_CALL0:
+	case OP_CALL1:
+	case OP_CALL2:
+	case OP_CALL3:
+	case OP_CALL4:
+	case OP_CALL5:
+	case OP_CALL6:
+	case OP_CALL7:
+	case OP_CALL8:
+		J_Exit (s, JIT_CALL);
+		break;
+
+	case OP_DONE:
+	case OP_RETURN:
+		J_Exit (s, JIT_RETURN);
+		break;
+
+	default:
+		J_CallHelper (PR_JitHelper, s);
+		break;
+	}
+}
+
+/*
+====================
+PR_JitFree
+====================
+*/
+static void PR_JitFree (void)
+{
+	if (jit_code)
+		Sys_FreeCode (jit_code, jit_codesize);
+	jit_code = NULL;
+	if (jit_entry)
+		Q_free (jit_entry);
+	jit_entry = NULL;
+	if (jit_checkglobals)
+		Q_free (jit_checkglobals);
+	jit_checkglobals = NULL;
+	if (jit_checkedicts)
+		Q_free (jit_checkedicts);
+	jit_checkedicts = NULL;
+	jit_state = jit_none;
+}
+
+/*
+====================
+PR_JitCompile
+====================
+*/
+static qbool PR_JitCompile (void)
+{
+	int		i, s, n, len, target;
+	byte	*blockstart;
+	dstatement_t	*st;
+
+	n = progs->numstatements;
+
+// find the blocks
+	blockstart = Q_malloc (n + 1);
+	memset (blockstart, 0, n + 1);
+	blockstart[0] = true;
+	for (i = 1; i < progs->numfunctions; i++)
+	{
+		if (pr_functions[i].first_statement >= 0 && pr_functions[i].first_statement < n)
+			blockstart[pr_functions[i].first_statement] = true;
+	}
+
+	for (s = 0, st = pr_statements; s < n; s++, st++)
+	{
+		switch (st->op)
+		{
+		case OP_IF:
+		case OP_IFNOT:
+		case OP_GOTO:
+			target = s + (short)(st->op == OP_GOTO ? st->a : st->b);
+			if (target < 0 || target >= n)
+			{
+				Com_Printf ("pr_jit: statement %i branches out of the program\n", s);
+				Q_free (blockstart);
+				return false;
+			}
+			blockstart[target] = true;
+			blockstart[s + 1] = true;
+			break;
+
+		case OP_CALL0:
+		case OP_CALL1:
+		case OP_CALL2:
+		case OP_CALL3:
+		case OP_CALL4:
+		case OP_CALL5:
+		case OP_CALL6:
+		case OP_CALL7:
+		case OP_CALL8:
+		case OP_DONE:
+		case OP_RETURN:
+			blockstart[s + 1] = true;
+			break;
+		}
+	}
+
+// emit
+	jit_codesize = (n + 1) * JIT_MAXSTATEMENT + 256;
+	jit_code = Sys_AllocCode (jit_codesize);
+	if (!jit_code)
+	{
+		Com_Printf ("pr_jit: couldn't allocate %iK of code memory\n", jit_codesize / 1024);
+		Q_free (blockstart);
+		return false;
+	}
+	jit_entry = Q_malloc ((n + 1) * sizeof(*jit_entry));
+	memset (jit_entry, 0, (n + 1) * sizeof(*jit_entry));
+	jit_fixups = Q_malloc (n * sizeof(*jit_fixups));
+	jit_numfixups = 0;
+	jit_ptr = jit_code;
+	jit_end = jit_code + jit_codesize;
+
+	// entry: save registers, load the bases and jump to the target block
+	J_Code ("\x53\x41\x54\x41\x55\x41\x56");	// push rbx, r12, r13, r14
+	J_Code ("\x48\x83\xEC\x28");				// sub rsp, 40 (align, and Win64 home space)
+#ifdef _WIN32
+	J_Code ("\x41\x89\xCD");					// mov r13d, ecx
+	J_Code ("\x49\x89\xD6");					// mov r14, rdx
+#else
+	J_Code ("\x41\x89\xFD");					// mov r13d, edi
+	J_Code ("\x49\x89\xF6");					// mov r14, rsi
+#endif
+	J_Code ("\x48\xBB");						// mov rbx, pr_globals
+	J_Pointer (pr_globals);
+	J_Code ("\x49\xBA");						// mov r10, &sv.edicts
+	J_Pointer (&sv.edicts);
+	J_Code ("\x4D\x8B\x22");					// mov r12, [r10]
+#ifdef _WIN32
+	J_Code ("\x41\xFF\xE0");					// jmp r8
+#else
+	J_Code ("\xFF\xE2");						// jmp rdx
+#endif
+
+	// exit: eax is already set
+	jit_exit = jit_ptr;
+	J_Code ("\x45\x89\x2E");					// mov [r14], r13d
+	J_Code ("\x48\x83\xC4\x28");				// add rsp, 40
+	J_Code ("\x41\x5E\x41\x5D\x41\x5C\x5B");	// pop r14, r13, r12, rbx
+	J_Code ("\xC3");							// ret
+
+	for (s = 0; s < n; s++)
+	{
+		if (jit_ptr > jit_end - JIT_MAXSTATEMENT)
+		{
+			Com_Printf ("pr_jit: out of code memory\n");
+			Q_free (blockstart);
+			Q_free (jit_fixups);
+			PR_JitFree ();
+			return false;
+		}
+
+		if (blockstart[s])
+		{
+			for (len = 1; s + len < n && !blockstart[s + len]; len++)
+				;
+			jit_entry[s] = jit_ptr;
+			J_Code ("\x41\x81\xFD");		// cmp r13d, len + 1
+			J_Long (len + 1);
+			J_Code ("\x7F\x0A");			// jg over the exit
+			J_Exit (s, JIT_BAIL);
+			J_Code ("\x41\x81\xED");		// sub r13d, len
+			J_Long (len);
+		}
+
+		PR_JitStatement (s);
+	}
+
+	// running off the end is left to the interpreter
+	jit_entry[n] = jit_ptr;
+	J_Exit (n, JIT_BAIL);
+
+	for (i = 0; i < jit_numfixups; i++)
+		*(int *)jit_fixups[i].at = jit_entry[jit_fixups[i].target] - (jit_fixups[i].at + 4);
+
+	Com_DPrintf ("pr_jit: %i statements, %iK of code\n", n, (int)(jit_ptr - jit_code) / 1024);
+
+	Sys_ProtectCode (jit_code, jit_codesize);
+	Q_free (blockstart);
+	Q_free (jit_fixups);
+	return true;
+}
+
+/*
+============================================================================
+
+RUNNING
+
+============================================================================
+*/
+
+/*
+====================
+PR_JitLoadProgs
+
+Called by PR_LoadProgs.  If pr_jit is off, compiling is put off until it
+is first needed.
+====================
+*/
+void PR_JitLoadProgs (void)
+{
+	PR_JitFree ();
+	if (pr_jit.value)
+		PR_JitReady ();
+}
+
+/*
+====================
+PR_JitReady
+====================
+*/
+qbool PR_JitReady (void)
+{
+	if (jit_state == jit_none)
+		jit_state = PR_JitCompile () ? jit_ready : jit_failed;
+	return jit_state == jit_ready;
+}
+
+/*
+====================
+PR_JitCheckFailed
+====================
+*/
+static void PR_JitCheckFailed (int s, char *what)
+{
+	jit_mismatches++;
+	Com_Printf ("pr_jit: %s differs after statement %i in %s\n", what, s,
+		PR_GetString(pr_xfunction->s_name));
+}
+
+/*
+====================
+PR_JitSame
+
+Bit for bit, so NaN payloads have to match too.  With two NaN operands
+x86 keeps the first one.  The native code uses the operand order of the
+C the interpreter is written in, which optimized builds keep, but an
+unoptimized build may swap them and get reported here.
+====================
+*/
+static qbool PR_JitSame (void *p1, void *p2, int size)
+{
+	return !memcmp (p1, p2, size);
+}
+
+/*
+====================
+PR_JitRunChecked
+
+pr_jit 2: runs the segment in the interpreter first, then in native code
+from the same state, and compares.
+====================
+*/
+static int PR_JitRunChecked (int s, int *runaway)
+{
+	int		code, end, irunaway, profile;
+	int		globalsize, edictsize;
+	int		*interpglobals;
+	byte	*interpedicts;
+
+	globalsize = progs->numglobals * 4;
+	edictsize = sv.num_edicts * pr_edict_size;
+	if (!jit_checkglobals)
+	{
+		jit_checkglobals = Q_malloc (globalsize * 2);
+		jit_checkedicts = Q_malloc (MAX_EDICTS * pr_edict_size * 2);
+	}
+	interpglobals = jit_checkglobals + progs->numglobals;
+	interpedicts = jit_checkedicts + MAX_EDICTS * pr_edict_size;
+
+	memcpy (jit_checkglobals, pr_globals, globalsize);
+	memcpy (jit_checkedicts, sv.edicts, edictsize);
+
+	profile = pr_xfunction->profile;
+	irunaway = *runaway;
+	end = PR_ExecuteSegment (s, &irunaway);
+	pr_xfunction->profile = profile;
+
+	memcpy (interpglobals, pr_globals, globalsize);
+	memcpy (interpedicts, sv.edicts, edictsize);
+	memcpy (pr_globals, jit_checkglobals, globalsize);
+	memcpy (sv.edicts, jit_checkedicts, edictsize);
+
+	code = ((jitentry_t)jit_code) (*runaway, runaway, jit_entry[s]);
+	if ((code & 3) == JIT_BAIL || (code & 3) == JIT_ERROR)
+		return code;		// stopped early, the interpreter takes it from here
+
+	jit_checked++;
+	if ((code >> 2) != end || *runaway != irunaway)
+		PR_JitCheckFailed (s, "control flow");
+	else if (!PR_JitSame (interpglobals, pr_globals, globalsize))
+		PR_JitCheckFailed (s, "globals");
+	else if (!PR_JitSame (interpedicts, sv.edicts, edictsize))
+		PR_JitCheckFailed (s, "edicts");
+
+	return code;
+}
+
+/*
+====================
+PR_ExecuteJit
+
+Like PR_ExecuteThreaded, from statement s (already run), but with calls
+and returns handled here and everything else in native code.
+====================
+*/
+void PR_ExecuteJit (int s, int exitdepth, int runaway)
+{
+	int		code, mark;
+	dstatement_t	*st;
+	dfunction_t	*newf;
+	eval_t	*a;
+
+	mark = runaway;
+	s++;
+
+	while (1)
+	{
+		if (s < 0 || s > progs->numstatements || !jit_entry[s])
+		{
+			pr_xfunction->profile += mark - runaway;
+			PR_Interpret (s - 1, exitdepth, runaway);
+			return;
+		}
+
+		if (pr_jit.value == 2)
+			code = PR_JitRunChecked (s, &runaway);
+		else
+			code = ((jitentry_t)jit_code) (runaway, &runaway, jit_entry[s]);
+		s = code >> 2;
+
+		pr_xfunction->profile += mark - runaway;
+		mark = runaway;
+
+		if ((code & 3) == JIT_BAIL)
+		{
+			PR_Interpret (s - 1, exitdepth, runaway);
+			return;
+		}
+
+		pr_xstatement = s;
+
+		if ((code & 3) == JIT_ERROR)
+		{	// raised here, where longjmp has only C frames to unwind
+			if (jit_errorhost)
+				Host_Error ("%s", jit_error);
+			PR_RunError ("%s", jit_error);
+		}
+
+		st = &pr_statements[s];
+		a = (eval_t *)&pr_globals[st->a];
+
+		if ((code & 3) == JIT_RETURN)
+		{
+			pr_globals[OFS_RETURN] = a->vector[0];
+			pr_globals[OFS_RETURN+1] = a->vector[1];
+			pr_globals[OFS_RETURN+2] = a->vector[2];
+
+			s = PR_LeaveFunction ();
+			if (pr_depth == exitdepth)
+				return;		// all done
+			s++;
+			continue;
+		}
+
+		pr_argc = st->op - OP_CALL0;
+		if (!a->function)
+			PR_RunError ("NULL function");
+
+		newf = &pr_functions[a->function];
+
+		if (newf->first_statement < 0)
+		{	// negative statements are built-in functions
+			PR_CallBuiltin (newf);
+
+			if (pr_trace)
+			{	// traceon was called, finish in the plain interpreter
+				PR_Interpret (s, exitdepth, runaway);
+				return;
+			}
+			s++;
+			continue;
+		}
+
+		s = PR_EnterFunction (newf) + 1;
+	}
+}
+
+/*
+====================
+PR_JitStats_f
+====================
+*/
+void PR_JitStats_f (void)
+{
+	switch (jit_state)
+	{
+	case jit_none:
+		Com_Printf ("progs not compiled\n");
+		break;
+	case jit_failed:
+		Com_Printf ("progs couldn't be compiled\n");
+		break;
+	case jit_ready:
+		Com_Printf ("%i statements in %iK of code\n", progs->numstatements,
+			(int)(jit_ptr - jit_code) / 1024);
+		break;
+	}
+	Com_Printf ("%i segments checked, %i mismatches\n", jit_checked, jit_mismatches);
+}
+
+#else	// !PR_JIT
+
+qbool PR_JitReady (void)
+{
+	static qbool warned;
+
+	if (!warned)
+		Com_Printf ("pr_jit: not supported on this platform\n");
+	warned = true;
+	return false;
+}
+
+void PR_JitLoadProgs (void)
+{
+}
+
+void PR_ExecuteJit (int s, int exitdepth, int runaway)
+{
+	PR_Interpret (s, exitdepth, runaway);
+}
+
+void PR_JitStats_f (void)
+{
+	Com_Printf ("pr_jit: not supported on this platform\n");
+}
+
+#endif	// PR_JIT
@@ -51,6 +51,8 @@ typedef struct edict_s
 {
 	qbool		inuse;
 	link_t		area;				// linked to a division node or leaf
+	struct areabounds_s	*areabounds;	// copy of absmin/absmax for area checks
+	int			areaslot;
 
 	int			num_leafs;
 	short		leafnums[MAX_ENT_LEAFS];	// for pvs checks, already -1
@@ -94,12 +96,73 @@ extern	int					pr_numcmdfunctions;
 void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
+void PR_DecodeStatements (void);
+int PR_EnterFunction (dfunction_t *f);
+int PR_LeaveFunction (void);
+void PR_Interpret (int s, int exitdepth, int runaway);
+int PR_ExecuteSegment (int s, int *runaway);
 void PR_LoadProgs (void);
 
 void PR_Profile_f (void);
+void PR_CallBuiltin (dfunction_t *f);
+
+extern	cvar_t	pr_profile;
+extern	qbool	pr_profiling;
+void PR_ProfileEnter (dfunction_t *f);
+void PR_ProfileLeave (void);
+void PR_ResetProfile (void);
+void PR_ProfileMapSummary (void);
+void PR_ProfileReport_f (void);
+void PR_ProfileClear_f (void);
+void PR_ProfileFlame_f (void);
+
+// pr_jit.c
+extern	cvar_t	pr_jit;
+void PR_JitLoadProgs (void);
+qbool PR_JitReady (void);
+void PR_ExecuteJit (int s, int exitdepth, int runaway);
+void PR_JitStats_f (void);
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
+void ED_RebuildFreeList (void);
+void ED_BenchAlloc_f (void);
+
+// what OP_ADDRESS on an entvars_t field has to tell the engine
+#define	FW_TRACE		1		// SV_TraceFieldAddressed
+#define	FW_HOT			2		// copied to ed_hot
+
+#define	ED_WATCHFIELDS	(sizeof(entvars_t)/4)
+extern	byte	ed_fieldwatch[ED_WATCHFIELDS];
+
+void ED_FieldAddressed (edict_t *ed, int field);
+// field is below ED_WATCHFIELDS and has ed_fieldwatch bits set
+
+// packed copies of the edict fields the engine walks all edicts for.
+// entries are current after SV_LinkEdict, ED_Free and ED_ClearEdict,
+// progs writes are caught up with by ED_SyncHotFields, call it before reading
+typedef struct
+{
+	vec3_t		origin[MAX_EDICTS];
+	vec3_t		absmin[MAX_EDICTS];
+	vec3_t		absmax[MAX_EDICTS];
+	float		modelindex[MAX_EDICTS];		// 0 for free edicts
+	byte		solid[MAX_EDICTS];
+	byte		hasmodel[MAX_EDICTS];		// modelindex and model string set
+} edhot_t;
+
+extern	edhot_t	ed_hot;
+extern	qbool	ed_hotstale;				// next sync copies all edicts
+
+void ED_UpdateHotFields (edict_t *ed);
+void ED_SyncHotFields (void);
+
+void ED_ClearFindIndexes (void);
+void ED_EdictChanged (edict_t *ed);
+// must be called after C code changes a string field of ed
+void ED_StringStored (int ofs);
+edict_t *ED_FindString (int start, int field, char *s);
+// the first edict after start with the string field set to s, or sv.edicts
 
 char	*ED_NewString (char *string);
 // returns a copy of the string allocated from the server's string heap
@@ -148,7 +211,9 @@ extern int pr_numbuiltins, pr_numextbuiltins;
 
 extern int		pr_argc;
 
+extern	int			pr_depth;
 extern	qbool		pr_trace;
+extern	cvar_t		pr_fastexec;
 extern	dfunction_t	*pr_xfunction;
 extern	int			pr_xstatement;
 
@@ -173,16 +238,17 @@ void ED_PrintNum (int ent);
 //
 // PR strings stuff
 //
-#define MAX_PRSTR 1024		// max static strings
-#define MAX_DYN_PRSTR 1024	// max dynamic strings
-
-extern char *pr_strtbl[MAX_PRSTR + MAX_DYN_PRSTR];
 extern int num_prstr;
 
 char *PR_GetString(int num);
 int PR_SetString(char *s);
+int PR_SetConstString (char *s);
+qbool PR_StringIsConstant (int num);
+int PR_NewDynString (char *s);
+void PR_FreeDynString (int num);
 void PR_InitStrings (void);
 void PR_FreeStrings (void);
+void PR_BenchStrings_f (void);
 
 #endif /* _PROGS_H_ */
 
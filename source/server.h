@@ -65,6 +65,8 @@ typedef struct
 	int			lastcheck;			// used by PF_checkclient
 	double		lastchecktime;		// for monster ai
 
+	int			leafchanges;		// bumped whenever an ent's leafnums change
+
 	qbool		loadgame;			// handle connections specially
 
 	//check player/eyes models for hacks
@@ -151,6 +153,17 @@ typedef struct
 #endif
 #define MAX_STUFFTEXT		256
 
+// a piece of a shared multicast block that belongs in a client datagram
+#define MAX_DATAGRAM_FRAGMENTS	64
+
+typedef struct
+{
+	struct dgblock_s	*block;
+	int					offset;
+	int					length;
+	int					position;	// datagram.cursize when it was added
+} dgfragment_t;
+
 typedef struct client_s
 {
 	client_state_e	state;
@@ -186,6 +199,11 @@ typedef struct client_s
 	sizebuf_t		datagram;
 	byte			datagram_buf[MAX_DATAGRAM];
 
+	// shared multicast data to be spliced into the datagram when sent
+	int				num_fragments;
+	int				fragment_size;		// total length of the fragments
+	dgfragment_t	fragments[MAX_DATAGRAM_FRAGMENTS];
+
 	// back buffers for client reliable data
 	sizebuf_t		backbuf;
 	int				num_backbuf;
@@ -251,10 +269,16 @@ typedef struct
 	double	idle;
 	int		count;
 	int		packets;
+	int		multicasts;
+	int		multicast_clients;	// spawned clients looked at by SV_Multicast
 
 	double	latched_active;
 	double	latched_idle;
 	int		latched_packets;
+	int		latched_multicasts;
+	int		latched_multicast_clients;
+
+	netstats_t	latched_net;	// server socket packets and syscalls
 } svstats_t;
 
 // MAX_CHALLENGES is made large to prevent a denial
@@ -356,6 +380,7 @@ extern	cvar_t	sv_paused;		// 1 - normal, 2 - auto (single player), 3 - both
 extern	cvar_t	sv_mintic, sv_maxtic;
 extern	cvar_t	maxclients;
 extern	cvar_t	sv_fastconnect;
+extern	cvar_t	sv_threads;
 extern	cvar_t	pm_maxspeed;
 
 extern	cvar_t	teamplay;
@@ -435,6 +460,7 @@ void SV_BeginRedirect (redirect_t rd);
 void SV_EndRedirect (void);
 
 void SV_Multicast (vec3_t origin, int to);
+void SV_ClearDatagram (client_t *cl);
 void SV_StartParticle (vec3_t org, vec3_t dir, int color, int count,
 						int replacement_te, int replacement_count);
 void SV_StartSound (edict_t *entity, int channel, char *sample, int volume,
@@ -464,7 +490,10 @@ void SV_SendServerInfoChange (char *key, char *value);
 // sv_ents.c
 //
 int SV_TranslateEntnum (int num);
+void SV_PrepareEntities (client_t **clients, int count);
 void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg);
+void SV_BenchEntSort_f (void);
+void SV_BenchHotFields_f (void);
 void SV_WriteClientdataToMessage (client_t *client, sizebuf_t *msg);
 
 //
@@ -135,6 +135,7 @@ void SV_RemoveBot (client_t *cl)
 
 	Com_DPrintf ("Bot %s removed\n", cl->name);
 
+	SV_ClearDatagram (cl);
 	cl->state = cs_free;		// we don't have zombie bots :)
 	cl->bot = false;
 	cl->old_frags = 0;
@@ -190,7 +191,7 @@ void SV_RunBots (void)
 
 		// update bogus network stuff
 		cl->netchan.last_received = curtime;
-		SZ_Clear (&cl->datagram);			// don't overflow
+		SV_ClearDatagram (cl);			// don't overflow
 		SV_ClearReliable (cl);				// don't overflow
 
 		//
@@ -276,6 +276,12 @@ void SV_Status_f (void)
 	Com_Printf ("cpu utilization  : %3i%%\n",(int)cpu);
 	Com_Printf ("avg response time: %i ms\n",(int)avg);
 	Com_Printf ("packets/frame    : %5.2f (%d)\n", pak, num_prstr);
+	Com_Printf ("multicasts/frame : %5.2f (%i client visits)\n",
+		(float)svs.stats.latched_multicasts / STATFRAMES, svs.stats.latched_multicast_clients / STATFRAMES);
+	if (svs.stats.latched_net.recvcalls && svs.stats.latched_net.sendcalls)
+		Com_Printf ("packets/syscall  : %5.2f in, %5.2f out\n",
+			(float)svs.stats.latched_net.recvpackets / svs.stats.latched_net.recvcalls,
+			(float)svs.stats.latched_net.sendpackets / svs.stats.latched_net.sendcalls);
 
 // min fps lat drp
 	if (sv_redirected != RD_NONE) {
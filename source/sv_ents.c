@@ -20,16 +20,39 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "server.h"
 #include "pmove.h"
+#include <threads.h>
 
 int SV_PMTypeForClient (client_t *cl);
 
+cvar_t	sv_threads = {"sv_threads", "1"};
+
 //=============================================================================
 
 // because there can be a lot of nails, there is a special
 // network protocol for them
 #define	MAX_NAILS	32
-edict_t	*nails[MAX_NAILS];
-int		numnails;
+
+/*
+** the entity update of one client while it is being built
+** kept apart for each client so several can be built at once
+*/
+typedef struct
+{
+	client_t	*client;
+	sizebuf_t	*msg;					// where the update goes
+	byte		pvs[MAX_MAP_LEAFS/8];
+	unsigned	visible[MAX_EDICTS/32];	// entnums touching a leaf in pvs
+	unsigned	pvshash;
+	int			visgeneration;			// visible is valid for this index
+	edict_t		*nails[MAX_NAILS];
+	int			numnails;
+
+	qbool		prepared;				// buf holds the finished update
+	sizebuf_t	buf;
+	byte		buf_data[MAX_DATAGRAM];
+} entbuild_t;
+
+static entbuild_t	sv_entbuild[MAX_CLIENTS];
 
 extern	int	sv_nailmodel, sv_supernailmodel, sv_playermodel;
 
@@ -39,37 +62,36 @@ cvar_t	sv_nailhack	= {"sv_nailhack", "0"};
 cvar_t	sv_nailhack	= {"sv_nailhack", "1"};
 #endif
 
-qbool SV_AddNailUpdate (edict_t *ent)
+static qbool SV_AddNailUpdate (entbuild_t *eb, edict_t *ent, float modelindex)
 {
 	if (sv_nailhack.value)
 		return false;
 
-	if (ent->v.modelindex != sv_nailmodel
-		&& ent->v.modelindex != sv_supernailmodel)
+	if (modelindex != sv_nailmodel && modelindex != sv_supernailmodel)
 		return false;
-	if (numnails == MAX_NAILS)
+	if (eb->numnails == MAX_NAILS)
 		return true;
-	nails[numnails] = ent;
-	numnails++;
+	eb->nails[eb->numnails] = ent;
+	eb->numnails++;
 	return true;
 }
 
-void SV_EmitNailUpdate (sizebuf_t *msg)
+static void SV_EmitNailUpdate (entbuild_t *eb, sizebuf_t *msg)
 {
 	byte	bits[6];	// [48 bits] xyzpy 12 12 12 4 8
 	int		n, i;
 	edict_t	*ent;
 	int		x, y, z, pitch, yaw;
 
-	if (!numnails)
+	if (!eb->numnails)
 		return;
 
 	MSG_WriteByte (msg, svc_nails);
-	MSG_WriteByte (msg, numnails);
+	MSG_WriteByte (msg, eb->numnails);
 
-	for (n=0 ; n<numnails ; n++)
+	for (n=0 ; n<eb->numnails ; n++)
 	{
-		ent = nails[n];
+		ent = eb->nails[n];
 		x = ((int)(ent->v.origin[0] + 4096 + 1) >> 1) & 4095;
 		y = ((int)(ent->v.origin[1] + 4096 + 1) >> 1) & 4095;
 		z = ((int)(ent->v.origin[2] + 4096 + 1) >> 1) & 4095;
@@ -343,100 +365,636 @@ static entity_state_t *SV_GetBaseline (int number)
 }
 
 
+/*
+=============================================================================
+
+PARALLEL ENTITY UPDATES
+
+With sv_threads > 1, SV_PrepareEntities builds the updates of all clients
+that are about to get a datagram on a pool of worker threads.  Nothing may
+change progs or world state while the workers run.
+
+=============================================================================
+*/
+
+#define SV_MAX_THREADS	16
+
+static mtx_t	sv_joblock;
+static cnd_t	sv_jobready;	// broadcast when new jobs are posted
+static cnd_t	sv_jobdone;		// signalled when the last job finished
+
+static int		sv_numworkers;		// threads started
+static int		sv_activeworkers;	// threads allowed to take jobs
+
+static void		(*sv_jobfunc) (entbuild_t *eb);
+static entbuild_t	*sv_jobs[MAX_CLIENTS];
+static int		sv_numjobs;
+static int		sv_nextjob;
+static int		sv_jobsfinished;
+
+// called and returns with sv_joblock held
+static void SV_DoJobs (void)
+{
+	entbuild_t	*eb;
+
+	while (sv_nextjob < sv_numjobs)
+	{
+		eb = sv_jobs[sv_nextjob++];
+		mtx_unlock (&sv_joblock);
+		sv_jobfunc (eb);
+		mtx_lock (&sv_joblock);
+
+		if (++sv_jobsfinished == sv_numjobs)
+			cnd_signal (&sv_jobdone);
+	}
+}
+
+static int SV_Worker (void *arg)
+{
+	int		index = (int)(intptr_t)arg;
+
+	mtx_lock (&sv_joblock);
+	while (1)
+	{
+		if (index < sv_activeworkers)
+			SV_DoJobs ();
+		cnd_wait (&sv_jobready, &sv_joblock);
+	}
+
+	return 0;
+}
+
+static void SV_StartWorkers (void)
+{
+	thrd_t	thread;
+	int		count;
+
+	count = bound (1, (int)sv_threads.value, SV_MAX_THREADS) - 1;
+
+	if (!sv_numworkers && count) {
+		mtx_init (&sv_joblock, mtx_plain);
+		cnd_init (&sv_jobready);
+		cnd_init (&sv_jobdone);
+	}
+
+	while (sv_numworkers < count)
+	{
+		if (thrd_create (&thread, SV_Worker, (void *)(intptr_t)sv_numworkers) != thrd_success) {
+			Com_Printf ("SV_StartWorkers: couldn't create thread\n");
+			break;
+		}
+		thrd_detach (thread);
+		sv_numworkers++;
+	}
+
+	sv_activeworkers = min (count, sv_numworkers);
+}
+
+// runs func on all queued jobs, the calling thread helps out
+static void SV_RunJobs (void (*func) (entbuild_t *eb), int count)
+{
+	mtx_lock (&sv_joblock);
+	sv_jobfunc = func;
+	sv_numjobs = count;
+	sv_nextjob = 0;
+	sv_jobsfinished = 0;
+	cnd_broadcast (&sv_jobready);
+
+	SV_DoJobs ();
+	while (sv_jobsfinished < sv_numjobs)
+		cnd_wait (&sv_jobdone, &sv_joblock);
+	mtx_unlock (&sv_joblock);
+}
+
+/*
+=============================================================================
+
+VISIBLE ENTITY INDEX
+
+Lists the entities touching each leaf, so the entities visible to a client
+can be found from the set bits of its PVS instead of testing every edict.
+The index is rebuilt when any entity has been relinked since the last
+build, and clients with the same PVS share the visible set.
+
+=============================================================================
+*/
+
+#define	VIS_WORDS	(MAX_EDICTS/32)
+
+static int		vis_spawncount = -1;
+static int		vis_leafchanges;
+static int		vis_generation;		// bumped on every rebuild
+static int		vis_numleafs;		// highest leafnum in use + 1
+static int		vis_leafstart[MAX_MAP_LEAFS+1];
+static int		vis_cursor[MAX_MAP_LEAFS];
+static short	vis_ents[MAX_EDICTS*MAX_ENT_LEAFS];
+
 /*
 =============
-SV_WriteEntitiesToClient
+SV_UpdateEntityIndex
 
-Encodes the current state of the world as
-a svc_packetentities messages and possibly
-a svc_nails message and
-svc_playerinfo messages
+Must not be called while the workers run
 =============
 */
-void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
+static void SV_UpdateEntityIndex (void)
 {
-	int		e, i;
+	int		e, i, leaf;
+	edict_t	*ent;
+
+	if (vis_spawncount == svs.spawncount && vis_leafchanges == sv.leafchanges)
+		return;		// nothing moved
+
+	vis_spawncount = svs.spawncount;
+	vis_leafchanges = sv.leafchanges;
+	vis_generation++;
+
+	// count the ents in each leaf
+	vis_numleafs = 0;
+	for (e=MAX_CLIENTS+1, ent=EDICT_NUM(e) ; e < sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+		for (i=0 ; i < ent->num_leafs ; i++)
+			if (ent->leafnums[i] >= vis_numleafs)
+				vis_numleafs = ent->leafnums[i] + 1;
+
+	memset (vis_leafstart, 0, (vis_numleafs + 1) * sizeof(vis_leafstart[0]));
+	for (e=MAX_CLIENTS+1, ent=EDICT_NUM(e) ; e < sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+		for (i=0 ; i < ent->num_leafs ; i++)
+			vis_leafstart[ent->leafnums[i] + 1]++;
+
+	for (leaf = 0; leaf < vis_numleafs; leaf++)
+		vis_leafstart[leaf + 1] += vis_leafstart[leaf];
+
+	// fill in, each leaf's list ends up sorted by entnum
+	memcpy (vis_cursor, vis_leafstart, vis_numleafs * sizeof(vis_cursor[0]));
+	for (e=MAX_CLIENTS+1, ent=EDICT_NUM(e) ; e < sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+		for (i=0 ; i < ent->num_leafs ; i++)
+			vis_ents[vis_cursor[ent->leafnums[i]]++] = e;
+}
+
+/*
+=============
+SV_FindVisibleEntities
+
+Sets eb->visible to the entities touching a leaf in eb->pvs
+=============
+*/
+static void SV_FindVisibleEntities (entbuild_t *eb)
+{
+	entbuild_t	*other;
+	unsigned	hash;
+	int		bytes, i, leaf, e;
+
+	// only the leafs that have ents in them matter
+	bytes = (vis_numleafs + 7) >> 3;
+
+	hash = 2166136261u;
+	for (i = 0; i < bytes; i++)
+		hash = (hash ^ eb->pvs[i]) * 16777619u;
+
+	// see if a client with the same PVS has been done already
+	if (sv_activeworkers)
+		mtx_lock (&sv_joblock);
+	for (i = 0, other = sv_entbuild; i < MAX_CLIENTS; i++, other++)
+	{
+		if (other == eb || other->visgeneration != vis_generation || other->pvshash != hash)
+			continue;
+		if (!memcmp (other->pvs, eb->pvs, bytes)) {
+			memcpy (eb->visible, other->visible, sizeof(eb->visible));
+			break;
+		}
+	}
+	if (sv_activeworkers)
+		mtx_unlock (&sv_joblock);
+
+	if (i == MAX_CLIENTS)
+	{
+		memset (eb->visible, 0, sizeof(eb->visible));
+		for (leaf = 0; leaf < vis_numleafs; leaf++)
+		{
+			if (!eb->pvs[leaf >> 3]) {
+				leaf |= 7;		// skip the whole byte
+				continue;
+			}
+			if (!(eb->pvs[leaf >> 3] & (1 << (leaf & 7))))
+				continue;
+			for (i = vis_leafstart[leaf]; i < vis_leafstart[leaf + 1]; i++) {
+				e = vis_ents[i];
+				eb->visible[e >> 5] |= 1u << (e & 31);
+			}
+		}
+	}
+
+	if (sv_activeworkers)
+		mtx_lock (&sv_joblock);
+	eb->pvshash = hash;
+	eb->visgeneration = vis_generation;
+	if (sv_activeworkers)
+		mtx_unlock (&sv_joblock);
+}
+
+/*
+=============
+SV_CollectEntities
+
+Finds the players and entities visible to the client.
+Entity numbers are not translated yet
+=============
+*/
+static void SV_CollectEntities (entbuild_t *eb)
+{
+	int		e, w;
+	unsigned	bits;
 	byte	*pvs;
 	vec3_t	org;
 	edict_t	*ent;
 	packet_entities_t	*pack;
+	client_t	*client;
 	edict_t	*clent;
 	client_frame_t	*frame;
 	entity_state_t	*state;
 
+	client = eb->client;
+
 	// this is the frame we are creating
 	frame = &client->frames[client->netchan.incoming_sequence & UPDATE_MASK];
 
+	// our pvs and visible set are about to change
+	if (sv_activeworkers)
+		mtx_lock (&sv_joblock);
+	eb->visgeneration = 0;
+	if (sv_activeworkers)
+		mtx_unlock (&sv_joblock);
+
+	pvs = eb->pvs;
 	if (sv.intermission_running && sv.intermission_origin_valid) {
-		pvs = CM_FatPVS (sv.intermission_origin);
+		CM_MakeFatPVS (sv.intermission_origin, pvs);
 	}
 	else {
 		// find the client's PVS
 		clent = client->edict;
 		VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-		pvs = CM_FatPVS (org);
+		CM_MakeFatPVS (org, pvs);
 	}
 
 	// send over the players in the PVS
-	SV_WritePlayersToClient (client, pvs, msg);
+	SV_WritePlayersToClient (client, pvs, eb->msg);
 
 	// put other visible entities into either a packet_entities or a nails message
 	pack = &frame->entities;
 	pack->num_entities = 0;
 
-	numnails = 0;
+	eb->numnails = 0;
 
-	for (e=MAX_CLIENTS+1, ent=EDICT_NUM(e) ; e < sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+	SV_FindVisibleEntities (eb);
+
+	for (w = 0; w < VIS_WORDS; w++)
 	{
-		// ignore ents without visible models
-		if (!ent->v.modelindex || !*PR_GetString(ent->v.model))
+		// entnums come out in increasing order, as when walking all edicts
+		for (e = w << 5, bits = eb->visible[w]; bits; e++, bits >>= 1)
+		{
+			if (!(bits & 1))
+				continue;
+			// ignore ents without visible models
+			if (!ed_hot.hasmodel[e])
+				continue;
+
+			ent = EDICT_NUM(e);
+			if (SV_AddNailUpdate (eb, ent, ed_hot.modelindex[e]))
+				continue;	// added to the special update list
+
+			// add to the packetentities
+			if (pack->num_entities == MAX_PACKET_ENTITIES)
+				continue;	// all full
+
+			state = &pack->entities[pack->num_entities];
+			pack->num_entities++;
+
+			state->number = e;		// translated later
+			state->flags = 0;
+			MSG_PackOrigin (ed_hot.origin[e], state->s_origin);
+			MSG_PackAngles (ent->v.angles, state->s_angles);
+			state->modelindex = ed_hot.modelindex[e];
+			state->frame = ent->v.frame;
+			state->colormap = ent->v.colormap;
+			state->skinnum = ent->v.skin;
+			state->effects = ent->v.effects;
+		}
+	}
+}
+
+/*
+=============
+SV_TranslatePack
+
+Translates the entnums of a pack that is sorted by original entnum,
+keeping it sorted.  Entities that keep their number are already in
+order, the few that get remapped are sorted on the side and merged back
+=============
+*/
+static void SV_TranslatePack (packet_entities_t *pack, int (*translate) (int num))
+{
+	entity_state_t	moved[MAX_PACKET_ENTITIES];
+	entity_state_t	*ents;
+	int		i, j, k, num, kept, nummoved;
+
+	ents = pack->entities;
+	kept = nummoved = 0;
+
+	for (i = 0; i < pack->num_entities; i++)
+	{
+		num = translate (ents[i].number);
+		if (num == ents[i].number) {
+			if (kept != i)
+				ents[kept] = ents[i];
+			kept++;
 			continue;
+		}
 
-		// ignore if not touching a PV leaf
-		for (i=0 ; i < ent->num_leafs ; i++)
-			if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
-				break;
-		
-		if (i == ent->num_leafs)
-			continue;		// not visible
-
-		if (SV_AddNailUpdate (ent))
-			continue;	// added to the special update list
-
-		// add to the packetentities
-		if (pack->num_entities == MAX_PACKET_ENTITIES)
-			continue;	// all full
-
-		state = &pack->entities[pack->num_entities];
-		pack->num_entities++;
-
-		state->number = SV_TranslateEntnum(e);
-		state->flags = 0;
-		MSG_PackOrigin (ent->v.origin, state->s_origin);
-		MSG_PackAngles (ent->v.angles, state->s_angles);
-		state->modelindex = ent->v.modelindex;
-		state->frame = ent->v.frame;
-		state->colormap = ent->v.colormap;
-		state->skinnum = ent->v.skin;
-		state->effects = ent->v.effects;
+		// insertion sort, there are rarely more than a few
+		for (j = nummoved; j > 0 && moved[j-1].number > num; j--)
+			moved[j] = moved[j-1];
+		moved[j] = ents[i];
+		moved[j].number = num;
+		nummoved++;
 	}
 
-	// entity translation might have broken original entnum order, so sort them
-	qsort (pack->entities, pack->num_entities, sizeof(pack->entities[0]), entity_state_compare);
+	if (!nummoved)
+		return;
+
+	// merge from the back so nothing is overwritten before it's moved
+	i = kept - 1;
+	j = nummoved - 1;
+	k = pack->num_entities - 1;
+	while (j >= 0)
+	{
+		if (i >= 0 && ents[i].number > moved[j].number)
+			ents[k--] = ents[i--];
+		else
+			ents[k--] = moved[j--];
+	}
+}
+
+/*
+=============
+SV_TranslateEntities
+
+The translation table is shared by all clients, so this part is never
+run in parallel.  Clients must be handled in the same order each frame
+=============
+*/
+static void SV_TranslateEntities (entbuild_t *eb)
+{
+	SV_TranslatePack (&eb->client->frames[eb->client->netchan.incoming_sequence & UPDATE_MASK].entities,
+		SV_TranslateEntnum);
+}
+
+/*
+=============
+SV_EmitEntities
 
+Writes the svc_packetentities and svc_nails messages
+=============
+*/
+static void SV_EmitEntities (entbuild_t *eb)
+{
+	client_t	*client;
+	packet_entities_t	*pack;
+
+	client = eb->client;
+	pack = &client->frames[client->netchan.incoming_sequence & UPDATE_MASK].entities;
+
+	// SV_TranslatePack left the entities sorted by translated entnum
 	if (client->delta_sequence != -1) {
 		// encode the packet entities as a delta from the
 		// last packetentities acknowledged by the client
 		MSG_EmitPacketEntities (&client->frames[client->delta_sequence & UPDATE_MASK].entities,
-			client->delta_sequence, pack, msg, SV_GetBaseline);
+			client->delta_sequence, pack, eb->msg, SV_GetBaseline);
 	}
 	else {
 		// no delta
-		MSG_EmitPacketEntities (NULL, 0, pack, msg, SV_GetBaseline);
+		MSG_EmitPacketEntities (NULL, 0, pack, eb->msg, SV_GetBaseline);
 	}
 
 	// now add the specialized nail update
-	SV_EmitNailUpdate (msg);
+	SV_EmitNailUpdate (eb, eb->msg);
+}
+
+/*
+=============
+SV_PrepareEntities
+
+Builds the entity updates for a list of clients in parallel.
+SV_WriteEntitiesToClient will then just copy them out
+=============
+*/
+void SV_PrepareEntities (client_t **clients, int count)
+{
+	entbuild_t	*eb;
+	int		i;
+
+	SV_StartWorkers ();
+	SV_UpdateEntityIndex ();
+	ED_SyncHotFields ();
+
+	for (i = 0; i < count; i++)
+	{
+		eb = &sv_entbuild[clients[i] - svs.clients];
+		eb->client = clients[i];
+		SZ_Init (&eb->buf, eb->buf_data, sizeof(eb->buf_data));
+		eb->buf.allowoverflow = true;
+		eb->msg = &eb->buf;
+		sv_jobs[i] = eb;
+	}
+
+	if (!sv_activeworkers)
+	{
+		for (i = 0; i < count; i++) {
+			SV_CollectEntities (sv_jobs[i]);
+			SV_TranslateEntities (sv_jobs[i]);
+			SV_EmitEntities (sv_jobs[i]);
+			sv_jobs[i]->prepared = true;
+		}
+		return;
+	}
+
+	SV_RunJobs (SV_CollectEntities, count);
+	for (i = 0; i < count; i++)
+		SV_TranslateEntities (sv_jobs[i]);
+	SV_RunJobs (SV_EmitEntities, count);
+
+	for (i = 0; i < count; i++)
+		sv_jobs[i]->prepared = true;
+}
+
+/*
+=============
+SV_WriteEntitiesToClient
+
+Encodes the current state of the world as
+a svc_packetentities messages and possibly
+a svc_nails message and
+svc_playerinfo messages
+=============
+*/
+void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
+{
+	entbuild_t	*eb;
+
+	eb = &sv_entbuild[client - svs.clients];
+
+	if (eb->prepared)
+	{
+		// built by SV_PrepareEntities
+		eb->prepared = false;
+		if (eb->buf.overflowed)
+			msg->overflowed = true;
+		else
+			SZ_Write (msg, eb->buf.data, eb->buf.cursize);
+		return;
+	}
+
+	SV_UpdateEntityIndex ();
+	ED_SyncHotFields ();
+
+	eb->client = client;
+	eb->msg = msg;
+	SV_CollectEntities (eb);
+	SV_TranslateEntities (eb);
+	SV_EmitEntities (eb);
+}
+
+// same as SV_TranslateEntnum, but doesn't allocate translations
+static int SV_PeekEntnum (int num)
+{
+	if (num > MAX_CLIENTS && sv.entmap[num] && sv.translations[sv.entmap[num]].original == num)
+		return sv.entmap[num];
+	return num;
+}
+
+/*
+=============
+SV_BenchEntSort_f
+
+Times sorting of translated packet entities with qsort against
+SV_TranslatePack, on the entities of the current map
+=============
+*/
+
+void SV_BenchEntSort_f (void)
+{
+	packet_entities_t	in, out, ref;
+	edict_t	*ent;
+	double	start, qsort_time, pack_time;
+	int		e, i, n, count;
+
+	if (sv.state != ss_active) {
+		Com_Printf ("no map running\n");
+		return;
+	}
+
+	count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100000;
+	if (count < 1)
+		count = 1;
+
+	// the first MAX_PACKET_ENTITIES visible ents, as SV_CollectEntities would find them
+	in.num_entities = 0;
+	for (e=MAX_CLIENTS+1, ent=EDICT_NUM(e) ; e < sv.num_edicts && in.num_entities < MAX_PACKET_ENTITIES ;
+			e++, ent = NEXT_EDICT(ent))
+	{
+		if (!ent->v.modelindex || !ent->num_leafs)
+			continue;
+		memset (&in.entities[in.num_entities], 0, sizeof(in.entities[0]));
+		in.entities[in.num_entities++].number = e;
+	}
+
+	start = Sys_DoubleTime ();
+	for (n = 0; n < count; n++) {
+		ref = in;
+		for (i = 0; i < ref.num_entities; i++)
+			ref.entities[i].number = SV_PeekEntnum (ref.entities[i].number);
+		qsort (ref.entities, ref.num_entities, sizeof(ref.entities[0]), entity_state_compare);
+	}
+	qsort_time = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (n = 0; n < count; n++) {
+		out = in;
+		SV_TranslatePack (&out, SV_PeekEntnum);
+	}
+	pack_time = Sys_DoubleTime () - start;
+
+	for (i = 0; i < out.num_entities; i++)
+		if (out.entities[i].number != ref.entities[i].number)
+			break;
+
+	Com_Printf ("%i entities, %i runs\n", in.num_entities, count);
+	Com_Printf ("qsort:     %6.3f usec\n", qsort_time * 1000000 / count);
+	Com_Printf ("translate: %6.3f usec\n", pack_time * 1000000 / count);
+	if (i != out.num_entities)
+		Com_Printf ("order differs at %i!\n", i);
+}
+
+/*
+=============
+SV_BenchHotFields_f
+
+Times the per-entity test and origin packing of SV_CollectEntities over
+all edicts of the current map, reading the edicts and reading ed_hot,
+and the cost of a full ED_SyncHotFields
+=============
+*/
+void SV_BenchHotFields_f (void)
+{
+	edict_t	*ent;
+	double	start, edict_time, hot_time, sync_time;
+	short	s_origin[3];
+	int		e, n, count, sent, hotsent;
+
+	if (sv.state != ss_active) {
+		Com_Printf ("no map running\n");
+		return;
+	}
+
+	count = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 10000;
+	if (count < 1)
+		count = 1;
+
+	start = Sys_DoubleTime ();
+	for (n = 0; n < count; n++) {
+		ed_hotstale = true;
+		ED_SyncHotFields ();
+	}
+	sync_time = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (n = 0; n < count; n++) {
+		sent = 0;
+		for (e = MAX_CLIENTS+1, ent = EDICT_NUM(e); e < sv.num_edicts; e++, ent = NEXT_EDICT(ent)) {
+			if (!ent->inuse || !ent->v.modelindex || !*PR_GetString(ent->v.model))
+				continue;
+			MSG_PackOrigin (ent->v.origin, s_origin);
+			sent += s_origin[0] + (ent->v.modelindex == sv_nailmodel);
+		}
+	}
+	edict_time = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (n = 0; n < count; n++) {
+		hotsent = 0;
+		for (e = MAX_CLIENTS+1; e < sv.num_edicts; e++) {
+			if (!ed_hot.hasmodel[e])
+				continue;
+			MSG_PackOrigin (ed_hot.origin[e], s_origin);
+			hotsent += s_origin[0] + (ed_hot.modelindex[e] == sv_nailmodel);
+		}
+	}
+	hot_time = Sys_DoubleTime () - start;
+
+	Com_Printf ("%i edicts, %i bytes each, %i runs\n", sv.num_edicts, pr_edict_size, count);
+	Com_Printf ("edicts: %7.3f usec\n", edict_time * 1000000 / count);
+	Com_Printf ("ed_hot: %7.3f usec\n", hot_time * 1000000 / count);
+	Com_Printf ("sync:   %7.3f usec\n", sync_time * 1000000 / count);
+	if (sent != hotsent)
+		Com_Printf ("ed_hot differs from the edicts!\n");
 }
 
 /* vi: set noet ts=4 sts=4 ai sw=4: */
@@ -93,20 +93,22 @@ void SV_CreateBaseline (void)
 	// FIXME, translate baselines nums as well as packet entity nums?
 	max_edicts = min (sv.num_edicts, 512);
 
+	ED_SyncHotFields ();
+
 	for (entnum = 0; entnum < max_edicts ; entnum++)
 	{
-		svent = EDICT_NUM(entnum);
-		if (!svent->inuse)
-			continue;
 		// create baselines for all player slots,
 		// and any other edict that has a visible model
-		if (entnum > MAX_CLIENTS && !svent->v.modelindex)
+		if (entnum > MAX_CLIENTS && !ed_hot.modelindex[entnum])
+			continue;
+		svent = EDICT_NUM(entnum);
+		if (!svent->inuse)
 			continue;
 
 	//
 	// create entity baseline
 	//
-		MSG_PackOrigin (svent->v.origin, svent->baseline.s_origin);
+		MSG_PackOrigin (ed_hot.origin[entnum], svent->baseline.s_origin);
 		MSG_PackAngles (svent->v.angles, svent->baseline.s_angles);
 		svent->baseline.frame = svent->v.frame;
 		svent->baseline.skinnum = svent->v.skin;
@@ -173,6 +175,7 @@ void SV_SaveSpawnparms (void)
 
 		if (sv_client->bot) {
 			// bots are kicked on map change
+			SV_ClearDatagram (sv_client);
 			sv_client->state = cs_free;
 			sv_client->bot = false;
 			sv_client->name[0] = 0;
@@ -228,6 +231,7 @@ void SV_SpawnServer (char *mapname, qbool devmap)
 	Com_DPrintf ("SpawnServer: %s\n", mapname);
 
 	SV_SaveSpawnparms ();
+	PR_ProfileMapSummary ();
 	PR_FreeStrings ();
 
 	svs.spawncount++;		// any partially connected client will be
@@ -285,6 +289,7 @@ void SV_SpawnServer (char *mapname, qbool devmap)
 		svs.clients[i].edict = ent;
 		svs.clients[i].old_frags = 0;
 	}
+	ED_RebuildFreeList ();	// nothing is free yet
 
 	sv.time = 1.0;
 
@@ -323,6 +328,7 @@ void SV_SpawnServer (char *mapname, qbool devmap)
 	ent = EDICT_NUM(0);
 	ent->inuse = true;
 	ent->v.model = PR_SetString(sv.modelname);
+	ED_EdictChanged (ent);
 	ent->v.modelindex = 1;		// world model
 	ent->v.solid = SOLID_BSP;
 	ent->v.movetype = MOVETYPE_PUSH;
@@ -19,6 +19,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "server.h"
+#include "sv_world.h"
 #include "version.h"
 
 client_t	*sv_client;					// current client
@@ -137,6 +138,108 @@ void SV_FinalMessage (char *message)
 }
 
 
+/*
+=============================================================================
+
+CLIENT ADDRESS HASH
+
+Finds the client a packet belongs to by base address and qport.  The
+chains live outside client_t so that clearing a slot can't break them.
+Entries are checked against the client when looked up, so a slot only
+has to be rehashed when a connection is set up in it; zombies stay
+findable until the slot is reused, as they always were.
+
+=============================================================================
+*/
+
+#define	CLIENT_HASH_SIZE	64		// power of two, keep it >= MAX_CLIENTS
+
+static int	sv_clienthash[CLIENT_HASH_SIZE];		// client number + 1, 0 ends a chain
+static int	sv_clienthash_next[MAX_CLIENTS];		// same
+static int	sv_clienthash_bucket[MAX_CLIENTS];		// bucket + 1, 0 if not hashed
+
+static int SV_ClientHashKey (netadr_t adr, int qport)
+{
+	unsigned int	v;
+
+	v = qport;
+	if (adr.type != NA_LOOPBACK)	// NET_CompareBaseAdr ignores loopback ip
+		v ^= (adr.ip[0] << 24) | (adr.ip[1] << 16) | (adr.ip[2] << 8) | adr.ip[3];
+	v ^= v >> 16;
+	v ^= v >> 7;
+
+	return v & (CLIENT_HASH_SIZE - 1);
+}
+
+static void SV_UnhashClient (client_t *cl)
+{
+	int		num, *link;
+
+	num = cl - svs.clients;
+	if (!sv_clienthash_bucket[num])
+		return;
+
+	for (link = &sv_clienthash[sv_clienthash_bucket[num] - 1] ; *link ; link = &sv_clienthash_next[*link - 1])
+		if (*link - 1 == num)
+		{
+			*link = sv_clienthash_next[num];
+			break;
+		}
+
+	sv_clienthash_next[num] = 0;
+	sv_clienthash_bucket[num] = 0;
+}
+
+static void SV_HashClient (client_t *cl)
+{
+	int		num, key;
+
+	SV_UnhashClient (cl);
+
+	num = cl - svs.clients;
+	key = SV_ClientHashKey (cl->netchan.remote_address, cl->netchan.qport);
+	sv_clienthash_next[num] = sv_clienthash[key];
+	sv_clienthash[key] = num + 1;
+	sv_clienthash_bucket[num] = key + 1;
+}
+
+static void SV_ClearClientHash (void)
+{
+	memset (sv_clienthash, 0, sizeof(sv_clienthash));
+	memset (sv_clienthash_next, 0, sizeof(sv_clienthash_next));
+	memset (sv_clienthash_bucket, 0, sizeof(sv_clienthash_bucket));
+}
+
+/*
+=================
+SV_ClientForAddress
+
+Returns the lowest numbered client matching adr and qport, like a
+walk over svs.clients would, or NULL
+=================
+*/
+static client_t *SV_ClientForAddress (netadr_t adr, int qport)
+{
+	int			num;
+	client_t	*cl, *best;
+
+	best = NULL;
+	for (num = sv_clienthash[SV_ClientHashKey (adr, qport)] ; num ; num = sv_clienthash_next[num - 1])
+	{
+		cl = &svs.clients[num - 1];
+		if (cl->state == cs_free)
+			continue;
+		if (cl->netchan.qport != qport)
+			continue;
+		if (!NET_CompareBaseAdr (adr, cl->netchan.remote_address))
+			continue;
+		if (!best || cl < best)
+			best = cl;
+	}
+
+	return best;
+}
+
 /*
 ================
 SV_Shutdown
@@ -165,10 +268,13 @@ void SV_Shutdown (char *finalmsg)
 	sv.state = ss_dead;
 	com_serveractive = false;
 
-	for (i = 0; i < MAX_CLIENTS; i++)	
+	for (i = 0; i < MAX_CLIENTS; i++) {
 		SV_FreeDelayedPackets(&svs.clients[i]);
+		SV_ClearDatagram (&svs.clients[i]);		// release shared fragments
+	}
 
 	memset (svs.clients, 0, sizeof(svs.clients));
+	SV_ClearClientHash ();
 	svs.lastuserid = 0;
 }
 
@@ -237,6 +343,8 @@ void SV_DropClient (client_t *drop)
 	}
 	*drop->uploadfn = 0;
 
+	SV_ClearDatagram (drop);		// release shared fragments
+
 	drop->state = cs_zombie;		// become free in a few seconds
 	drop->connection_started = svs.realtime;	// for zombie timeout
 
@@ -740,6 +848,7 @@ void SVC_DirectConnect (void)
 	Netchan_OutOfBandPrint (NS_SERVER, adr, "%c", S2C_CONNECTION );
 
 	Netchan_Setup (NS_SERVER, &newcl->netchan, adr, qport);
+	SV_HashClient (newcl);
 
 	newcl->state = cs_connected;
 
@@ -1227,26 +1336,16 @@ void SV_ReadPackets (void)
 		qport = MSG_ReadShort () & 0xffff;
 
 		// check which client sent this packet
-		for (i=0, cl=svs.clients ; i<MAX_CLIENTS ; i++,cl++)
-		{
-			if (cl->state == cs_free)
-				continue;
-			if (!NET_CompareBaseAdr (net_from, cl->netchan.remote_address))
-				continue;
-			if (cl->netchan.qport != qport)
-				continue;
-			if (cl->netchan.remote_address.port != net_from.port)
-			{
-				Com_DPrintf ("SV_ReadPackets: fixing up a translated port\n");
-				cl->netchan.remote_address.port = net_from.port;
-			}
+		cl = SV_ClientForAddress (net_from, qport);
+		if (!cl)
+			continue;
 
-			break;
+		if (cl->netchan.remote_address.port != net_from.port)
+		{
+			Com_DPrintf ("SV_ReadPackets: fixing up a translated port\n");
+			cl->netchan.remote_address.port = net_from.port;
 		}
 
-		if (i == MAX_CLIENTS)
-			continue;
-
 		// ok, we know who sent this packet, but do we need to delay executing it?
 		if (cl->delay > 0) {
 			if (!svs.free_packets) // packet has to be dropped..
@@ -1479,9 +1578,15 @@ void SV_Frame (double time)
 		svs.stats.latched_active = svs.stats.active;
 		svs.stats.latched_idle = svs.stats.idle;
 		svs.stats.latched_packets = svs.stats.packets;
+		svs.stats.latched_multicasts = svs.stats.multicasts;
+		svs.stats.latched_multicast_clients = svs.stats.multicast_clients;
+		svs.stats.latched_net = net_stats[NS_SERVER];
+		memset (&net_stats[NS_SERVER], 0, sizeof(net_stats[NS_SERVER]));
 		svs.stats.active = 0;
 		svs.stats.idle = 0;
 		svs.stats.packets = 0;
+		svs.stats.multicasts = 0;
+		svs.stats.multicast_clients = 0;
 		svs.stats.count = 0;
 	}
 }
@@ -1528,6 +1633,10 @@ void SV_InitLocal (void)
 	Cvar_Register (&sv_pausable);
 	Cmd_AddLegacyCommand ("pausable", "sv_pausable");
 	Cvar_Register (&sv_nailhack);
+	Cvar_Register (&sv_threads);
+	Cvar_Register (&sv_areagrid);
+	Cvar_Register (&sv_tracecache);
+	Cvar_Register (&sv_triggerleafs);
 	Cvar_Register (&sv_maxrate);
 	Cvar_Register (&sv_fastconnect);
 	Cvar_Register (&sv_loadentfiles);
@@ -1589,6 +1698,13 @@ void SV_InitLocal (void)
 	Cmd_AddCommand ("listip", SV_ListIP_f);
 	Cmd_AddCommand ("writeip", SV_WriteIP_f);
 
+	Cmd_AddCommand ("bench_entsort", SV_BenchEntSort_f);
+	Cmd_AddCommand ("bench_hotfields", SV_BenchHotFields_f);
+	Cmd_AddCommand ("bench_area", SV_BenchArea_f);
+	Cmd_AddCommand ("bench_touch", SV_BenchTouch_f);
+	Cmd_AddCommand ("bench_findradius", SV_BenchFindRadius_f);
+	Cmd_AddCommand ("trace_stats", SV_TraceStats_f);
+
 	for (i=1 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
 
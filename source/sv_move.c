@@ -37,8 +37,9 @@ is not a staircase.
 qbool SV_CheckBottom (edict_t *ent)
 {
 	vec3_t	mins, maxs, start, stop;
-	trace_t	trace;
-	int		x, y;
+	vec3_t	starts[4], stops[4];
+	trace_t	trace, corners[4];
+	int		i, x, y;
 	float	mid, bottom;
 
 	VectorAdd (ent->v.origin, ent->v.mins, mins);
@@ -79,17 +80,23 @@ realcheck:
 	for	(x=0 ; x<=1 ; x++)
 		for	(y=0 ; y<=1 ; y++)
 		{
-			start[0] = stop[0] = x ? maxs[0] : mins[0];
-			start[1] = stop[1] = y ? maxs[1] : mins[1];
-		
-			trace = SV_Trace (start, vec3_origin, vec3_origin, stop, true, ent);
-		
-			if (trace.fraction != 1.0 && trace.endpos[2] > bottom)
-				bottom = trace.endpos[2];
-			if (trace.fraction == 1.0 || mid - trace.endpos[2] > STEPSIZE)
-				return false;
+			i = x*2 + y;
+			starts[i][0] = stops[i][0] = x ? maxs[0] : mins[0];
+			starts[i][1] = stops[i][1] = y ? maxs[1] : mins[1];
+			starts[i][2] = start[2];
+			stops[i][2] = stop[2];
 		}
 
+	SV_TraceBatch (4, starts, vec3_origin, vec3_origin, stops, true, ent, corners);
+
+	for (i=0 ; i<4 ; i++)
+	{
+		if (corners[i].fraction != 1.0 && corners[i].endpos[2] > bottom)
+			bottom = corners[i].endpos[2];
+		if (corners[i].fraction == 1.0 || mid - corners[i].endpos[2] > STEPSIZE)
+			return false;
+	}
+
 	return true;
 }
 
@@ -87,6 +87,8 @@ void SV_CheckVelocity (edict_t *ent)
 		{
 			Com_DPrintf ("Got a NaN origin on %s\n", PR_GetString(ent->v.classname));
 			ent->v.origin[i] = 0;
+			ED_UpdateHotFields (ent);
+			SV_TraceFieldChanged (ent);
 		}
 /*		if (ent->v.velocity[i] > sv_maxvelocity.value)
 			ent->v.velocity[i] = sv_maxvelocity.value;
@@ -446,8 +448,10 @@ qbool SV_Push (edict_t *pusher, vec3_t move)
 
 		solid_save = pusher->v.solid;
 		pusher->v.solid = SOLID_NOT;
+		SV_TraceFieldChanged (pusher);
 		block = SV_TestEntityPosition (check);
 		pusher->v.solid = solid_save;
+		SV_TraceFieldChanged (pusher);
 		if (block)
 			continue;
 
@@ -914,6 +918,8 @@ void SV_Physics (void)
 
 	pr_global_struct->frametime = sv_frametime;
 
+	SV_ClearTraceCache ();
+
 	SV_ProgStartFrame ();
 
 //
@@ -280,6 +280,7 @@ void SV_LoadGame_f (void)
 
 	sv.num_edicts = entnum;
 	sv.time = time;
+	ED_RebuildFreeList ();
 
 	fclose (f);
 
@@ -206,6 +206,179 @@ void SV_BroadcastCommand (char *fmt, ...)
 }
 
 
+/*
+=============================================================================
+
+SHARED DATAGRAM FRAGMENTS
+
+Unreliable data that goes to many clients is stored once in a reference
+counted block.  Client datagrams only remember where each fragment
+belongs, and the fragments are spliced in when the datagram is sent.
+
+=============================================================================
+*/
+
+#define	DGBLOCK_SIZE	(MAX_MSGLEN*8)
+
+typedef struct dgblock_s
+{
+	struct dgblock_s	*next;		// on the free list
+	int		refcount;				// fragments still pointing here
+	int		used;
+	byte	data[DGBLOCK_SIZE];
+} dgblock_t;
+
+static dgblock_t	*dg_current;	// new fragments are stored here
+static dgblock_t	*dg_free;
+
+static void SV_ReleaseBlock (dgblock_t *block)
+{
+	if (--block->refcount > 0)
+		return;
+
+	if (block == dg_current)
+		block->used = 0;		// start over
+	else {
+		block->next = dg_free;
+		dg_free = block;
+	}
+}
+
+/*
+=================
+SV_StoreFragment
+
+Copies data into the shared pool.  The caller holds a reference to the
+block until it has added the fragment to all its clients, so a client
+overflowing and releasing its fragments can't let the block start over
+under the others.  Release it with SV_ReleaseBlock
+=================
+*/
+static dgblock_t *SV_StoreFragment (byte *data, int length, int *offset)
+{
+	dgblock_t	*block;
+
+	block = dg_current;
+	if (!block || block->used + length > DGBLOCK_SIZE)
+	{
+		if (block && !block->refcount) {
+			block->next = dg_free;
+			dg_free = block;
+		}
+
+		if (dg_free) {
+			block = dg_free;
+			dg_free = block->next;
+		}
+		else
+			block = Q_malloc (sizeof(*block));
+
+		block->next = NULL;
+		block->refcount = 0;
+		block->used = 0;
+		dg_current = block;
+	}
+
+	*offset = block->used;
+	memcpy (block->data + block->used, data, length);
+	block->used += length;
+	block->refcount++;
+	return block;
+}
+
+/*
+=================
+SV_AddFragment
+
+Appends a stored fragment to a client's datagram
+=================
+*/
+static void SV_AddFragment (client_t *cl, dgblock_t *block, int offset, int length)
+{
+	dgfragment_t	*frag;
+
+	if (cl->datagram.overflowed)
+		return;		// will be thrown away anyway
+
+	if (cl->datagram.cursize + cl->fragment_size + length > cl->datagram.maxsize)
+	{
+		// same as what SZ_GetSpace does for the datagram itself
+		Sys_Printf ("SV_AddFragment: overflow\n");
+		SV_ClearDatagram (cl);
+		cl->datagram.overflowed = true;
+		return;
+	}
+
+	if (cl->num_fragments == MAX_DATAGRAM_FRAGMENTS) {
+		SZ_Write (&cl->datagram, block->data + offset, length);
+		return;
+	}
+
+	frag = &cl->fragments[cl->num_fragments++];
+	frag->block = block;
+	frag->offset = offset;
+	frag->length = length;
+	frag->position = cl->datagram.cursize;
+	cl->fragment_size += length;
+	block->refcount++;
+}
+
+/*
+=================
+SV_ClearDatagram
+
+Use instead of SZ_Clear on client datagrams so the fragments are released
+=================
+*/
+void SV_ClearDatagram (client_t *cl)
+{
+	int		i;
+
+	for (i = 0; i < cl->num_fragments; i++)
+		SV_ReleaseBlock (cl->fragments[i].block);
+	cl->num_fragments = 0;
+	cl->fragment_size = 0;
+
+	SZ_Clear (&cl->datagram);
+}
+
+/*
+=================
+SV_WriteDatagram
+
+Writes the client's datagram to msg with the fragments spliced in
+=================
+*/
+static void SV_WriteDatagram (client_t *cl, sizebuf_t *msg)
+{
+	dgfragment_t	*frag;
+	int		i, pos;
+
+	pos = 0;
+	for (i = 0, frag = cl->fragments; i < cl->num_fragments; i++, frag++)
+	{
+		SZ_Write (msg, cl->datagram.data + pos, frag->position - pos);
+		SZ_Write (msg, frag->block->data + frag->offset, frag->length);
+		pos = frag->position;
+	}
+	SZ_Write (msg, cl->datagram.data + pos, cl->datagram.cursize - pos);
+}
+
+
+/*
+** view leafs of the clients, as last seen by SV_Multicast
+** a client's leaf is only looked up again once its view origin moved,
+** which normally happens at most once per frame
+*/
+typedef struct
+{
+	int		spawncount;		// svs.spawncount the leaf belongs to
+	vec3_t	vieworg;
+	int		leafnum;		// pvs/phs row + 1, 0 if outside the world
+} mcview_t;
+
+static mcview_t	sv_mcviews[MAX_CLIENTS];
+
 /*
 =================
 SV_Multicast
@@ -221,13 +394,19 @@ MULTICAST_PHS	send to clients potentially hearable from org
 void SV_Multicast (vec3_t origin, int to)
 {
 	client_t	*client;
+	mcview_t	*view;
 	byte		*mask;
 	int			leafnum;
 	int			j;
 	qbool		reliable;
-	vec3_t		vieworg;
+	vec3_t		vieworg, delta;
+	dgblock_t	*block;
+	int			offset;
 
 	reliable = false;
+	block = NULL;
+	offset = 0;
+	svs.stats.multicasts++;
 
 	switch (to)
 	{
@@ -260,19 +439,28 @@ void SV_Multicast (vec3_t origin, int to)
 		if (client->state != cs_spawned)
 			continue;
 
+		svs.stats.multicast_clients++;
+
 		if (!mask)
 			goto inrange;	// multicast to all
 
 		VectorAdd (client->edict->v.origin, client->edict->v.view_ofs, vieworg);
 
 		if (to == MULTICAST_PHS_R || to == MULTICAST_PHS) {
-			vec3_t delta;
 			VectorSubtract(origin, vieworg, delta);
-			if (VectorLength(delta) <= 1024)
+			if (DotProduct(delta, delta) <= 1024*1024)
 				goto inrange;
 		}
 
-		leafnum = CM_Leafnum(CM_PointInLeaf(vieworg));
+		view = &sv_mcviews[j];
+		if (view->spawncount != svs.spawncount || !VectorCompare (vieworg, view->vieworg))
+		{
+			view->spawncount = svs.spawncount;
+			VectorCopy (vieworg, view->vieworg);
+			view->leafnum = CM_Leafnum(CM_PointInLeaf(vieworg));
+		}
+
+		leafnum = view->leafnum;
 		if (leafnum)
 		{
 			// -1 is because pvs rows are 1 based, not 0 based like leafs
@@ -287,10 +475,16 @@ void SV_Multicast (vec3_t origin, int to)
 inrange:
 		if (reliable) {
 			SV_AddToReliable (client, sv.multicast.data, sv.multicast.cursize);
-		} else
-			SZ_Write (&client->datagram, sv.multicast.data, sv.multicast.cursize);
+		} else {
+			if (!block)
+				block = SV_StoreFragment (sv.multicast.data, sv.multicast.cursize, &offset);
+			SV_AddFragment (client, block, offset, sv.multicast.cursize);
+		}
 	}
 
+	if (block)
+		SV_ReleaseBlock (block);
+
 	SZ_Clear (&sv.multicast);
 }
 
@@ -662,11 +856,12 @@ qbool SV_SendClientDatagram (client_t *client)
 
 	// copy the accumulated multicast datagram
 	// for this client out to the message
-	if (client->datagram.overflowed)
+	if (client->datagram.overflowed
+		|| client->datagram.cursize + client->fragment_size > client->datagram.maxsize)
 		Com_Printf ("WARNING: datagram overflowed for %s\n", client->name);
 	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
-	SZ_Clear (&client->datagram);
+		SV_WriteDatagram (client, &msg);
+	SV_ClearDatagram (client);
 
 	// send deltas over reliable stream
 	if (Netchan_CanReliable (&client->netchan))
@@ -694,6 +889,8 @@ void SV_UpdateToReliableMessages (void)
 	int			i, j;
 	client_t *client;
 	edict_t *ent;
+	dgblock_t	*block;
+	int			offset;
 
 // check for changes to be sent over the reliable streams to all clients
 	for (i=0, sv_client = svs.clients ; i<MAX_CLIENTS ; i++, sv_client++)
@@ -743,6 +940,8 @@ void SV_UpdateToReliableMessages (void)
 		SZ_Clear (&sv.datagram);
 
 	// append the broadcast messages to each client messages
+	block = NULL;
+	offset = 0;
 	for (j=0, client = svs.clients ; j<MAX_CLIENTS ; j++, client++)
 	{
 		if (client->state < cs_connected)
@@ -750,13 +949,16 @@ void SV_UpdateToReliableMessages (void)
 
 		SV_AddToReliable (client, sv.reliable_datagram.data, sv.reliable_datagram.cursize);
 
-		if (client->state != cs_spawned)
+		if (client->state != cs_spawned || !sv.datagram.cursize)
 			continue;	// datagrams only go to spawned
-		SZ_Write (&client->datagram
-			, sv.datagram.data
-			, sv.datagram.cursize);
+		if (!block)
+			block = SV_StoreFragment (sv.datagram.data, sv.datagram.cursize, &offset);
+		SV_AddFragment (client, block, offset, sv.datagram.cursize);
 	}
 
+	if (block)
+		SV_ReleaseBlock (block);
+
 	SZ_Clear (&sv.reliable_datagram);
 	SZ_Clear (&sv.datagram);
 }
@@ -776,10 +978,17 @@ void SV_SendClientMessages (void)
 {
 	int			i;
 	client_t	*c;
+	client_t	*ready[MAX_CLIENTS];
+	int			numready;
 
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+	numready = 0;
+
+// collect the datagrams so they can go out together
+	NET_BeginBatch (NS_SERVER);
+
 // build individual updates
 	for (i=0, c = svs.clients ; i<MAX_CLIENTS ; i++, c++)
 	{
@@ -801,7 +1010,7 @@ void SV_SendClientMessages (void)
 		if (c->netchan.message.overflowed)
 		{
 			SZ_Clear (&c->netchan.message);
-			SZ_Clear (&c->datagram);
+			SV_ClearDatagram (c);
 			SV_BroadcastPrintf (PRINT_HIGH, "%s overflowed\n", c->name);
 			Com_Printf ("WARNING: reliable overflow for %s\n",c->name);
 			SV_DropClient (c);
@@ -820,11 +1029,24 @@ void SV_SendClientMessages (void)
 			continue;		// bandwidth choke
 		}
 
-		if (c->state == cs_spawned)
-			SV_SendClientDatagram (c);
+		if (c->state == cs_spawned) {
+			if (sv_threads.value > 1)
+				ready[numready++] = c;	// sent below
+			else
+				SV_SendClientDatagram (c);
+		}
 		else
 			Netchan_Transmit (&c->netchan, 0, NULL);	// just update reliable
 	}
+
+// build the entity updates of all the clients at once, then send them out
+	if (numready) {
+		SV_PrepareEntities (ready, numready);
+		for (i = 0; i < numready; i++)
+			SV_SendClientDatagram (ready[i]);
+	}
+
+	NET_FlushBatch (NS_SERVER);
 }
 
 #ifdef _WIN32
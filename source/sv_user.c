@@ -473,6 +473,7 @@ static void Cmd_Spawn_f (void)
 		ent->v.colormap = NUM_FOR_EDICT(ent);
 		ent->v.team = 0;	// FIXME
 		ent->v.netname = PR_SetString(sv_client->name);
+		ED_EdictChanged (ent);
 	}
 
 	sv_client->entgravity = 1.0;
@@ -1321,6 +1322,7 @@ void SetUpClientEdict (client_t *cl, edict_t *ent)
 	memset (&ent->v, 0, progs->entityfields * 4);
 	ent->v.colormap = NUM_FOR_EDICT(ent);
 	ent->v.netname = PR_SetString(cl->name);
+	ED_EdictChanged (ent);
 
 	cl->entgravity = 1.0;
 	if (fofs_gravity)
@@ -1590,6 +1592,7 @@ static void Cmd_Noclip_f (void)
 			sv_player->v.solid = SOLID_NOT;
 		SV_ClientPrintf (sv_client, PRINT_HIGH, "noclip OFF\n");
 	}
+	SV_TraceFieldChanged (sv_player);
 }
 
 
@@ -1728,6 +1731,58 @@ USER CMD EXECUTION
 ===========================================================================
 */
 
+/*
+====================
+AddEntToPmove
+
+Returns false once the physents are full
+====================
+*/
+static qbool AddEntToPmove (edict_t *check, int pl, vec3_t pmove_mins, vec3_t pmove_maxs)
+{
+	int			i;
+	physent_t	*pe;
+
+	if (check->v.owner == pl)
+		return true;		// player's own missile
+	if (check->v.solid == SOLID_BSP
+		|| check->v.solid == SOLID_BBOX
+		|| check->v.solid == SOLID_SLIDEBOX)
+	{
+		if (check == sv_player)
+			return true;
+
+		for (i=0 ; i<3 ; i++)
+			if (check->v.absmin[i] > pmove_maxs[i]
+			|| check->v.absmax[i] < pmove_mins[i])
+				break;
+		if (i != 3)
+			return true;
+		if (pmove.numphysent == MAX_PHYSENTS)
+			return false;
+		pe = &pmove.physents[pmove.numphysent];
+		pmove.numphysent++;
+
+		VectorCopy (check->v.origin, pe->origin);
+		pe->info = NUM_FOR_EDICT(check);
+		if (check->v.solid == SOLID_BSP) {
+			if ((unsigned)check->v.modelindex >= MAX_MODELS)
+				Host_Error ("AddLinksToPmove: check->v.modelindex >= MAX_MODELS");
+			pe->model = sv.models[(int)(check->v.modelindex)];
+			if (!pe->model)
+				Host_Error ("SOLID_BSP with a non-bsp model");
+		}
+		else
+		{
+			pe->model = NULL;
+			VectorCopy (check->v.mins, pe->mins);
+			VectorCopy (check->v.maxs, pe->maxs);
+		}
+	}
+
+	return true;
+}
+
 /*
 ====================
 AddLinksToPmove
@@ -1736,11 +1791,9 @@ AddLinksToPmove
 */
 static void AddLinksToPmove ( areanode_t *node )
 {
-	link_t		*l, *next;
-	edict_t		*check;
+	static edict_t	*touchlist[MAX_EDICTS];	// done with before recursing
 	int			pl;
-	int			i;
-	physent_t	*pe;
+	int			i, numtouch;
 	vec3_t		pmove_mins, pmove_maxs;
 
 	for (i=0 ; i<3 ; i++)
@@ -1752,48 +1805,10 @@ static void AddLinksToPmove ( areanode_t *node )
 	pl = EDICT_TO_PROG(sv_player);
 
 	// touch linked edicts
-	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
-	{
-		next = l->next;
-		check = EDICT_FROM_AREA(l);
-
-		if (check->v.owner == pl)
-			continue;		// player's own missile
-		if (check->v.solid == SOLID_BSP
-			|| check->v.solid == SOLID_BBOX
-			|| check->v.solid == SOLID_SLIDEBOX)
-		{
-			if (check == sv_player)
-				continue;
-
-			for (i=0 ; i<3 ; i++)
-				if (check->v.absmin[i] > pmove_maxs[i]
-				|| check->v.absmax[i] < pmove_mins[i])
-					break;
-			if (i != 3)
-				continue;
-			if (pmove.numphysent == MAX_PHYSENTS)
-				return;
-			pe = &pmove.physents[pmove.numphysent];
-			pmove.numphysent++;
-
-			VectorCopy (check->v.origin, pe->origin);
-			pe->info = NUM_FOR_EDICT(check);
-			if (check->v.solid == SOLID_BSP) {
-				if ((unsigned)check->v.modelindex >= MAX_MODELS)
-					Host_Error ("AddLinksToPmove: check->v.modelindex >= MAX_MODELS");
-				pe->model = sv.models[(int)(check->v.modelindex)];
-				if (!pe->model)
-					Host_Error ("SOLID_BSP with a non-bsp model");
-			}
-			else
-			{
-				pe->model = NULL;
-				VectorCopy (check->v.mins, pe->mins);
-				VectorCopy (check->v.maxs, pe->maxs);
-			}
-		}
-	}
+	numtouch = SV_AreaBoundsEdicts (&node->solid_bounds, pmove_mins, pmove_maxs, touchlist, 0, MAX_EDICTS);
+	for (i = 0; i < numtouch; i++)
+		if (!AddEntToPmove (touchlist[i], pl, pmove_mins, pmove_maxs))
+			return;
 
 // recurse down both sides
 	if (node->axis == -1)
@@ -1805,6 +1820,33 @@ static void AddLinksToPmove ( areanode_t *node )
 		AddLinksToPmove ( node->children[1] );
 }
 
+/*
+====================
+AddAreaToPmove
+
+AddLinksToPmove for when the entities are linked into the area grid
+====================
+*/
+static void AddAreaToPmove (void)
+{
+	edict_t		*touchlist[MAX_EDICTS];
+	int			i, numtouch, pl;
+	vec3_t		pmove_mins, pmove_maxs;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		pmove_mins[i] = pmove.origin[i] - 256;
+		pmove_maxs[i] = pmove.origin[i] + 256;
+	}
+
+	pl = EDICT_TO_PROG(sv_player);
+
+	numtouch = SV_AreaEdicts (pmove_mins, pmove_maxs, touchlist, MAX_EDICTS, AREA_SOLID);
+	for (i = 0; i < numtouch; i++)
+		if (!AddEntToPmove (touchlist[i], pl, pmove_mins, pmove_maxs))
+			return;
+}
+
 
 /* is this still used for something ???? */
 #if 0
@@ -2028,7 +2070,10 @@ void SV_RunCmd (usercmd_t *ucmd)
 	// build physent list
 	pmove.numphysent = 1;
 	pmove.physents[0].model = sv.worldmodel;
-	AddLinksToPmove ( sv_areanodes );
+	if (SV_UseAreaGrid ())
+		AddAreaToPmove ();
+	else
+		AddLinksToPmove ( sv_areanodes );
 
 	// fill in movevars
 	movevars.entgravity = sv_client->entgravity;
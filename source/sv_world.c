@@ -21,6 +21,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "server.h"
 #include "sv_world.h"
+#include <float.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AREA_SSE
+#include <xmmintrin.h>
+#endif
 
 /*
 
@@ -42,6 +48,10 @@ typedef struct
 	edict_t		*passedict;
 } moveclip_t;
 
+// trace cache, see below
+static int	tc_numused;
+static void SV_InvalidateTraces (edict_t *ent);
+
 
 /*
 ================
@@ -134,6 +144,242 @@ void InsertLinkAfter (link_t *l, link_t *after)
 	l->next->prev = l;
 }
 
+/*
+===============================================================================
+
+AREA BOUNDS
+
+Each area list keeps a copy of its entities' absmin/absmax as separate
+arrays, in the same order as the links.  SV_AreaBoundsEdicts rejects four
+boxes at a time from those and only hands out the edicts that touch.
+Unlinking leaves a dead slot that can never touch anything; dead slots
+are squeezed out once there are too many of them.
+
+===============================================================================
+*/
+
+static void SV_ClearSlots (areabounds_t *ab, int first)
+{
+	int		i, j;
+
+	for (i = first; i < ab->maxcount; i++)
+	{
+		for (j = 0; j < 3; j++) {
+			ab->absmin[j][i] = FLT_MAX;
+			ab->absmax[j][i] = -FLT_MAX;
+		}
+		ab->ents[i] = NULL;
+	}
+}
+
+static void SV_FreeBounds (areabounds_t *ab)
+{
+	Q_free (ab->absmin[0]);
+	memset (ab, 0, sizeof(*ab));
+}
+
+// moves the live slots together, keeping their order
+static void SV_CompactBounds (areabounds_t *ab)
+{
+	int		i, j, k;
+
+	for (i = j = 0; i < ab->count; i++)
+	{
+		if (!ab->ents[i])
+			continue;
+		if (i != j) {
+			for (k = 0; k < 3; k++) {
+				ab->absmin[k][j] = ab->absmin[k][i];
+				ab->absmax[k][j] = ab->absmax[k][i];
+			}
+			ab->ents[j] = ab->ents[i];
+			ab->ents[j]->areaslot = j;
+		}
+		j++;
+	}
+
+	ab->count = j;
+	ab->numdead = 0;
+	SV_ClearSlots (ab, j);
+}
+
+static void SV_GrowBounds (areabounds_t *ab)
+{
+	areabounds_t	old;
+	float	*block;
+	int		i;
+
+	old = *ab;
+
+	// keep it a multiple of 4 so whole groups can always be read
+	ab->maxcount = max (8, ab->maxcount * 2);
+	block = Q_malloc (ab->maxcount * (6 * sizeof(float) + sizeof(edict_t *)));
+	for (i = 0; i < 3; i++) {
+		ab->absmin[i] = block + i * ab->maxcount;
+		ab->absmax[i] = block + (i + 3) * ab->maxcount;
+	}
+	ab->ents = (edict_t **)(block + 6 * ab->maxcount);
+
+	for (i = 0; i < 3; i++) {
+		memcpy (ab->absmin[i], old.absmin[i], old.count * sizeof(float));
+		memcpy (ab->absmax[i], old.absmax[i], old.count * sizeof(float));
+	}
+	memcpy (ab->ents, old.ents, old.count * sizeof(edict_t *));
+	SV_ClearSlots (ab, old.count);
+
+	Q_free (old.absmin[0]);
+}
+
+static void SV_AddBounds (areabounds_t *ab, edict_t *ent)
+{
+	int		i;
+
+	if (ab->count == ab->maxcount)
+	{
+		if (ab->numdead > ab->count / 4)
+			SV_CompactBounds (ab);
+		else
+			SV_GrowBounds (ab);
+	}
+
+	for (i = 0; i < 3; i++) {
+		ab->absmin[i][ab->count] = ent->v.absmin[i];
+		ab->absmax[i][ab->count] = ent->v.absmax[i];
+	}
+	ab->ents[ab->count] = ent;
+	ent->areabounds = ab;
+	ent->areaslot = ab->count;
+	ab->count++;
+}
+
+static void SV_RemoveBounds (edict_t *ent)
+{
+	areabounds_t	*ab;
+	int		i, slot;
+
+	ab = ent->areabounds;
+	slot = ent->areaslot;
+	ent->areabounds = NULL;
+
+	for (i = 0; i < 3; i++) {
+		ab->absmin[i][slot] = FLT_MAX;
+		ab->absmax[i][slot] = -FLT_MAX;
+	}
+	ab->ents[slot] = NULL;
+	ab->numdead++;
+
+	// drop dead slots from the end right away
+	while (ab->count && !ab->ents[ab->count - 1]) {
+		ab->count--;
+		ab->numdead--;
+	}
+
+	if (ab->numdead > 16 && ab->numdead > ab->count / 2)
+		SV_CompactBounds (ab);
+}
+
+// a query box set up for SV_AreaBoxMask
+typedef struct
+{
+#ifdef AREA_SSE
+	__m128	mins[3], maxs[3];
+#else
+	float	*mins, *maxs;
+#endif
+} areabox_t;
+
+#ifdef AREA_SSE
+#define	AREA_STEP	4
+#else
+#define	AREA_STEP	1
+#endif
+
+static void SV_SetAreaBox (areabox_t *box, vec3_t mins, vec3_t maxs)
+{
+#ifdef AREA_SSE
+	int		i;
+
+	for (i = 0; i < 3; i++) {
+		box->mins[i] = _mm_set1_ps (mins[i]);
+		box->maxs[i] = _mm_set1_ps (maxs[i]);
+	}
+#else
+	box->mins = mins;
+	box->maxs = maxs;
+#endif
+}
+
+// bit n is set if slot i+n of ab touches the box, for AREA_STEP slots
+static inline int SV_AreaBoxMask (const areabox_t *box, const areabounds_t *ab, int i)
+{
+#ifdef AREA_SSE
+	__m128	out;
+
+	// same tests as the scalar version, so NaNs come out the same
+	out = _mm_or_ps (_mm_cmpgt_ps (box->mins[0], _mm_loadu_ps (ab->absmax[0] + i)),
+		_mm_cmplt_ps (box->maxs[0], _mm_loadu_ps (ab->absmin[0] + i)));
+	out = _mm_or_ps (out, _mm_cmpgt_ps (box->mins[1], _mm_loadu_ps (ab->absmax[1] + i)));
+	out = _mm_or_ps (out, _mm_cmplt_ps (box->maxs[1], _mm_loadu_ps (ab->absmin[1] + i)));
+	out = _mm_or_ps (out, _mm_cmpgt_ps (box->mins[2], _mm_loadu_ps (ab->absmax[2] + i)));
+	out = _mm_or_ps (out, _mm_cmplt_ps (box->maxs[2], _mm_loadu_ps (ab->absmin[2] + i)));
+
+	return ~_mm_movemask_ps (out) & 15;
+#else
+	return !(box->mins[0] > ab->absmax[0][i]
+		|| box->mins[1] > ab->absmax[1][i]
+		|| box->mins[2] > ab->absmax[2][i]
+		|| box->maxs[0] < ab->absmin[0][i]
+		|| box->maxs[1] < ab->absmin[1][i]
+		|| box->maxs[2] < ab->absmin[2][i]);
+#endif
+}
+
+/*
+====================
+SV_AreaBoundsEdicts
+
+====================
+*/
+int SV_AreaBoundsEdicts (areabounds_t *ab, vec3_t mins, vec3_t maxs, edict_t **edicts, int count, int max_edicts)
+{
+	areabox_t	box;
+	int		i, j, bits;
+
+	SV_SetAreaBox (&box, mins, maxs);
+
+	for (i = 0; i < ab->count; i += AREA_STEP)
+	{
+		bits = SV_AreaBoxMask (&box, ab, i);
+		for (j = i; bits; j++, bits >>= 1)
+		{
+			if (!(bits & 1) || !ab->ents[j])
+				continue;
+			if (count == max_edicts)
+				return count;
+			edicts[count++] = ab->ents[j];
+		}
+	}
+
+	return count;
+}
+
+// calls func for the entities of ab that touch the box and aren't SOLID_NOT
+static void SV_AreaBoundsWalk (areabounds_t *ab, const areabox_t *box, areafunc_t func, void *arg)
+{
+	int		i, j, bits;
+
+	for (i = 0; i < ab->count; i += AREA_STEP)
+	{
+		bits = SV_AreaBoxMask (box, ab, i);
+		for (j = i; bits; j++, bits >>= 1)
+		{
+			if (!(bits & 1) || !ab->ents[j] || ab->ents[j]->v.solid == SOLID_NOT)
+				continue;
+			func (ab->ents[j], arg);
+		}
+	}
+}
+
 //============================================================================
 
 
@@ -186,453 +432,1730 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 }
 
 /*
-===============
-SV_ClearWorld
+===============================================================================
 
-===============
+AREA GRID
+
+With sv_areagrid set at map load, entities are linked into a uniform grid
+over the world's x/y bounds instead of the areanode tree.  An entity is
+linked to the cell holding the center of its box, and entities bigger than
+a cell go on a separate list that is always checked.  A query therefore
+only has to look at the cells within half a cell of its box.
+
+===============================================================================
 */
-void SV_ClearWorld (void)
-{
-	memset (sv_areanodes, 0, sizeof(sv_areanodes));
-	sv_numareanodes = 0;
-	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
-}
 
+cvar_t	sv_areagrid = {"sv_areagrid", "0"};
+
+#define	GRID_MAX		64		// cells along each axis
+#define	GRID_MINCELL	128		// smallest cell size
+
+typedef struct
+{
+	link_t	trigger_edicts;
+	link_t	solid_edicts;
+	areabounds_t	trigger_bounds;
+	areabounds_t	solid_bounds;
+} areacell_t;
+
+static qbool		sv_usegrid;
+static vec3_t		grid_mins;
+static float		grid_cellsize;
+static int			grid_dims[2];
+static areacell_t	grid_cells[GRID_MAX*GRID_MAX];
+static areacell_t	grid_large;		// ents bigger than a cell
 
 /*
 ===============
-SV_UnlinkEdict
+SV_CreateAreaGrid
 
+The cell size is picked so that there are about as many cells as there
+are entities in the map, within the bounds of GRID_MAX and GRID_MINCELL
 ===============
 */
-void SV_UnlinkEdict (edict_t *ent)
+static void SV_CreateAreaGrid (vec3_t mins, vec3_t maxs)
 {
-	if (!ent->area.prev)
-		return;		// not linked in anywhere
-	RemoveLink (&ent->area);
-	ent->area.prev = ent->area.next = NULL;
+	char	*data;
+	int		i, numents;
+	float	size[2], cell;
+
+	// estimate the entity count from the map's entity lump
+	numents = MAX_CLIENTS;
+	for (data = CM_EntityString(); *data; data++)
+		if (*data == '{')
+			numents++;
+
+	size[0] = max (maxs[0] - mins[0], 1);
+	size[1] = max (maxs[1] - mins[1], 1);
+
+	cell = sqrt (size[0] * size[1] / numents);
+	cell = max (cell, GRID_MINCELL);
+	cell = max (cell, size[0] / GRID_MAX);
+	cell = max (cell, size[1] / GRID_MAX);
+
+	VectorCopy (mins, grid_mins);
+	grid_cellsize = cell;
+	grid_dims[0] = bound (1, (int)ceil(size[0] / cell), GRID_MAX);
+	grid_dims[1] = bound (1, (int)ceil(size[1] / cell), GRID_MAX);
+
+	for (i = 0; i < grid_dims[0] * grid_dims[1]; i++) {
+		ClearLink (&grid_cells[i].trigger_edicts);
+		ClearLink (&grid_cells[i].solid_edicts);
+	}
+	ClearLink (&grid_large.trigger_edicts);
+	ClearLink (&grid_large.solid_edicts);
+
+	Com_DPrintf ("area grid: %i x %i cells of %i units\n", grid_dims[0], grid_dims[1], (int)cell);
 }
 
-/*
-====================
-SV_AreaEdicts
-====================
-*/
-int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area)
+// returns the column/row of the cell holding x, clamped to the grid
+static int SV_GridCoord (float x, int axis)
 {
-	link_t		*l, *start;
-	edict_t		*touch;
-	int			stackdepth = 0, count = 0;
-	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
+	int		c;
 
-// touch linked edicts
-	while (1)
-	{
-		if (area == AREA_SOLID)
-			start = &node->solid_edicts;
-		else
-			start = &node->trigger_edicts;
+	c = (int)floor((x - grid_mins[axis]) / grid_cellsize);
+	return bound (0, c, grid_dims[axis] - 1);
+}
 
-		for (l = start->next ; l != start ; l = l->next)
-		{
-			touch = EDICT_FROM_AREA(l);
-			if (touch->v.solid == SOLID_NOT)
-				continue;
-			if (mins[0] > touch->v.absmax[0]
-			|| mins[1] > touch->v.absmax[1]
-			|| mins[2] > touch->v.absmax[2]
-			|| maxs[0] < touch->v.absmin[0]
-			|| maxs[1] < touch->v.absmin[1]
-			|| maxs[2] < touch->v.absmin[2])
-				continue;
+static areacell_t *SV_GridCellForBox (vec3_t absmin, vec3_t absmax)
+{
+	int		x, y;
 
-			if (count == max_edicts)
-				return count;
-			edicts[count++] = touch;
-		}
+	if (absmax[0] - absmin[0] > grid_cellsize || absmax[1] - absmin[1] > grid_cellsize)
+		return &grid_large;
 
-		if (node->axis == -1)
-			goto checkstack;		// terminal node
+	x = SV_GridCoord (0.5 * (absmin[0] + absmax[0]), 0);
+	y = SV_GridCoord (0.5 * (absmin[1] + absmax[1]), 1);
+	return &grid_cells[y * grid_dims[0] + x];
+}
 
-		// recurse down both sides
-		if (maxs[node->axis] > node->dist)
-		{
-			if (mins[node->axis] < node->dist)
-			{
-				localstack[stackdepth++] = node->children[0];
-				node = node->children[1];
-				continue;
-			}
-			node = node->children[0];
-			continue;
-		}
-		if (mins[node->axis] < node->dist)
+// SV_AreaBoundsEdicts, minus the SOLID_NOT ents
+static int SV_AreaList (areabounds_t *ab, vec3_t mins, vec3_t maxs, edict_t **edicts, int count, int max_edicts)
+{
+	int		i, first;
+
+	first = count;
+	count = SV_AreaBoundsEdicts (ab, mins, maxs, edicts, count, max_edicts);
+
+	for (i = first; i < count; i++)
+		if (edicts[i]->v.solid == SOLID_NOT)
+			break;
+	if (i == count)
+		return count;
+
+	for (first = i; i < count; i++)
+		if (edicts[i]->v.solid != SOLID_NOT)
+			edicts[first++] = edicts[i];
+	return first;
+}
+
+static int SV_GridAreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area)
+{
+	areacell_t	*cell;
+	int			x, y, x0, x1, y0, y1, count;
+	float		half;
+
+	if (area == AREA_SOLID)
+		count = SV_AreaList (&grid_large.solid_bounds, mins, maxs, edicts, 0, max_edicts);
+	else
+		count = SV_AreaList (&grid_large.trigger_bounds, mins, maxs, edicts, 0, max_edicts);
+
+	// the center of a small entity is at most half a cell outside its box
+	half = 0.5 * grid_cellsize;
+	x0 = SV_GridCoord (mins[0] - half, 0);
+	x1 = SV_GridCoord (maxs[0] + half, 0);
+	y0 = SV_GridCoord (mins[1] - half, 1);
+	y1 = SV_GridCoord (maxs[1] + half, 1);
+
+	for (y = y0; y <= y1; y++)
+	{
+		cell = &grid_cells[y * grid_dims[0] + x0];
+		for (x = x0; x <= x1 && count < max_edicts; x++, cell++)
 		{
-			node = node->children[1];
-			continue;
+			if (area == AREA_SOLID)
+				count = SV_AreaList (&cell->solid_bounds, mins, maxs, edicts, count, max_edicts);
+			else
+				count = SV_AreaList (&cell->trigger_bounds, mins, maxs, edicts, count, max_edicts);
 		}
-
-checkstack:
-		if (!stackdepth)
-			return count;
-		node = localstack[--stackdepth];
 	}
 
 	return count;
 }
 
 /*
-====================
-SV_TouchLinks
-====================
+===============
+SV_UseAreaGrid
+
+True if entities are linked into the area grid rather than sv_areanodes
+===============
 */
-void SV_TouchLinks ( edict_t *ent, areanode_t *node )
+qbool SV_UseAreaGrid (void)
 {
-	int			i, numtouch;
-	edict_t		*touchlist[MAX_EDICTS], *touch;
-	int			old_self, old_other;
+	return sv_usegrid;
+}
 
-	numtouch = SV_AreaEdicts (ent->v.absmin, ent->v.absmax, touchlist, MAX_EDICTS, AREA_TRIGGERS);
+//============================================================================
 
-// touch linked edicts
-	for (i = 0; i < numtouch; i++)
-	{
-		touch = touchlist[i];
-		if (touch == ent)
-			continue;
-		if (!touch->v.touch || touch->v.solid != SOLID_TRIGGER)
-			continue;
+/*
+===============================================================================
 
-		old_self = pr_global_struct->self;
-		old_other = pr_global_struct->other;
+TRIGGER LEAF INDEX
 
-		pr_global_struct->self = EDICT_TO_PROG(touch);
-		pr_global_struct->other = EDICT_TO_PROG(ent);
-		pr_global_struct->time = sv.time;
-		PR_ExecuteProgram (touch->v.touch);
+With sv_triggerleafs 1, SV_TouchLinks gets its triggers from the BSP leafs
+the mover touches (the leafnums SV_LinkToLeafs just found for it) instead
+of going through the area nodes.  The triggers are listed per leaf.  The
+lists are built the first time they're needed, and from then on a trigger
+being linked or unlinked only adds or removes its own entries.
 
-		pr_global_struct->self = old_self;
-		pr_global_struct->other = old_other;
-	}
-}
+Triggers touching more than TL_MAXLEAFS leafs are always candidates.
+Movers without a model or with too many leafs take the area node path.
+Solid leafs aren't listed, so a trigger that only meets a mover inside a
+wall is not touched.
 
-/*
-====================
-SV_LinkToLeafs
-====================
+===============================================================================
 */
-void SV_LinkToLeafs (edict_t *ent)
+
+cvar_t	sv_triggerleafs = {"sv_triggerleafs", "0"};
+
+#define	TL_MAXLEAFS		64
+
+// what a trigger is listed as
+#define	TL_NONE			0
+#define	TL_LEAFS		1
+#define	TL_LARGE		2
+
+// entries of entity e are e*TL_MAXLEAFS and up, one for each leaf it touches
+static qbool	tl_valid;			// built, and kept current from then on
+static byte		tl_state[MAX_EDICTS];
+static byte		tl_numentleafs[MAX_EDICTS];
+static short	tl_leaf[MAX_EDICTS*TL_MAXLEAFS];
+static int		tl_next[MAX_EDICTS*TL_MAXLEAFS];	// in the same leaf, by entnum
+static int		tl_prev[MAX_EDICTS*TL_MAXLEAFS];
+static int		tl_leafhead[MAX_MAP_LEAFS];		// first entry, -1 if none
+static int		tl_numentries;
+static short	tl_large[MAX_EDICTS];			// sorted by entnum
+static int		tl_numlarge;
+static int		tl_mark[MAX_EDICTS];
+static int		tl_markcount;
+
+static struct {
+	int		builds;
+	double	buildtime;
+	int		updates;
+} tl_stats;
+
+static void SV_TriggerIndexRemove (int e)
 {
-	int	i, leafnums[MAX_ENT_LEAFS];
+	int		i, n;
 
-	ent->num_leafs = CM_FindTouchedLeafs (ent->v.absmin, ent->v.absmax, leafnums,
-													MAX_ENT_LEAFS, 0, NULL);
-	for (i = 0; i < ent->num_leafs; i++) {
-		// ent->leafnums are real leafnum minus one (for pvs checks)
-		ent->leafnums[i] = leafnums[i] - 1;
+	if (tl_state[e] == TL_LARGE)
+	{
+		for (i = 0; i < tl_numlarge && tl_large[i] != e; i++)
+			;
+		if (i < tl_numlarge) {
+			memmove (tl_large + i, tl_large + i + 1, (tl_numlarge - i - 1) * sizeof(tl_large[0]));
+			tl_numlarge--;
+		}
+	}
+	else if (tl_state[e] == TL_LEAFS)
+	{
+		for (i = 0, n = e * TL_MAXLEAFS; i < tl_numentleafs[e]; i++, n++)
+		{
+			if (tl_prev[n] == -1)
+				tl_leafhead[tl_leaf[n]] = tl_next[n];
+			else
+				tl_next[tl_prev[n]] = tl_next[n];
+			if (tl_next[n] != -1)
+				tl_prev[tl_next[n]] = tl_prev[n];
+		}
+		tl_numentries -= tl_numentleafs[e];
 	}
-}
-
 
-/*
-===============
-SV_LinkEdict
+	tl_state[e] = TL_NONE;
+}
 
-===============
-*/
-void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
+static void SV_TriggerIndexAdd (edict_t *ent)
 {
-	areanode_t	*node;
+	int		leafs[TL_MAXLEAFS+1];
+	int		e, i, n, p, c, leaf, count;
 
-	if (ent->area.prev)
+	e = NUM_FOR_EDICT(ent);
+	if (tl_state[e] != TL_NONE)
+		SV_TriggerIndexRemove (e);		// never listed twice
+
+	count = CM_FindTouchedLeafs (ent->v.absmin, ent->v.absmax, leafs, TL_MAXLEAFS+1, 0, NULL);
+	if (count > TL_MAXLEAFS)
+	{
+		for (i = tl_numlarge; i > 0 && tl_large[i - 1] > e; i--)
+			tl_large[i] = tl_large[i - 1];
+		tl_large[i] = e;
+		tl_numlarge++;
+		tl_state[e] = TL_LARGE;
+		return;
+	}
+
+	for (i = 0, n = e * TL_MAXLEAFS; i < count; i++, n++)
+	{
+		// same numbering as ent->leafnums
+		leaf = leafs[i] - 1;
+		tl_leaf[n] = leaf;
+
+		// keep each leaf's list sorted by entnum
+		for (p = -1, c = tl_leafhead[leaf]; c != -1 && c < n; p = c, c = tl_next[c])
+			;
+		tl_prev[n] = p;
+		tl_next[n] = c;
+		if (p == -1)
+			tl_leafhead[leaf] = n;
+		else
+			tl_next[p] = n;
+		if (c != -1)
+			tl_prev[c] = n;
+	}
+
+	tl_numentleafs[e] = count;
+	tl_numentries += count;
+	tl_state[e] = TL_LEAFS;
+}
+
+static void SV_BuildTriggerIndex (void)
+{
+	int		e;
+	edict_t	*ent;
+	double	start;
+
+	start = Sys_DoubleTime ();
+
+	memset (tl_state, TL_NONE, sizeof(tl_state));
+	memset (tl_leafhead, -1, sizeof(tl_leafhead));
+	tl_numentries = 0;
+	tl_numlarge = 0;
+
+	for (e = 1; e < sv.num_edicts; e++)
+	{
+		ent = EDICT_NUM(e);
+		if (!ent->inuse || !ent->area.prev || ent->v.solid != SOLID_TRIGGER)
+			continue;
+		SV_TriggerIndexAdd (ent);
+	}
+
+	tl_valid = true;
+	tl_stats.builds++;
+	tl_stats.buildtime += Sys_DoubleTime () - start;
+}
+
+// checks the lists against the linked triggers, for the benchmarks
+static qbool SV_TriggerIndexValid (void)
+{
+	int		leaf, n, p, e, entries;
+	edict_t	*ent;
+
+	entries = 0;
+	for (leaf = 0; leaf < MAX_MAP_LEAFS; leaf++)
+	{
+		// entries go up strictly, which also rules out loops
+		for (p = -1, n = tl_leafhead[leaf]; n != -1; p = n, n = tl_next[n])
+		{
+			if (n <= p || tl_prev[n] != p || tl_leaf[n] != leaf
+				|| tl_state[n / TL_MAXLEAFS] != TL_LEAFS || n % TL_MAXLEAFS >= tl_numentleafs[n / TL_MAXLEAFS])
+				return false;
+			entries++;
+		}
+	}
+	if (entries != tl_numentries)
+		return false;
+
+	for (n = 0; n < tl_numlarge; n++)
+		if ((n && tl_large[n] <= tl_large[n - 1]) || tl_state[tl_large[n]] != TL_LARGE)
+			return false;
+
+	for (e = 1; e < MAX_EDICTS; e++)
+	{
+		ent = e < sv.num_edicts ? EDICT_NUM(e) : NULL;
+		if ((ent && ent->inuse && ent->area.prev && ent->v.solid == SOLID_TRIGGER) != (tl_state[e] != TL_NONE))
+			return false;
+	}
+
+	return true;
+}
+
+// called by SV_LinkEdict for triggers
+static void SV_TriggerLinked (edict_t *ent)
+{
+	if (!tl_valid)
+		return;		// built when first needed
+	SV_TriggerIndexAdd (ent);
+	tl_stats.updates++;
+}
+
+// called by SV_UnlinkEdict
+static void SV_TriggerUnlinked (edict_t *ent)
+{
+	int		e = NUM_FOR_EDICT(ent);
+
+	if (tl_state[e] == TL_NONE)
+		return;
+	SV_TriggerIndexRemove (e);
+	tl_stats.updates++;
+}
+
+static qbool SV_TouchesBox (edict_t *ent, vec3_t mins, vec3_t maxs)
+{
+	return !(mins[0] > ent->v.absmax[0] || mins[1] > ent->v.absmax[1]
+		|| mins[2] > ent->v.absmax[2] || maxs[0] < ent->v.absmin[0]
+		|| maxs[1] < ent->v.absmin[1] || maxs[2] < ent->v.absmin[2]);
+}
+
+// same as SV_AreaEdicts (ent->v.absmin, ent->v.absmax, ..., AREA_TRIGGERS)
+// except for the solid leafs, and the order
+static int SV_TriggerLeafEdicts (edict_t *ent, edict_t **edicts, int max_edicts)
+{
+	edict_t	*touch;
+	int		i, j, e, leaf, count;
+
+	if (!tl_valid)
+		SV_BuildTriggerIndex ();
+
+	if (++tl_markcount == 0x7fffffff) {
+		memset (tl_mark, 0, sizeof(tl_mark));
+		tl_markcount = 1;
+	}
+
+	count = 0;
+	for (i = 0; i < tl_numlarge; i++)
+	{
+		touch = EDICT_NUM(tl_large[i]);
+		if (SV_TouchesBox (touch, ent->v.absmin, ent->v.absmax)) {
+			if (count == max_edicts)
+				return count;
+			edicts[count++] = touch;
+		}
+	}
+
+	for (i = 0; i < ent->num_leafs; i++)
+	{
+		leaf = ent->leafnums[i];
+		for (j = tl_leafhead[leaf]; j != -1; j = tl_next[j])
+		{
+			e = j / TL_MAXLEAFS;
+			if (tl_mark[e] == tl_markcount)
+				continue;
+			tl_mark[e] = tl_markcount;
+
+			touch = EDICT_NUM(e);
+			if (touch->v.solid == SOLID_NOT || !SV_TouchesBox (touch, ent->v.absmin, ent->v.absmax))
+				continue;
+			if (count == max_edicts)
+				return count;
+			edicts[count++] = touch;
+		}
+	}
+
+	return count;
+}
+
+static qbool SV_UseTriggerLeafs (edict_t *ent)
+{
+	return sv_triggerleafs.value && ent->v.modelindex && ent->num_leafs < MAX_ENT_LEAFS;
+}
+
+//============================================================================
+
+/*
+===============
+SV_ClearWorld
+
+===============
+*/
+static void SV_FreeAreaBounds (void)
+{
+	int		i;
+
+	for (i = 0; i < AREA_NODES; i++) {
+		SV_FreeBounds (&sv_areanodes[i].trigger_bounds);
+		SV_FreeBounds (&sv_areanodes[i].solid_bounds);
+	}
+	for (i = 0; i < GRID_MAX*GRID_MAX; i++) {
+		SV_FreeBounds (&grid_cells[i].trigger_bounds);
+		SV_FreeBounds (&grid_cells[i].solid_bounds);
+	}
+	SV_FreeBounds (&grid_large.trigger_bounds);
+	SV_FreeBounds (&grid_large.solid_bounds);
+}
+
+void SV_ClearWorld (void)
+{
+	SV_FreeAreaBounds ();
+	SV_ClearTraceCache ();
+	tl_valid = false;
+	memset (tl_state, TL_NONE, sizeof(tl_state));
+
+	memset (sv_areanodes, 0, sizeof(sv_areanodes));
+	sv_numareanodes = 0;
+	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	sv_usegrid = sv_areagrid.value != 0;
+	if (sv_usegrid)
+		SV_CreateAreaGrid (sv.worldmodel->mins, sv.worldmodel->maxs);
+}
+
+
+/*
+===============
+SV_UnlinkEdict
+
+===============
+*/
+void SV_UnlinkEdict (edict_t *ent)
+{
+	if (!ent->area.prev)
+		return;		// not linked in anywhere
+	RemoveLink (&ent->area);
+	ent->area.prev = ent->area.next = NULL;
+	if (ent->areabounds)
+		SV_RemoveBounds (ent);
+	if (tc_numused)
+		SV_InvalidateTraces (ent);
+	SV_TriggerUnlinked (ent);
+}
+
+/*
+====================
+SV_AreaEdicts
+====================
+*/
+int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area)
+{
+	int			stackdepth = 0, count = 0;
+	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
+
+	if (sv_usegrid)
+		return SV_GridAreaEdicts (mins, maxs, edicts, max_edicts, area);
+
+// touch linked edicts
+	while (1)
+	{
+		if (area == AREA_SOLID)
+			count = SV_AreaList (&node->solid_bounds, mins, maxs, edicts, count, max_edicts);
+		else
+			count = SV_AreaList (&node->trigger_bounds, mins, maxs, edicts, count, max_edicts);
+		if (count == max_edicts)
+			return count;
+
+		if (node->axis == -1)
+			goto checkstack;		// terminal node
+
+		// recurse down both sides
+		if (maxs[node->axis] > node->dist)
+		{
+			if (mins[node->axis] < node->dist)
+			{
+				localstack[stackdepth++] = node->children[0];
+				node = node->children[1];
+				continue;
+			}
+			node = node->children[0];
+			continue;
+		}
+		if (mins[node->axis] < node->dist)
+		{
+			node = node->children[1];
+			continue;
+		}
+
+checkstack:
+		if (!stackdepth)
+			return count;
+		node = localstack[--stackdepth];
+	}
+
+	return count;
+}
+
+/*
+====================
+SV_AreaWalk
+
+Calls func for every entity linked in area whose box touches mins/maxs,
+except SOLID_NOT ones (SV_AreaBoundsWalk skips them, as SV_AreaList does
+for SV_AreaEdicts).  The order is the same as SV_AreaEdicts, but nothing
+is collected first and there is no max_edicts limit.  func must not link
+or unlink entities
+====================
+*/
+void SV_AreaWalk (vec3_t mins, vec3_t maxs, int area, areafunc_t func, void *arg)
+{
+	int			stackdepth = 0;
+	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
+	areacell_t	*cell;
+	areabox_t	box;
+	int			x, y, x0, x1, y0, y1;
+	float		half;
+
+	SV_SetAreaBox (&box, mins, maxs);
+
+	if (sv_usegrid)
+	{	// same as SV_GridAreaEdicts
+		SV_AreaBoundsWalk (area == AREA_SOLID ? &grid_large.solid_bounds
+			: &grid_large.trigger_bounds, &box, func, arg);
+
+		half = 0.5 * grid_cellsize;
+		x0 = SV_GridCoord (mins[0] - half, 0);
+		x1 = SV_GridCoord (maxs[0] + half, 0);
+		y0 = SV_GridCoord (mins[1] - half, 1);
+		y1 = SV_GridCoord (maxs[1] + half, 1);
+
+		for (y = y0; y <= y1; y++)
+		{
+			cell = &grid_cells[y * grid_dims[0] + x0];
+			for (x = x0; x <= x1; x++, cell++)
+				SV_AreaBoundsWalk (area == AREA_SOLID ? &cell->solid_bounds
+					: &cell->trigger_bounds, &box, func, arg);
+		}
+		return;
+	}
+
+	while (1)
+	{
+		SV_AreaBoundsWalk (area == AREA_SOLID ? &node->solid_bounds
+			: &node->trigger_bounds, &box, func, arg);
+
+		if (node->axis == -1)
+			goto checkstack;		// terminal node
+
+		// recurse down both sides
+		if (maxs[node->axis] > node->dist)
+		{
+			if (mins[node->axis] < node->dist)
+			{
+				localstack[stackdepth++] = node->children[0];
+				node = node->children[1];
+				continue;
+			}
+			node = node->children[0];
+			continue;
+		}
+		if (mins[node->axis] < node->dist)
+		{
+			node = node->children[1];
+			continue;
+		}
+
+checkstack:
+		if (!stackdepth)
+			return;
+		node = localstack[--stackdepth];
+	}
+}
+
+typedef struct
+{
+	float	*org;
+	float	rad2;
+	edict_t	*chain;
+} findradius_t;
+
+static void SV_FindRadiusFunc (edict_t *ent, void *arg)
+{
+	findradius_t	*fr = arg;
+	vec3_t		eorg;
+	int			j;
+
+	for (j = 0; j < 3; j++)
+		eorg[j] = fr->org[j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
+	if (DotProduct(eorg, eorg) > fr->rad2)
+		return;
+
+	ent->v.chain = EDICT_TO_PROG(fr->chain);
+	fr->chain = ent;
+}
+
+/*
+====================
+SV_FindRadius
+
+Links the solid and trigger entities whose centers are within rad of org
+through their chain fields and returns the head, sv.edicts if none
+====================
+*/
+edict_t *SV_FindRadius (vec3_t org, float rad)
+{
+	findradius_t	fr;
+	vec3_t		mins, maxs;
+	int			i;
+
+	fr.org = org;
+	fr.rad2 = rad * rad;
+	fr.chain = sv.edicts;
+
+	for (i = 0; i < 3; i++)
+	{
+		mins[i] = org[i] - rad - 1;		// enlarge the bbox a bit
+		maxs[i] = org[i] + rad + 1;
+	}
+
+	SV_AreaWalk (mins, maxs, AREA_SOLID, SV_FindRadiusFunc, &fr);
+	SV_AreaWalk (mins, maxs, AREA_TRIGGERS, SV_FindRadiusFunc, &fr);
+
+	return fr.chain;
+}
+
+/*
+====================
+SV_TouchLinks
+====================
+*/
+void SV_TouchLinks ( edict_t *ent, areanode_t *node )
+{
+	int			i, numtouch;
+	edict_t		*touchlist[MAX_EDICTS], *touch;
+	int			old_self, old_other;
+
+	if (SV_UseTriggerLeafs (ent))
+		numtouch = SV_TriggerLeafEdicts (ent, touchlist, MAX_EDICTS);
+	else
+		numtouch = SV_AreaEdicts (ent->v.absmin, ent->v.absmax, touchlist, MAX_EDICTS, AREA_TRIGGERS);
+
+// touch linked edicts
+	for (i = 0; i < numtouch; i++)
+	{
+		touch = touchlist[i];
+		if (touch == ent)
+			continue;
+		if (!touch->v.touch || touch->v.solid != SOLID_TRIGGER)
+			continue;
+
+		old_self = pr_global_struct->self;
+		old_other = pr_global_struct->other;
+
+		pr_global_struct->self = EDICT_TO_PROG(touch);
+		pr_global_struct->other = EDICT_TO_PROG(ent);
+		pr_global_struct->time = sv.time;
+		PR_ExecuteProgram (touch->v.touch);
+
+		pr_global_struct->self = old_self;
+		pr_global_struct->other = old_other;
+	}
+}
+
+/*
+====================
+SV_LinkToLeafs
+====================
+*/
+void SV_LinkToLeafs (edict_t *ent)
+{
+	int	i, leafnums[MAX_ENT_LEAFS];
+
+	ent->num_leafs = CM_FindTouchedLeafs (ent->v.absmin, ent->v.absmax, leafnums,
+													MAX_ENT_LEAFS, 0, NULL);
+	for (i = 0; i < ent->num_leafs; i++) {
+		// ent->leafnums are real leafnum minus one (for pvs checks)
+		ent->leafnums[i] = leafnums[i] - 1;
+	}
+}
+
+
+/*
+===============
+SV_LinkEdict
+
+===============
+*/
+void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
+{
+	areanode_t	*node;
+	areacell_t	*cell;
+	link_t		*triggers, *solids;
+	areabounds_t	*trigger_bounds, *solid_bounds;
+
+	if (ent->area.prev)
 		SV_UnlinkEdict (ent);	// unlink from old position
 	
 	if (ent == sv.edicts)
 		return;		// don't add the world
 
-	if (!ent->inuse)
-		return;
+	if (!ent->inuse)
+		return;
+
+// set the abs box
+	VectorAdd (ent->v.origin, ent->v.mins, ent->v.absmin);
+	VectorAdd (ent->v.origin, ent->v.maxs, ent->v.absmax);
+
+//
+// to make items easier to pick up and allow them to be grabbed off
+// of shelves, the abs sizes are expanded
+//
+	if ((int)ent->v.flags & FL_ITEM)
+	{
+		ent->v.absmin[0] -= 15;
+		ent->v.absmin[1] -= 15;
+		ent->v.absmax[0] += 15;
+		ent->v.absmax[1] += 15;
+	}
+	else
+	{	// because movement is clipped an epsilon away from an actual edge,
+		// we must fully check even when bounding boxes don't quite touch
+		ent->v.absmin[0] -= 1;
+		ent->v.absmin[1] -= 1;
+		ent->v.absmin[2] -= 1;
+		ent->v.absmax[0] += 1;
+		ent->v.absmax[1] += 1;
+		ent->v.absmax[2] += 1;
+	}
+
+	ED_UpdateHotFields (ent);
+
+// link to PVS leafs
+	if (ent->v.modelindex)
+		SV_LinkToLeafs (ent);
+	else
+		ent->num_leafs = 0;
+	sv.leafchanges++;
+
+	if (ent->v.solid == SOLID_NOT)
+		return;
+
+	if (tc_numused && ent->v.solid != SOLID_TRIGGER)
+		SV_InvalidateTraces (ent);
+
+	if (sv_usegrid)
+	{
+		cell = SV_GridCellForBox (ent->v.absmin, ent->v.absmax);
+		triggers = &cell->trigger_edicts;
+		solids = &cell->solid_edicts;
+		trigger_bounds = &cell->trigger_bounds;
+		solid_bounds = &cell->solid_bounds;
+	}
+	else
+	{
+	// find the first node that the ent's box crosses
+		node = sv_areanodes;
+		while (1)
+		{
+			if (node->axis == -1)
+				break;
+			if (ent->v.absmin[node->axis] > node->dist)
+				node = node->children[0];
+			else if (ent->v.absmax[node->axis] < node->dist)
+				node = node->children[1];
+			else
+				break;		// crosses the node
+		}
+		triggers = &node->trigger_edicts;
+		solids = &node->solid_edicts;
+		trigger_bounds = &node->trigger_bounds;
+		solid_bounds = &node->solid_bounds;
+	}
+
+// link it in
+
+	if (ent->v.solid == SOLID_TRIGGER) {
+		InsertLinkBefore (&ent->area, triggers);
+		SV_AddBounds (trigger_bounds, ent);
+		SV_TriggerLinked (ent);
+	}
+	else {
+		InsertLinkBefore (&ent->area, solids);
+		SV_AddBounds (solid_bounds, ent);
+	}
+
+// if touch_triggers, touch all entities at this node and decend for more
+	if (touch_triggers)
+		SV_TouchLinks ( ent, sv_areanodes );
+}
+
+
+
+/*
+===============================================================================
+
+POINT TESTING IN HULLS
+
+===============================================================================
+*/
+
+/*
+==================
+SV_PointContents
+
+==================
+*/
+int SV_PointContents (vec3_t p)
+{
+	return CM_HullPointContents (&sv.worldmodel->hulls[0], sv.worldmodel->hulls[0].firstclipnode, p);
+}
+
+//===========================================================================
+
+/*
+============
+SV_TestEntityPosition
+
+A small wrapper around SV_BoxInSolidEntity that never clips against the
+supplied entity.
+============
+*/
+edict_t	*SV_TestEntityPosition (edict_t *ent)
+{
+	trace_t	trace;
+
+	if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
+		// only clip against bmodels
+		trace = SV_Trace (ent->v.origin, ent->v.mins, ent->v.maxs, ent->v.origin, MOVE_NOMONSTERS, ent);
+	else
+		trace = SV_Trace (ent->v.origin, ent->v.mins, ent->v.maxs, ent->v.origin, MOVE_NORMAL, ent);
+
+	if (trace.startsolid)
+		return sv.edicts;
+	
+	return NULL;
+}
+
+/*
+==================
+SV_ClipMoveToEntity
+
+Handles selection or creation of a clipping hull, and offseting (and
+eventually rotation) of the end points
+==================
+*/
+trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	trace_t		trace;
+	vec3_t		offset;
+	vec3_t		start_l, end_l;
+	hull_t		*hull;
+
+// get the clipping hull
+	hull = SV_HullForEntity (ent, mins, maxs, offset);
 
-// set the abs box
-	VectorAdd (ent->v.origin, ent->v.mins, ent->v.absmin);
-	VectorAdd (ent->v.origin, ent->v.maxs, ent->v.absmax);
+	VectorSubtract (start, offset, start_l);
+	VectorSubtract (end, offset, end_l);
 
-//
-// to make items easier to pick up and allow them to be grabbed off
-// of shelves, the abs sizes are expanded
-//
-	if ((int)ent->v.flags & FL_ITEM)
+// trace a line through the apropriate clipping hull
+	trace = CM_HullTrace (hull, start_l, end_l);
+
+// fix trace up by the offset
+	VectorAdd (trace.endpos, offset, trace.endpos);
+
+// did we clip the move?
+	if (trace.fraction < 1 || trace.startsolid )
+		trace.e.ent = ent;
+
+	return trace;
+}
+
+//===========================================================================
+
+/*
+====================
+SV_ClipToLinks
+
+Mins and maxs enclose the entire area swept by the move
+====================
+*/
+void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
+{
+	int			i, numtouch;
+	edict_t		*touchlist[MAX_EDICTS], *touch;
+	trace_t		trace;
+
+	numtouch = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+
+// touch linked edicts
+	for (i = 0; i < numtouch; i++)
 	{
-		ent->v.absmin[0] -= 15;
-		ent->v.absmin[1] -= 15;
-		ent->v.absmax[0] += 15;
-		ent->v.absmax[1] += 15;
+		touch = touchlist[i];
+		if (touch == clip->passedict)
+			continue;
+		if (touch->v.solid == SOLID_TRIGGER)
+			Host_Error ("Trigger in clipping list");
+
+		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+			continue;
+
+		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
+			continue;	// points never interact
+
+	// might intersect, so do an exact clip
+		if (clip->trace.allsolid)
+			return;
+		if (clip->passedict)
+		{
+		 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+				continue;	// don't clip against own missiles
+			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+				continue;	// don't clip against owner
+		}
+
+		if ((int)touch->v.flags & FL_MONSTER)
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
+		else
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
+		if (trace.allsolid || trace.startsolid ||
+		trace.fraction < clip->trace.fraction)
+		{
+			trace.e.ent = touch;
+		 	if (clip->trace.startsolid)
+			{
+				clip->trace = trace;
+				clip->trace.startsolid = true;
+			}
+			else
+				clip->trace = trace;
+		}
+		else if (trace.startsolid)
+			clip->trace.startsolid = true;
 	}
-	else
-	{	// because movement is clipped an epsilon away from an actual edge,
-		// we must fully check even when bounding boxes don't quite touch
-		ent->v.absmin[0] -= 1;
-		ent->v.absmin[1] -= 1;
-		ent->v.absmin[2] -= 1;
-		ent->v.absmax[0] += 1;
-		ent->v.absmax[1] += 1;
-		ent->v.absmax[2] += 1;
+}
+
+
+/*
+==================
+SV_MoveBounds
+==================
+*/
+void SV_MoveBounds (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, vec3_t boxmins, vec3_t boxmaxs)
+{
+#if 0
+// debug to test against everything
+boxmins[0] = boxmins[1] = boxmins[2] = -9999;
+boxmaxs[0] = boxmaxs[1] = boxmaxs[2] = 9999;
+#else
+	int		i;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		if (end[i] > start[i])
+		{
+			boxmins[i] = start[i] + mins[i] - 1;
+			boxmaxs[i] = end[i] + maxs[i] + 1;
+		}
+		else
+		{
+			boxmins[i] = end[i] + mins[i] - 1;
+			boxmaxs[i] = start[i] + maxs[i] + 1;
+		}
 	}
+#endif
+}
 
-// link to PVS leafs
-	if (ent->v.modelindex)
-		SV_LinkToLeafs (ent);
+/*
+==================
+SV_ClipTraceToEntities
+
+trace holds the move clipped to the world, shortens it to any entity in the way
+==================
+*/
+static void SV_ClipTraceToEntities (trace_t *trace, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	moveclip_t	clip;
+	int			i;
+
+	memset ( &clip, 0, sizeof ( moveclip_t ) );
+
+	clip.trace = *trace;
+	clip.start = start;
+	clip.end = end;
+	clip.mins = mins;
+	clip.maxs = maxs;
+	clip.type = type;
+	clip.passedict = passedict;
+
+	if (type == MOVE_MISSILE)
+	{
+		for (i=0 ; i<3 ; i++)
+		{
+			clip.mins2[i] = -15;
+			clip.maxs2[i] = 15;
+		}
+	}
 	else
-		ent->num_leafs = 0;
+	{
+		VectorCopy (mins, clip.mins2);
+		VectorCopy (maxs, clip.maxs2);
+	}
+
+// create the bounding box of the entire move
+	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
+
+// clip to entities
+	SV_ClipToLinks ( sv_areanodes, &clip );
+
+	*trace = clip.trace;
+}
+
+/*
+==================
+SV_TraceUncached
+==================
+*/
+static trace_t SV_TraceUncached (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	trace_t		trace;
+
+// clip to world
+	trace = SV_ClipMoveToEntity ( sv.edicts, start, mins, maxs, end );
+
+// clip to entities
+	SV_ClipTraceToEntities ( &trace, start, mins, maxs, end, type, passedict );
+
+	return trace;
+}
+
+/*
+===============================================================================
+
+TRACE CACHE
+
+With sv_tracecache 1, SV_Trace remembers its results during a server frame
+and hands them out again for calls with exactly the same arguments.  An
+entry is thrown away when an entity is linked or unlinked with a box that
+touches the area the trace looked at, or when its passedict is relinked.
+The whole cache is flushed at the start of each physics frame.
+
+Fields that clipping reads can also change without a relink.  Progs
+write them through OP_ADDRESS, which calls SV_TraceFieldAddressed before
+the store happens, so nothing is stored in the cache until the progs
+return.  C code calls SV_TraceFieldChanged after changing them.
+sv_tracecache 2 runs every cached trace again and stops the server if
+the result differs.
+
+===============================================================================
+*/
+
+cvar_t	sv_tracecache = {"sv_tracecache", "0"};
+
+#define	TRACE_CACHE_SIZE	1024	// must be a power of two
+
+typedef struct
+{
+	// the arguments
+	vec3_t	start, end, mins, maxs;
+	int		type;
+	edict_t	*passedict;
+
+	vec3_t	boxmins, boxmaxs;	// everything the trace could have touched
+	int		used;				// index in tc_used, -1 if free
+	trace_t	trace;
+} tracecache_t;
+
+static tracecache_t	tc_entries[TRACE_CACHE_SIZE];
+static int			tc_used[TRACE_CACHE_SIZE];
+static qbool		tc_initialized;
+static qbool		tc_hold;		// progs are about to change a field
+
+static struct {
+	int		hits;
+	int		misses;
+	int		invalidated;
+} tc_stats;
+
+static void SV_FreeTraceEntry (tracecache_t *tc)
+{
+	int		i;
+
+	i = tc->used;
+	tc->used = -1;
+	tc_used[i] = tc_used[--tc_numused];
+	if (i < tc_numused)
+		tc_entries[tc_used[i]].used = i;
+}
+
+/*
+==================
+SV_ClearTraceCache
+
+Called at the start of each physics frame and on map changes
+==================
+*/
+void SV_ClearTraceCache (void)
+{
+	int		i;
+
+	if (!tc_initialized) {
+		for (i = 0; i < TRACE_CACHE_SIZE; i++)
+			tc_entries[i].used = -1;
+		tc_initialized = true;
+	}
+
+	for (i = 0; i < tc_numused; i++)
+		tc_entries[tc_used[i]].used = -1;
+	tc_numused = 0;
+}
+
+// throws away the entries that a change to ent could affect
+static void SV_InvalidateTraces (edict_t *ent)
+{
+	tracecache_t	*tc;
+	int		i;
+
+	for (i = 0; i < tc_numused; )
+	{
+		tc = &tc_entries[tc_used[i]];
+		if (tc->passedict != ent
+			&& (tc->boxmins[0] > ent->v.absmax[0]
+			|| tc->boxmins[1] > ent->v.absmax[1]
+			|| tc->boxmins[2] > ent->v.absmax[2]
+			|| tc->boxmaxs[0] < ent->v.absmin[0]
+			|| tc->boxmaxs[1] < ent->v.absmin[1]
+			|| tc->boxmaxs[2] < ent->v.absmin[2]))
+		{
+			i++;
+			continue;
+		}
+
+		SV_FreeTraceEntry (tc);		// moves another entry to i
+		tc_stats.invalidated++;
+	}
+}
+
+/*
+==================
+SV_TraceFieldChanged
+
+Called after C code changes a field clipping reads (the FW_TRACE fields
+in pr_edict.c) of a linked edict without relinking it
+==================
+*/
+void SV_TraceFieldChanged (edict_t *ent)
+{
+	if (tc_numused)
+		SV_InvalidateTraces (ent);
+}
+
+/*
+==================
+SV_TraceFieldAddressed
+
+Called by OP_ADDRESS for the same fields.  The store comes later, maybe
+after a builtin that traces, so nothing new is cached until the progs
+have returned
+==================
+*/
+void SV_TraceFieldAddressed (edict_t *ent)
+{
+	if (tc_numused)
+		SV_InvalidateTraces (ent);
+	tc_hold = true;
+}
+
+static unsigned SV_HashTrace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	unsigned	hash;
+	int			i;
+
+	hash = 2166136261u;
+	for (i = 0; i < 3; i++) {
+		hash = (hash ^ *(unsigned *)&start[i]) * 16777619u;
+		hash = (hash ^ *(unsigned *)&end[i]) * 16777619u;
+		hash = (hash ^ *(unsigned *)&mins[i]) * 16777619u;
+		hash = (hash ^ *(unsigned *)&maxs[i]) * 16777619u;
+	}
+	hash = (hash ^ type) * 16777619u;
+	hash = (hash ^ (passedict ? NUM_FOR_EDICT(passedict) : -1)) * 16777619u;
+
+	return hash ^ (hash >> 16);
+}
 
-	if (ent->v.solid == SOLID_NOT)
-		return;
+static qbool SV_SameTrace (trace_t *a, trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->inopen == b->inopen && a->inwater == b->inwater
+		&& a->fraction == b->fraction && VectorCompare (a->endpos, b->endpos)
+		&& VectorCompare (a->plane.normal, b->plane.normal) && a->plane.dist == b->plane.dist
+		&& a->e.ent == b->e.ent;
+}
 
-// find the first node that the ent's box crosses
-	node = sv_areanodes;
-	while (1)
+/*
+==================
+SV_Trace
+==================
+*/
+trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	tracecache_t	*tc;
+	trace_t		trace;
+	vec3_t		mins2, maxs2;
+	int			i;
+
+	if (!sv_tracecache.value)
 	{
-		if (node->axis == -1)
-			break;
-		if (ent->v.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->v.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
+		if (tc_numused)
+			SV_ClearTraceCache ();	// would go stale
+		return SV_TraceUncached (start, mins, maxs, end, type, passedict);
 	}
 
-// link it in
+	if (!tc_initialized)
+		SV_ClearTraceCache ();
 
-	if (ent->v.solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
+	tc = &tc_entries[SV_HashTrace (start, mins, maxs, end, type, passedict) & (TRACE_CACHE_SIZE - 1)];
 
-// if touch_triggers, touch all entities at this node and decend for more
-	if (touch_triggers)
-		SV_TouchLinks ( ent, sv_areanodes );
-}
+	if (tc->used != -1 && tc->type == type && tc->passedict == passedict
+		&& VectorCompare (tc->start, start) && VectorCompare (tc->end, end)
+		&& VectorCompare (tc->mins, mins) && VectorCompare (tc->maxs, maxs))
+	{
+		tc_stats.hits++;
+		if (sv_tracecache.value != 2)
+			return tc->trace;
+
+		trace = SV_TraceUncached (start, mins, maxs, end, type, passedict);
+		if (!SV_SameTrace (&trace, &tc->trace))
+			Host_Error ("SV_Trace: cached result differs (passedict %i)",
+				passedict ? NUM_FOR_EDICT(passedict) : -1);
+		return trace;
+	}
 
+	tc_stats.misses++;
+	trace = SV_TraceUncached (start, mins, maxs, end, type, passedict);
 
+	if (tc_hold)
+	{
+		if (pr_depth)
+			return trace;	// a field store may still be coming
+		tc_hold = false;
+	}
 
-/*
-===============================================================================
+	// store it, replacing whatever was in the slot
+	VectorCopy (start, tc->start);
+	VectorCopy (end, tc->end);
+	VectorCopy (mins, tc->mins);
+	VectorCopy (maxs, tc->maxs);
+	tc->type = type;
+	tc->passedict = passedict;
+	tc->trace = trace;
+
+	// the box SV_TraceUncached looked for entities in
+	if (type == MOVE_MISSILE) {
+		for (i = 0; i < 3; i++) {
+			mins2[i] = -15;
+			maxs2[i] = 15;
+		}
+	}
+	else {
+		VectorCopy (mins, mins2);
+		VectorCopy (maxs, maxs2);
+	}
+	SV_MoveBounds (start, mins2, maxs2, end, tc->boxmins, tc->boxmaxs);
 
-POINT TESTING IN HULLS
+	if (tc->used == -1) {
+		tc->used = tc_numused;
+		tc_used[tc_numused++] = tc - tc_entries;
+	}
 
-===============================================================================
-*/
+	return trace;
+}
 
 /*
 ==================
-SV_PointContents
+SV_TraceBatch
 
+Same as count calls to SV_Trace with the same mins, maxs, type and
+passedict, but the world hull is walked once for all of them
 ==================
 */
-int SV_PointContents (vec3_t p)
+void SV_TraceBatch (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, int type, edict_t *passedict, trace_t *traces)
 {
-	return CM_HullPointContents (&sv.worldmodel->hulls[0], sv.worldmodel->hulls[0].firstclipnode, p);
-}
+	vec3_t		starts_l[CM_MAX_TRACEBATCH], ends_l[CM_MAX_TRACEBATCH];
+	vec3_t		offset;
+	hull_t		*hull;
+	int			i;
 
-//===========================================================================
+	if (count > CM_MAX_TRACEBATCH)
+	{
+		SV_TraceBatch (CM_MAX_TRACEBATCH, starts, mins, maxs, ends, type, passedict, traces);
+		SV_TraceBatch (count - CM_MAX_TRACEBATCH, starts + CM_MAX_TRACEBATCH, mins, maxs,
+			ends + CM_MAX_TRACEBATCH, type, passedict, traces + CM_MAX_TRACEBATCH);
+		return;
+	}
 
-/*
-============
-SV_TestEntityPosition
+	if (sv_tracecache.value)
+	{	// go through the cache one at a time
+		for (i = 0; i < count; i++)
+			traces[i] = SV_Trace (starts[i], mins, maxs, ends[i], type, passedict);
+		return;
+	}
 
-A small wrapper around SV_BoxInSolidEntity that never clips against the
-supplied entity.
-============
-*/
-edict_t	*SV_TestEntityPosition (edict_t *ent)
-{
-	trace_t	trace;
+// clip to world, like SV_ClipMoveToEntity
+	hull = SV_HullForEntity (sv.edicts, mins, maxs, offset);
 
-	if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
-		// only clip against bmodels
-		trace = SV_Trace (ent->v.origin, ent->v.mins, ent->v.maxs, ent->v.origin, MOVE_NOMONSTERS, ent);
-	else
-		trace = SV_Trace (ent->v.origin, ent->v.mins, ent->v.maxs, ent->v.origin, MOVE_NORMAL, ent);
+	for (i = 0; i < count; i++)
+	{
+		VectorSubtract (starts[i], offset, starts_l[i]);
+		VectorSubtract (ends[i], offset, ends_l[i]);
+	}
 
-	if (trace.startsolid)
-		return sv.edicts;
-	
-	return NULL;
+	CM_HullTraceBatch (hull, count, starts_l, ends_l, traces);
+
+	for (i = 0; i < count; i++)
+	{
+		VectorAdd (traces[i].endpos, offset, traces[i].endpos);
+		if (traces[i].fraction < 1 || traces[i].startsolid)
+			traces[i].e.ent = sv.edicts;
+
+	// clip to entities
+		SV_ClipTraceToEntities (&traces[i], starts[i], mins, maxs, ends[i], type, passedict);
+	}
 }
 
 /*
 ==================
-SV_ClipMoveToEntity
-
-Handles selection or creation of a clipping hull, and offseting (and
-eventually rotation) of the end points
+SV_TraceStats_f
 ==================
 */
-trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+void SV_TraceStats_f (void)
 {
-	trace_t		trace;
-	vec3_t		offset;
-	vec3_t		start_l, end_l;
-	hull_t		*hull;
+	int		total;
 
-// get the clipping hull
-	hull = SV_HullForEntity (ent, mins, maxs, offset);
+	if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+		memset (&tc_stats, 0, sizeof(tc_stats));
+		return;
+	}
 
-	VectorSubtract (start, offset, start_l);
-	VectorSubtract (end, offset, end_l);
+	total = tc_stats.hits + tc_stats.misses;
+	Com_Printf ("trace cache: %s\n", !sv_tracecache.value ? "off" :
+		sv_tracecache.value == 2 ? "verifying" : "on");
+	Com_Printf ("hits: %i  misses: %i  (%.1f%% hits)\n", tc_stats.hits, tc_stats.misses,
+		total ? 100.0 * tc_stats.hits / total : 0.0);
+	Com_Printf ("invalidated: %i  in use: %i/%i\n", tc_stats.invalidated, tc_numused, TRACE_CACHE_SIZE);
+}
 
-// trace a line through the apropriate clipping hull
-	trace = CM_HullTrace (hull, start_l, end_l);
+//=============================================================================
 
-// fix trace up by the offset
-	VectorAdd (trace.endpos, offset, trace.endpos);
+/*
+===============
+SV_RelinkAll
 
-// did we clip the move?
-	if (trace.fraction < 1 || trace.startsolid )
-		trace.e.ent = ent;
+Moves all linked entities over to the tree or the grid
+===============
+*/
+static void SV_RelinkAll (qbool grid)
+{
+	static edict_t	*linked[MAX_EDICTS];
+	edict_t	*ent;
+	int		i, count;
 
-	return trace;
-}
+	count = 0;
+	for (i = 1; i < sv.num_edicts; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (!ent->area.prev)
+			continue;
+		ent->area.prev = ent->area.next = NULL;
+		ent->areabounds = NULL;
+		SV_TriggerUnlinked (ent);
+		linked[count++] = ent;
+	}
 
-//===========================================================================
+	SV_FreeAreaBounds ();
+	memset (sv_areanodes, 0, sizeof(sv_areanodes));
+	sv_numareanodes = 0;
+	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
+	sv_usegrid = grid;
+	if (sv_usegrid)
+		SV_CreateAreaGrid (sv.worldmodel->mins, sv.worldmodel->maxs);
+
+	for (i = 0; i < count; i++)
+		SV_LinkEdict (linked[i], false);
+}
 
 /*
-====================
-SV_ClipToLinks
+===============
+SV_BenchArea_f
 
-Mins and maxs enclose the entire area swept by the move
-====================
+Replays pseudo random movement of all the linked entities of the current
+map and times the relinking and area queries with the areanode tree and
+with the area grid.  Entities are put back where they were afterwards
+===============
 */
-void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
+void SV_BenchArea_f (void)
 {
-	int			i, numtouch;
-	edict_t		*touchlist[MAX_EDICTS], *touch;
-	trace_t		trace;
+	static edict_t	*touchlist[MAX_EDICTS];
+	static edict_t	*movers[MAX_EDICTS];
+	static vec3_t	origins[MAX_EDICTS];
+	edict_t	*ent;
+	qbool	oldgrid;
+	vec3_t	mins, maxs;
+	double	start, linktime[2], querytime[2];
+	int		found[2];
+	int		i, j, n, pass, runs, nummovers;
+	unsigned	seed;
+
+	if (sv.state != ss_active) {
+		Com_Printf ("no map running\n");
+		return;
+	}
 
-	numtouch = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
+	runs = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+	if (runs < 1)
+		runs = 1;
 
-// touch linked edicts
-	for (i = 0; i < numtouch; i++)
+	// everything linked that isn't a brush model moves
+	nummovers = 0;
+	for (i = 1; i < sv.num_edicts; i++)
 	{
-		touch = touchlist[i];
-		if (touch == clip->passedict)
+		ent = EDICT_NUM(i);
+		if (!ent->inuse || !ent->area.prev || ent->v.solid == SOLID_BSP)
 			continue;
-		if (touch->v.solid == SOLID_TRIGGER)
-			Host_Error ("Trigger in clipping list");
+		VectorCopy (ent->v.origin, origins[nummovers]);
+		movers[nummovers++] = ent;
+	}
 
-		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
-			continue;
+	oldgrid = sv_usegrid;
 
-		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
-			continue;	// points never interact
+	for (pass = 0; pass < 2; pass++)
+	{
+		SV_RelinkAll (pass == 1);
 
-	// might intersect, so do an exact clip
-		if (clip->trace.allsolid)
-			return;
-		if (clip->passedict)
-		{
-		 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
-				continue;	// don't clip against owner
-		}
+		seed = 1;	// same movement for both
+		linktime[pass] = querytime[pass] = 0;
+		found[pass] = 0;
 
-		if ((int)touch->v.flags & FL_MONSTER)
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
-		else
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
-		if (trace.allsolid || trace.startsolid ||
-		trace.fraction < clip->trace.fraction)
+		for (n = 0; n < runs; n++)
 		{
-			trace.e.ent = touch;
-		 	if (clip->trace.startsolid)
+			start = Sys_DoubleTime ();
+			for (i = 0; i < nummovers; i++)
 			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
+				ent = movers[i];
+				for (j = 0; j < 3; j++) {
+					seed = seed * 1103515245 + 12345;
+					ent->v.origin[j] = origins[i][j] + (int)((seed >> 16) & 127) - 64;
+				}
+				SV_LinkEdict (ent, false);
 			}
-			else
-				clip->trace = trace;
+			linktime[pass] += Sys_DoubleTime () - start;
+
+			// about what a move and a trigger check would ask for
+			start = Sys_DoubleTime ();
+			for (i = 0; i < nummovers; i++)
+			{
+				ent = movers[i];
+				for (j = 0; j < 3; j++) {
+					mins[j] = ent->v.absmin[j] - 32;
+					maxs[j] = ent->v.absmax[j] + 32;
+				}
+				found[pass] += SV_AreaEdicts (mins, maxs, touchlist, MAX_EDICTS, AREA_SOLID);
+				found[pass] += SV_AreaEdicts (ent->v.absmin, ent->v.absmax, touchlist, MAX_EDICTS, AREA_TRIGGERS);
+			}
+			querytime[pass] += Sys_DoubleTime () - start;
 		}
-		else if (trace.startsolid)
-			clip->trace.startsolid = true;
 	}
-}
 
+	for (i = 0; i < nummovers; i++)
+		VectorCopy (origins[i], movers[i]->v.origin);
+	SV_RelinkAll (oldgrid);
+
+	if (!nummovers) {
+		Com_Printf ("nothing to move\n");
+		return;
+	}
+
+	n = runs * nummovers;
+	Com_Printf ("%i entities, %i runs, grid %i x %i cells of %i units\n", nummovers, runs,
+		grid_dims[0], grid_dims[1], (int)grid_cellsize);
+	Com_Printf ("        link usec  query usec  found\n");
+	Com_Printf ("tree:  %9.3f  %10.3f  %5.1f\n", linktime[0] * 1000000 / n,
+		querytime[0] * 1000000 / (2 * n), (float)found[0] / (2 * n));
+	Com_Printf ("grid:  %9.3f  %10.3f  %5.1f\n", linktime[1] * 1000000 / n,
+		querytime[1] * 1000000 / (2 * n), (float)found[1] / (2 * n));
+	if (found[0] != found[1])
+		Com_Printf ("results differ!\n");
+	if (tl_valid && !SV_TriggerIndexValid ())
+		Com_Printf ("trigger leaf index is broken!\n");
+}
 
 /*
-==================
-SV_MoveBounds
-==================
+===============
+SV_BenchTouch_f
+
+Asks for the triggers touching every linked entity that has a model, the
+way SV_TouchLinks would, through the area nodes and through the trigger
+leaf index, and times both.  No touch functions are called
+===============
 */
-void SV_MoveBounds (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, vec3_t boxmins, vec3_t boxmaxs)
+void SV_BenchTouch_f (void)
 {
-#if 0
-// debug to test against everything
-boxmins[0] = boxmins[1] = boxmins[2] = -9999;
-boxmaxs[0] = boxmaxs[1] = boxmaxs[2] = 9999;
-#else
-	int		i;
+	static edict_t	*touchlist[MAX_EDICTS];
+	static edict_t	*movers[MAX_EDICTS];
+	static byte		seen[MAX_EDICTS];
+	edict_t	*ent;
+	double	start, time[2];
+	int		found[2], only[2];
+	int		i, j, e, n, runs, nummovers;
+
+	if (sv.state != ss_active) {
+		Com_Printf ("no map running\n");
+		return;
+	}
 
-	for (i=0 ; i<3 ; i++)
+	runs = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+	if (runs < 1)
+		runs = 1;
+
+	nummovers = 0;
+	for (i = 1; i < sv.num_edicts; i++)
 	{
-		if (end[i] > start[i])
-		{
-			boxmins[i] = start[i] + mins[i] - 1;
-			boxmaxs[i] = end[i] + maxs[i] + 1;
+		ent = EDICT_NUM(i);
+		if (!ent->inuse || !ent->area.prev || ent->v.solid == SOLID_TRIGGER
+			|| ent->v.solid == SOLID_BSP || !ent->v.modelindex || ent->num_leafs == MAX_ENT_LEAFS)
+			continue;
+		movers[nummovers++] = ent;
+	}
+
+	if (!nummovers) {
+		Com_Printf ("nothing to test\n");
+		return;
+	}
+
+	// the full build is timed on its own
+	SV_BuildTriggerIndex ();
+
+	start = Sys_DoubleTime ();
+	found[0] = 0;
+	for (n = 0; n < runs; n++)
+		for (i = 0; i < nummovers; i++)
+			found[0] += SV_AreaEdicts (movers[i]->v.absmin, movers[i]->v.absmax, touchlist, MAX_EDICTS, AREA_TRIGGERS);
+	time[0] = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	found[1] = 0;
+	for (n = 0; n < runs; n++)
+		for (i = 0; i < nummovers; i++)
+			found[1] += SV_TriggerLeafEdicts (movers[i], touchlist, MAX_EDICTS);
+	time[1] = Sys_DoubleTime () - start;
+
+	// triggers only one of them finds, the leafs miss the ones met inside walls
+	only[0] = only[1] = 0;
+	for (i = 0; i < nummovers; i++)
+	{
+		n = SV_TriggerLeafEdicts (movers[i], touchlist, MAX_EDICTS);
+		for (j = 0; j < n; j++)
+			seen[NUM_FOR_EDICT(touchlist[j])] = 1;
+		n = SV_AreaEdicts (movers[i]->v.absmin, movers[i]->v.absmax, touchlist, MAX_EDICTS, AREA_TRIGGERS);
+		for (j = 0; j < n; j++) {
+			e = NUM_FOR_EDICT(touchlist[j]);
+			if (seen[e])
+				seen[e] = 2;
+			else
+				only[0]++;
 		}
-		else
-		{
-			boxmins[i] = end[i] + mins[i] - 1;
-			boxmaxs[i] = start[i] + maxs[i] + 1;
+		for (e = 1; e < sv.num_edicts; e++) {
+			if (seen[e] == 1)
+				only[1]++;
+			seen[e] = 0;
 		}
 	}
-#endif
+
+	Com_Printf ("%i movers, %i runs, %i trigger leaf entries, %i large\n", nummovers, runs,
+		tl_numentries, tl_numlarge);
+	Com_Printf ("        query usec  found\n");
+	Com_Printf ("area:  %10.3f  %5.2f\n", time[0] * 1000000 / (runs * nummovers),
+		(float)found[0] / (runs * nummovers));
+	Com_Printf ("leafs: %10.3f  %5.2f\n", time[1] * 1000000 / (runs * nummovers),
+		(float)found[1] / (runs * nummovers));
+	Com_Printf ("index builds: %i, %.3f msec average, %i trigger updates\n", tl_stats.builds,
+		tl_stats.builds ? tl_stats.buildtime * 1000 / tl_stats.builds : 0.0, tl_stats.updates);
+	if (only[0] || only[1])
+		Com_Printf ("only found by area: %i, only by leafs: %i\n", only[0], only[1]);
+	if (!SV_TriggerIndexValid ())
+		Com_Printf ("trigger leaf index is broken!\n");
 }
 
 /*
-==================
-SV_Trace
-==================
+===============
+SV_BenchFindRadius_f
+
+Runs findradius at the origin of every rocket, grenade and player of the
+current map, or at random spots when there are fewer than 32 of them,
+once collecting into arrays the old way and once with SV_FindRadius
+===============
 */
-trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+void SV_BenchFindRadius_f (void)
 {
-	moveclip_t	clip;
-	int			i;
-
-	memset ( &clip, 0, sizeof ( moveclip_t ) );
-
-// clip to world
-	clip.trace = SV_ClipMoveToEntity ( sv.edicts, start, mins, maxs, end );
+	static edict_t	*touchlist[MAX_EDICTS];
+	static vec3_t	spots[256];
+	edict_t	*ent, *chain;
+	vec3_t	mins, maxs, eorg;
+	float	rad, rad2;
+	double	start, time[2];
+	int		found[2];
+	int		i, j, k, n, runs, numspots, numtouch;
+	unsigned	seed;
+
+	if (sv.state != ss_active) {
+		Com_Printf ("no map running\n");
+		return;
+	}
 
-	clip.start = start;
-	clip.end = end;
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.type = type;
-	clip.passedict = passedict;
+	runs = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 100;
+	if (runs < 1)
+		runs = 1;
+	rad = 160;		// rocket splash in the stock progs
+	rad2 = rad * rad;
 
-	if (type == MOVE_MISSILE)
-	{
-		for (i=0 ; i<3 ; i++)
-		{
-			clip.mins2[i] = -15;
-			clip.maxs2[i] = 15;
-		}
-	}
-	else
+	numspots = 0;
+	for (i = 1; i < sv.num_edicts && numspots < 256; i++)
 	{
-		VectorCopy (mins, clip.mins2);
-		VectorCopy (maxs, clip.maxs2);
+		ent = EDICT_NUM(i);
+		if (!ent->inuse || !ent->area.prev)
+			continue;
+		if (ent->v.movetype == MOVETYPE_FLYMISSILE || ent->v.movetype == MOVETYPE_BOUNCE
+			|| (i <= MAX_CLIENTS && ent->v.solid != SOLID_NOT))
+			VectorCopy (ent->v.origin, spots[numspots++]);
 	}
+	for (seed = 1; numspots < 32; numspots++)
+		for (j = 0; j < 3; j++) {
+			seed = seed * 1103515245 + 12345;
+			spots[numspots][j] = sv.worldmodel->mins[j] + (sv.worldmodel->maxs[j]
+				- sv.worldmodel->mins[j]) * ((seed >> 8) & 0xffff) / 0xffff;
+		}
 
-// create the bounding box of the entire move
-	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
-
-// clip to entities
-	SV_ClipToLinks ( sv_areanodes, &clip );
+	// the way PF_findradius used to do it
+	start = Sys_DoubleTime ();
+	found[0] = 0;
+	for (n = 0; n < runs; n++)
+		for (k = 0; k < numspots; k++)
+		{
+			for (i = 0; i < 3; i++) {
+				mins[i] = spots[k][i] - rad - 1;
+				maxs[i] = spots[k][i] + rad + 1;
+			}
+			numtouch = SV_AreaEdicts (mins, maxs, touchlist, MAX_EDICTS, AREA_SOLID);
+			numtouch += SV_AreaEdicts (mins, maxs, &touchlist[numtouch], MAX_EDICTS - numtouch, AREA_TRIGGERS);
 
-	return clip.trace;
+			chain = sv.edicts;
+			for (i = 0; i < numtouch; i++)
+			{
+				ent = touchlist[i];
+				if (ent->v.solid == SOLID_NOT)
+					continue;
+				for (j = 0; j < 3; j++)
+					eorg[j] = spots[k][j] - (ent->v.origin[j] + (ent->v.mins[j] + ent->v.maxs[j]) * 0.5);
+				if (DotProduct(eorg, eorg) > rad2)
+					continue;
+				ent->v.chain = EDICT_TO_PROG(chain);
+				chain = ent;
+				found[0]++;
+			}
+		}
+	time[0] = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	found[1] = 0;
+	for (n = 0; n < runs; n++)
+		for (k = 0; k < numspots; k++)
+			for (chain = SV_FindRadius (spots[k], rad); chain != sv.edicts; chain = PROG_TO_EDICT(chain->v.chain))
+				found[1]++;
+	time[1] = Sys_DoubleTime () - start;
+
+	n = runs * numspots;
+	Com_Printf ("%i spots, %i runs, radius %i\n", numspots, runs, (int)rad);
+	Com_Printf ("         usec  found\n");
+	Com_Printf ("array: %6.3f  %5.2f\n", time[0] * 1000000 / n, (float)found[0] / n);
+	Com_Printf ("walk:  %6.3f  %5.2f\n", time[1] * 1000000 / n, (float)found[1] / n);
+	if (found[0] != found[1])
+		Com_Printf ("results differ!\n");
 }
 
 //=============================================================================
@@ -25,6 +25,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define	MOVE_NOMONSTERS	1
 #define	MOVE_MISSILE	2
 
+// the bounds of the entities on an area list, in the same order as the
+// list, so they can be checked several at a time without touching the edicts
+typedef struct areabounds_s
+{
+	int		count;			// slots in use, dead ones included
+	int		numdead;		// left by unlinked entities
+	int		maxcount;
+	float	*absmin[3];
+	float	*absmax[3];
+	struct edict_s	**ents;	// NULL for dead slots
+} areabounds_t;
+
 typedef struct areanode_s
 {
 	int		axis;		// -1 = leaf node
@@ -32,6 +44,8 @@ typedef struct areanode_s
 	struct areanode_s	*children[2];
 	link_t	trigger_edicts;
 	link_t	solid_edicts;
+	areabounds_t	trigger_bounds;
+	areabounds_t	solid_bounds;
 } areanode_t;
 
 #define AREA_SOLID		0
@@ -76,8 +90,46 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_TraceBatch (int count, vec3_t *starts, vec3_t mins, vec3_t maxs, vec3_t *ends, int type, edict_t *passedict, trace_t *traces);
+// traces[i] gets what SV_Trace (starts[i], mins, maxs, ends[i], type, passedict)
+// would return, with one walk of the world hull for all of them
+
 
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area);
 
+typedef void (*areafunc_t) (edict_t *ent, void *arg);
+void SV_AreaWalk (vec3_t mins, vec3_t maxs, int area, areafunc_t func, void *arg);
+// calls func for each entity linked in area whose box touches mins/maxs,
+// skipping SOLID_NOT ones as SV_AreaEdicts does, in the same order but with
+// no max_edicts limit; func must not link or unlink entities
+
+edict_t *SV_FindRadius (vec3_t org, float rad);
+// chains the entities within rad of org, like the findradius builtin
+
+int SV_AreaBoundsEdicts (areabounds_t *ab, vec3_t mins, vec3_t maxs, edict_t **edicts, int count, int max_edicts);
+// appends the entities of ab whose box touches mins/maxs to edicts[count],
+// returns the new count
+
+extern	cvar_t	sv_areagrid;
+qbool SV_UseAreaGrid (void);
+// true if sv_areagrid was set at map load, then sv_areanodes is not used
+
+void SV_BenchArea_f (void);
+
+extern	cvar_t	sv_triggerleafs;
+void SV_BenchTouch_f (void);
+
+void SV_BenchFindRadius_f (void);
+
+extern	cvar_t	sv_tracecache;
+void SV_ClearTraceCache (void);
+// forgets all cached traces, called at the start of each physics frame
+void SV_TraceFieldChanged (edict_t *ent);
+// must be called after C code changes a field clipping reads (solid,
+// owner, flags...) of a linked edict without relinking it
+void SV_TraceFieldAddressed (edict_t *ent);
+// OP_ADDRESS calls this for the same fields, before the store
+void SV_TraceStats_f (void);
+
 #endif /* _SV_WORLD_H_ */
 
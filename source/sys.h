@@ -27,11 +27,21 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 void Sys_mkdir (char *path);
 
+// maps a whole file read-only, returns NULL if that isn't possible
+void *Sys_MapFile (char *path, int *len);
+void Sys_UnmapFile (void *base, int len);
+
 //
 // memory protection
 //
 void Sys_MakeCodeWriteable (unsigned long startaddr, unsigned long length);
 
+// memory for generated code; Sys_AllocCode returns writeable memory or NULL,
+// Sys_ProtectCode makes it executable (and read-only) once it is filled in
+void *Sys_AllocCode (int size);
+void Sys_ProtectCode (void *base, int size);
+void Sys_FreeCode (void *base, int size);
+
 
 void Sys_Error (char *error, ...);
 // an error will cause the entire program to exit
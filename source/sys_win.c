@@ -68,6 +68,51 @@ void Sys_mkdir (char *path)
 	_mkdir (path);
 }
 
+/*
+================
+Sys_MapFile
+
+The view stays valid after the handles are closed, until Sys_UnmapFile
+================
+*/
+void *Sys_MapFile (char *path, int *len)
+{
+	HANDLE	file, mapping;
+	DWORD	size, sizehigh;
+	void	*base;
+
+	file = CreateFileA (path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	size = GetFileSize (file, &sizehigh);
+	if (size == INVALID_FILE_SIZE || sizehigh || !size || size > INT_MAX)
+	{
+		CloseHandle (file);
+		return NULL;
+	}
+
+	mapping = CreateFileMappingA (file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle (file);
+	if (!mapping)
+		return NULL;
+
+	base = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle (mapping);
+	if (!base)
+		return NULL;
+
+	*len = (int)size;
+	return base;
+}
+
+void Sys_UnmapFile (void *base, int len)
+{
+	(void)len;		// the whole view goes
+	UnmapViewOfFile (base);
+}
+
 
 /*
 ===============================================================================
@@ -91,6 +136,41 @@ void Sys_MakeCodeWriteable (unsigned long startaddr, unsigned long length)
    		Sys_Error("Protection change failed");
 }
 
+/*
+================
+Sys_AllocCode
+================
+*/
+void *Sys_AllocCode (int size)
+{
+	return VirtualAlloc (NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+/*
+================
+Sys_ProtectCode
+================
+*/
+void Sys_ProtectCode (void *base, int size)
+{
+	DWORD  flOldProtect;
+
+	if (!VirtualProtect (base, size, PAGE_EXECUTE_READ, &flOldProtect))
+		Sys_Error ("Protection change failed");
+	FlushInstructionCache (GetCurrentProcess(), base, size);
+}
+
+/*
+================
+Sys_FreeCode
+================
+*/
+void Sys_FreeCode (void *base, int size)
+{
+	(void)size;		// MEM_RELEASE takes the whole region
+	VirtualFree (base, 0, MEM_RELEASE);
+}
+
 
 void Sys_Error (char *error, ...)
 {
@@ -2061,9 +2061,10 @@ void TP_FindPoint (void)
 	
 		if (rank < best || best < 0) {
 			// check if we can actually see the object
-			vec3_t	end;
-			trace_t	trace;
+			vec3_t	starts[5], ends[5];
+			trace_t	traces[5];
 			float	radius;
+			int		j;
 
 			radius = item->radius;
 			if (ent->effects & (EF_BLUE|EF_RED|EF_DIMLIGHT|EF_BRIGHTLIGHT))
@@ -2075,46 +2076,32 @@ void TP_FindPoint (void)
 			// FIXME: is it ok to use PM_TraceLine here?
 			// physent list might not have been built yet...
 
+			// the centre and four edges of the item, all traced
+			// from vieworg in one walk of each hull
 			VectorSubtract (vieworg, entorg, v);
 			VectorNormalize (v);
-			VectorMA (entorg, radius, v, end);
-			trace = PM_TraceLine (vieworg, end);
-			if (trace.fraction == 1)
-				goto ok;
-
-			VectorMA (entorg, radius, right, end);
-			VectorSubtract (vieworg, end, v);
-			VectorNormalize (v);
-			VectorMA (end, radius, v, end);
-			trace = PM_TraceLine (vieworg, end);
-			if (trace.fraction == 1)
-				goto ok;
-
-			VectorMA (entorg, -radius, right, end);
-			VectorSubtract (vieworg, end, v);
-			VectorNormalize (v);
-			VectorMA (end, radius, v, end);
-			trace = PM_TraceLine (vieworg, end);
-			if (trace.fraction == 1)
-				goto ok;
-
-			VectorMA (entorg, radius, up, end);
-			VectorSubtract (vieworg, end, v);
-			VectorNormalize (v);
-			VectorMA (end, radius, v, end);
-			trace = PM_TraceLine (vieworg, end);
-			if (trace.fraction == 1)
-				goto ok;
+			VectorMA (entorg, radius, v, ends[0]);
 
+			VectorMA (entorg, radius, right, ends[1]);
+			VectorMA (entorg, -radius, right, ends[2]);
+			VectorMA (entorg, radius, up, ends[3]);
 			// use half the radius, otherwise it's possible to see
 			// through floor in some places
-			VectorMA (entorg, -radius/2, up, end);
-			VectorSubtract (vieworg, end, v);
-			VectorNormalize (v);
-			VectorMA (end, radius, v, end);
-			trace = PM_TraceLine (vieworg, end);
-			if (trace.fraction == 1)
-				goto ok;
+			VectorMA (entorg, -radius/2, up, ends[4]);
+
+			for (j = 0; j < 5; j++) {
+				VectorCopy (vieworg, starts[j]);
+				if (j) {
+					VectorSubtract (vieworg, ends[j], v);
+					VectorNormalize (v);
+					VectorMA (ends[j], radius, v, ends[j]);
+				}
+			}
+
+			PM_TraceLineBatch (5, starts, ends, traces);
+			for (j = 0; j < 5; j++)
+				if (traces[j].fraction == 1)
+					goto ok;
 
 			continue;	// not visible
 ok: